@@ -21,8 +21,8 @@
  * OF THIS SOFTWARE.
  */
 
-/* cliptest: for debugging calculate_edges() function, which is copied
- * from compositor.c.
+/* cliptest: for debugging calculate_edges() function, which clips the
+ * way gl-renderer.c does, using the code in src/vertex-clipping.c.
  * controls:
  *	clip box position: mouse left drag, keys: w a s d
  *	clip box size: mouse right drag, keys: i j k l
@@ -48,8 +48,7 @@
 #include <wayland-client.h>
 
 #include "window.h"
-
-typedef float GLfloat;
+#include "../src/vertex-clipping.h"
 
 struct geometry {
 	pixman_box32_t clip;
@@ -79,273 +78,30 @@ weston_surface_to_global_float(struct weston_surface *surface,
 	*y = -g->s * sx + g->c * sy;
 }
 
-/* ---------------------- copied begins -----------------------*/
-
-struct polygon8 {
-	GLfloat x[8];
-	GLfloat y[8];
-	int n;
-};
-
-struct clip_context {
-	struct {
-		GLfloat x;
-		GLfloat y;
-	} prev;
-
-	struct {
-		GLfloat x1, y1;
-		GLfloat x2, y2;
-	} clip;
-
-	struct {
-		GLfloat *x;
-		GLfloat *y;
-	} vertices;
-};
-
-static GLfloat
-float_difference(GLfloat a, GLfloat b)
-{
-	/* http://www.altdevblogaday.com/2012/02/22/comparing-floating-point-numbers-2012-edition/ */
-	static const GLfloat max_diff = 4.0f * FLT_MIN;
-	static const GLfloat max_rel_diff = 4.0e-5;
-	GLfloat diff = a - b;
-	GLfloat adiff = fabsf(diff);
-
-	if (adiff <= max_diff)
-		return 0.0f;
-
-	a = fabsf(a);
-	b = fabsf(b);
-	if (adiff <= (a > b ? a : b) * max_rel_diff)
-		return 0.0f;
-
-	return diff;
-}
-
-/* A line segment (p1x, p1y)-(p2x, p2y) intersects the line x = x_arg.
- * Compute the y coordinate of the intersection.
- */
-static GLfloat
-clip_intersect_y(GLfloat p1x, GLfloat p1y, GLfloat p2x, GLfloat p2y,
-		 GLfloat x_arg)
-{
-	GLfloat a;
-	GLfloat diff = float_difference(p1x, p2x);
-
-	/* Practically vertical line segment, yet the end points have already
-	 * been determined to be on different sides of the line. Therefore
-	 * the line segment is part of the line and intersects everywhere.
-	 * Return the end point, so we use the whole line segment.
-	 */
-	if (diff == 0.0f)
-		return p2y;
-
-	a = (x_arg - p2x) / diff;
-	return p2y + (p1y - p2y) * a;
-}
-
-/* A line segment (p1x, p1y)-(p2x, p2y) intersects the line y = y_arg.
- * Compute the x coordinate of the intersection.
- */
-static GLfloat
-clip_intersect_x(GLfloat p1x, GLfloat p1y, GLfloat p2x, GLfloat p2y,
-		 GLfloat y_arg)
-{
-	GLfloat a;
-	GLfloat diff = float_difference(p1y, p2y);
-
-	/* Practically horizontal line segment, yet the end points have already
-	 * been determined to be on different sides of the line. Therefore
-	 * the line segment is part of the line and intersects everywhere.
-	 * Return the end point, so we use the whole line segment.
-	 */
-	if (diff == 0.0f)
-		return p2x;
-
-	a = (y_arg - p2y) / diff;
-	return p2x + (p1x - p2x) * a;
-}
-
-enum path_transition {
-	PATH_TRANSITION_OUT_TO_OUT = 0,
-	PATH_TRANSITION_OUT_TO_IN = 1,
-	PATH_TRANSITION_IN_TO_OUT = 2,
-	PATH_TRANSITION_IN_TO_IN = 3,
-};
-
-static void
-clip_append_vertex(struct clip_context *ctx, GLfloat x, GLfloat y)
-{
-	*ctx->vertices.x++ = x;
-	*ctx->vertices.y++ = y;
-}
-
-static enum path_transition
-path_transition_left_edge(struct clip_context *ctx, GLfloat x, GLfloat y)
-{
-	return ((ctx->prev.x >= ctx->clip.x1) << 1) | (x >= ctx->clip.x1);
-}
-
-static enum path_transition
-path_transition_right_edge(struct clip_context *ctx, GLfloat x, GLfloat y)
-{
-	return ((ctx->prev.x < ctx->clip.x2) << 1) | (x < ctx->clip.x2);
-}
-
-static enum path_transition
-path_transition_top_edge(struct clip_context *ctx, GLfloat x, GLfloat y)
-{
-	return ((ctx->prev.y >= ctx->clip.y1) << 1) | (y >= ctx->clip.y1);
-}
-
-static enum path_transition
-path_transition_bottom_edge(struct clip_context *ctx, GLfloat x, GLfloat y)
-{
-	return ((ctx->prev.y < ctx->clip.y2) << 1) | (y < ctx->clip.y2);
-}
-
-static void
-clip_polygon_leftright(struct clip_context *ctx,
-		       enum path_transition transition,
-		       GLfloat x, GLfloat y, GLfloat clip_x)
-{
-	GLfloat yi;
-
-	switch (transition) {
-	case PATH_TRANSITION_IN_TO_IN:
-		clip_append_vertex(ctx, x, y);
-		break;
-	case PATH_TRANSITION_IN_TO_OUT:
-		yi = clip_intersect_y(ctx->prev.x, ctx->prev.y, x, y, clip_x);
-		clip_append_vertex(ctx, clip_x, yi);
-		break;
-	case PATH_TRANSITION_OUT_TO_IN:
-		yi = clip_intersect_y(ctx->prev.x, ctx->prev.y, x, y, clip_x);
-		clip_append_vertex(ctx, clip_x, yi);
-		clip_append_vertex(ctx, x, y);
-		break;
-	case PATH_TRANSITION_OUT_TO_OUT:
-		/* nothing */
-		break;
-	default:
-		assert(0 && "bad enum path_transition");
-	}
-
-	ctx->prev.x = x;
-	ctx->prev.y = y;
-}
-
-static void
-clip_polygon_topbottom(struct clip_context *ctx,
-		       enum path_transition transition,
-		       GLfloat x, GLfloat y, GLfloat clip_y)
-{
-	GLfloat xi;
-
-	switch (transition) {
-	case PATH_TRANSITION_IN_TO_IN:
-		clip_append_vertex(ctx, x, y);
-		break;
-	case PATH_TRANSITION_IN_TO_OUT:
-		xi = clip_intersect_x(ctx->prev.x, ctx->prev.y, x, y, clip_y);
-		clip_append_vertex(ctx, xi, clip_y);
-		break;
-	case PATH_TRANSITION_OUT_TO_IN:
-		xi = clip_intersect_x(ctx->prev.x, ctx->prev.y, x, y, clip_y);
-		clip_append_vertex(ctx, xi, clip_y);
-		clip_append_vertex(ctx, x, y);
-		break;
-	case PATH_TRANSITION_OUT_TO_OUT:
-		/* nothing */
-		break;
-	default:
-		assert(0 && "bad enum path_transition");
-	}
-
-	ctx->prev.x = x;
-	ctx->prev.y = y;
-}
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#define min(a, b) (((a) > (b)) ? (b) : (a))
 
 static void
-clip_context_prepare(struct clip_context *ctx, const struct polygon8 *src,
-		      GLfloat *dst_x, GLfloat *dst_y)
+surface_to_global_polygon(struct weston_surface *es, pixman_box32_t *surf_rect,
+			  struct polygon8 *surf)
 {
-	ctx->prev.x = src->x[src->n - 1];
-	ctx->prev.y = src->y[src->n - 1];
-	ctx->vertices.x = dst_x;
-	ctx->vertices.y = dst_y;
-}
-
-static int
-clip_polygon_left(struct clip_context *ctx, const struct polygon8 *src,
-		  GLfloat *dst_x, GLfloat *dst_y)
-{
-	enum path_transition trans;
 	int i;
 
-	clip_context_prepare(ctx, src, dst_x, dst_y);
-	for (i = 0; i < src->n; i++) {
-		trans = path_transition_left_edge(ctx, src->x[i], src->y[i]);
-		clip_polygon_leftright(ctx, trans, src->x[i], src->y[i],
-				       ctx->clip.x1);
-	}
-	return ctx->vertices.x - dst_x;
-}
+	surf->x[0] = surf_rect->x1;
+	surf->x[1] = surf_rect->x2;
+	surf->x[2] = surf_rect->x2;
+	surf->x[3] = surf_rect->x1;
+	surf->y[0] = surf_rect->y1;
+	surf->y[1] = surf_rect->y1;
+	surf->y[2] = surf_rect->y2;
+	surf->y[3] = surf_rect->y2;
+	surf->n = 4;
 
-static int
-clip_polygon_right(struct clip_context *ctx, const struct polygon8 *src,
-		   GLfloat *dst_x, GLfloat *dst_y)
-{
-	enum path_transition trans;
-	int i;
-
-	clip_context_prepare(ctx, src, dst_x, dst_y);
-	for (i = 0; i < src->n; i++) {
-		trans = path_transition_right_edge(ctx, src->x[i], src->y[i]);
-		clip_polygon_leftright(ctx, trans, src->x[i], src->y[i],
-				       ctx->clip.x2);
-	}
-	return ctx->vertices.x - dst_x;
-}
-
-static int
-clip_polygon_top(struct clip_context *ctx, const struct polygon8 *src,
-		 GLfloat *dst_x, GLfloat *dst_y)
-{
-	enum path_transition trans;
-	int i;
-
-	clip_context_prepare(ctx, src, dst_x, dst_y);
-	for (i = 0; i < src->n; i++) {
-		trans = path_transition_top_edge(ctx, src->x[i], src->y[i]);
-		clip_polygon_topbottom(ctx, trans, src->x[i], src->y[i],
-				       ctx->clip.y1);
-	}
-	return ctx->vertices.x - dst_x;
+	for (i = 0; i < surf->n; i++)
+		weston_surface_to_global_float(es, surf->x[i], surf->y[i],
+					       &surf->x[i], &surf->y[i]);
 }
 
-static int
-clip_polygon_bottom(struct clip_context *ctx, const struct polygon8 *src,
-		    GLfloat *dst_x, GLfloat *dst_y)
-{
-	enum path_transition trans;
-	int i;
-
-	clip_context_prepare(ctx, src, dst_x, dst_y);
-	for (i = 0; i < src->n; i++) {
-		trans = path_transition_bottom_edge(ctx, src->x[i], src->y[i]);
-		clip_polygon_topbottom(ctx, trans, src->x[i], src->y[i],
-				       ctx->clip.y2);
-	}
-	return ctx->vertices.x - dst_x;
-}
-
-#define max(a, b) (((a) > (b)) ? (a) : (b))
-#define min(a, b) (((a) > (b)) ? (b) : (a))
-#define clip(x, a, b)  min(max(x, a), b)
-
 /*
  * Compute the boundary vertices of the intersection of the global coordinate
  * aligned rectangle 'rect', and an arbitrary quadrilateral produced from
@@ -354,20 +110,18 @@ clip_polygon_bottom(struct clip_context *ctx, const struct polygon8 *src,
  * number of vertices. Vertices are produced in clockwise winding order.
  * Guarantees to produce either zero vertices, or 3-8 vertices with non-zero
  * polygon area.
+ *
+ * This is what gl-renderer.c did for each pair of rects before it clipped
+ * in batches; the benchmark compares the two.
  */
 static int
 calculate_edges(struct weston_surface *es, pixman_box32_t *rect,
 		pixman_box32_t *surf_rect, GLfloat *ex, GLfloat *ey)
 {
-	struct polygon8 polygon;
 	struct clip_context ctx;
 	int i, n;
 	GLfloat min_x, max_x, min_y, max_y;
-	struct polygon8 surf = {
-		{ surf_rect->x1, surf_rect->x2, surf_rect->x2, surf_rect->x1 },
-		{ surf_rect->y1, surf_rect->y1, surf_rect->y2, surf_rect->y2 },
-		4
-	};
+	struct polygon8 surf;
 
 	ctx.clip.x1 = rect->x1;
 	ctx.clip.y1 = rect->y1;
@@ -375,9 +129,7 @@ calculate_edges(struct weston_surface *es, pixman_box32_t *rect,
 	ctx.clip.y2 = rect->y2;
 
 	/* transform surface to screen space: */
-	for (i = 0; i < surf.n; i++)
-		weston_surface_to_global_float(es, surf.x[i], surf.y[i],
-					       &surf.x[i], &surf.y[i]);
+	surface_to_global_polygon(es, surf_rect, &surf);
 
 	/* find bounding box: */
 	min_x = max_x = surf.x[0];
@@ -401,40 +153,13 @@ calculate_edges(struct weston_surface *es, pixman_box32_t *rect,
 	 * there will be only four edges.  We just need to clip the surface
 	 * vertices to the clip rect bounds:
 	 */
-	if (!es->transform.enabled) {
-		for (i = 0; i < surf.n; i++) {
-			ex[i] = clip(surf.x[i], ctx.clip.x1, ctx.clip.x2);
-			ey[i] = clip(surf.y[i], ctx.clip.y1, ctx.clip.y2);
-		}
-		return surf.n;
-	}
+	if (!es->transform.enabled)
+		return clip_simple(&ctx, &surf, ex, ey);
 
 	/* Transformed case: use a general polygon clipping algorithm to
 	 * clip the surface rectangle with each side of 'rect'.
-	 * The algorithm is Sutherland-Hodgman, as explained in
-	 * http://www.codeguru.com/cpp/misc/misc/graphics/article.php/c8965/Polygon-Clipping.htm
-	 * but without looking at any of that code.
 	 */
-	polygon.n = clip_polygon_left(&ctx, &surf, polygon.x, polygon.y);
-	surf.n = clip_polygon_right(&ctx, &polygon, surf.x, surf.y);
-	polygon.n = clip_polygon_top(&ctx, &surf, polygon.x, polygon.y);
-	surf.n = clip_polygon_bottom(&ctx, &polygon, surf.x, surf.y);
-
-	/* Get rid of duplicate vertices */
-	ex[0] = surf.x[0];
-	ey[0] = surf.y[0];
-	n = 1;
-	for (i = 1; i < surf.n; i++) {
-		if (float_difference(ex[n - 1], surf.x[i]) == 0.0f &&
-		    float_difference(ey[n - 1], surf.y[i]) == 0.0f)
-			continue;
-		ex[n] = surf.x[i];
-		ey[n] = surf.y[i];
-		n++;
-	}
-	if (float_difference(ex[n - 1], surf.x[0]) == 0.0f &&
-	    float_difference(ey[n - 1], surf.y[0]) == 0.0f)
-		n--;
+	n = clip_transformed(&ctx, &surf, ex, ey);
 
 	if (n < 3)
 		return 0;
@@ -442,9 +167,6 @@ calculate_edges(struct weston_surface *es, pixman_box32_t *rect,
 	return n;
 }
 
-
-/* ---------------------- copied ends -----------------------*/
-
 static void
 geometry_set_phi(struct geometry *g, float phi)
 {
@@ -840,6 +562,65 @@ read_timer(void)
 	       1e-9 * (t.tv_nsec - begin_time.tv_nsec);
 }
 
+#define BENCH_GRID 8
+
+static void
+benchmark_batch(struct weston_surface *surface, struct geometry *geom)
+{
+	GLfloat x1[BENCH_GRID * BENCH_GRID], y1[BENCH_GRID * BENCH_GRID];
+	GLfloat x2[BENCH_GRID * BENCH_GRID], y2[BENCH_GRID * BENCH_GRID];
+	pixman_box32_t rects[BENCH_GRID * BENCH_GRID];
+	GLfloat ex[8 * BENCH_GRID * BENCH_GRID], ey[8 * BENCH_GRID * BENCH_GRID];
+	int vtxcnt[BENCH_GRID * BENCH_GRID];
+	struct clip_rects clip = { x1, y1, x2, y2, BENCH_GRID * BENCH_GRID };
+	struct polygon8 surf;
+	int i, j, k, n, npoly = 0, nsingle = 0;
+	double t;
+	const int N = 100000;
+
+	/* damage split into a grid of rects over and around the surface */
+	for (i = 0; i < BENCH_GRID; i++) {
+		for (j = 0; j < BENCH_GRID; j++) {
+			k = i * BENCH_GRID + j;
+			rects[k].x1 = -40 + j * 10;
+			rects[k].y1 = -40 + i * 10;
+			rects[k].x2 = rects[k].x1 + 10;
+			rects[k].y2 = rects[k].y1 + 10;
+			x1[k] = rects[k].x1;
+			y1[k] = rects[k].y1;
+			x2[k] = rects[k].x2;
+			y2[k] = rects[k].y2;
+		}
+	}
+
+	reset_timer();
+	for (i = 0; i < N; i++) {
+		geometry_set_phi(geom, (float)i / 360.0f);
+		for (k = 0; k < BENCH_GRID * BENCH_GRID; k++) {
+			n = calculate_edges(surface, &rects[k], &geom->surf,
+					    ex, ey);
+			nsingle += n >= 3;
+		}
+	}
+	t = read_timer();
+
+	printf("%d rects one at a time took %g s, average %g us/surface "
+	       "(%d polygons)\n", BENCH_GRID * BENCH_GRID, t, t / N * 1e6,
+	       nsingle);
+
+	reset_timer();
+	for (i = 0; i < N; i++) {
+		geometry_set_phi(geom, (float)i / 360.0f);
+		surface_to_global_polygon(surface, &geom->surf, &surf);
+		npoly += clip_transformed_batch(&surf, &clip, ex, ey, vtxcnt);
+	}
+	t = read_timer();
+
+	printf("%d rects in one batch took %g s, average %g us/surface "
+	       "(%d polygons)\n", BENCH_GRID * BENCH_GRID, t, t / N * 1e6,
+	       npoly);
+}
+
 static int
 benchmark(void)
 {
@@ -874,6 +655,8 @@ benchmark(void)
 
 	printf("%d calls took %g s, average %g us/call\n", N, t, t / N * 1e6);
 
+	benchmark_batch(&surface, &geom);
+
 	return 0;
 }
 
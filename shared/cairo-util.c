@@ -346,6 +346,7 @@ theme_create(void)
 	if (t == NULL)
 		return NULL;
 
+	memset(t->frame_cache, 0, sizeof t->frame_cache);
 	t->margin = 32;
 	t->width = 6;
 	t->titlebar_height = 27;
@@ -404,21 +405,33 @@ theme_create(void)
 void
 theme_destroy(struct theme *t)
 {
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_LENGTH(t->frame_cache); i++)
+		if (t->frame_cache[i])
+			cairo_surface_destroy(t->frame_cache[i]);
 	cairo_surface_destroy(t->active_frame);
 	cairo_surface_destroy(t->inactive_frame);
 	cairo_surface_destroy(t->shadow);
 	free(t);
 }
 
-void
-theme_render_frame(struct theme *t,
-		   cairo_t *cr, int width, int height,
-		   const char *title, uint32_t flags)
+/* theme_render_frame() draws the drop shadow with tile_mask() at
+ * (2, 2), 8 pixels larger than the frame, with 64 pixel corners. */
+#define SHADOW_OFFSET 2
+#define SHADOW_GROW 8
+#define SHADOW_CORNER 64
+
+/* Length of the edge pieces in a cached frame */
+#define FRAME_CACHE_EDGE 8
+
+static void
+theme_render_frame_border(struct theme *t,
+			  cairo_t *cr, int width, int height,
+			  int top_margin, uint32_t flags)
 {
-	cairo_text_extents_t extents;
-	cairo_font_extents_t font_extents;
 	cairo_surface_t *source;
-	int x, y, margin, top_margin;
+	int margin;
 
 	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
 	cairo_set_source_rgba(cr, 0, 0, 0, 0);
@@ -429,8 +442,9 @@ theme_render_frame(struct theme *t,
 	else {
 		cairo_set_source_rgba(cr, 0, 0, 0, 0.45);
 		tile_mask(cr, t->shadow,
-			  2, 2, width + 8, height + 8,
-			  64, 64);
+			  SHADOW_OFFSET, SHADOW_OFFSET,
+			  width + SHADOW_GROW, height + SHADOW_GROW,
+			  SHADOW_CORNER, SHADOW_CORNER);
 		margin = t->margin;
 	}
 
@@ -439,15 +453,177 @@ theme_render_frame(struct theme *t,
 	else
 		source = t->inactive_frame;
 
+	tile_source(cr, source,
+		    margin, margin,
+		    width - margin * 2, height - margin * 2,
+		    t->width, top_margin);
+}
+
+/* Size of the corners of the border drawn by
+ * theme_render_frame_border().  Everything between them only varies
+ * across the edge, not along it. */
+static void
+theme_get_frame_corners(struct theme *t, int top_margin, uint32_t flags,
+			int *left, int *right, int *top, int *bottom)
+{
+	int shadow_near, shadow_far;
+
+	if (flags & THEME_FRAME_MAXIMIZED) {
+		*left = t->width;
+		*right = t->width;
+		*top = top_margin;
+		*bottom = t->width;
+		return;
+	}
+
+	shadow_near = SHADOW_OFFSET + SHADOW_CORNER;
+	shadow_far = SHADOW_CORNER - SHADOW_OFFSET - SHADOW_GROW;
+
+	*left = t->margin + t->width;
+	if (*left < shadow_near)
+		*left = shadow_near;
+	*right = t->margin + t->width;
+	if (*right < shadow_far)
+		*right = shadow_far;
+	*top = t->margin + top_margin;
+	if (*top < shadow_near)
+		*top = shadow_near;
+	*bottom = t->margin + t->width;
+	if (*bottom < shadow_far)
+		*bottom = shadow_far;
+}
+
+/* The border for the given state, rendered once at the smallest size
+ * that holds all four corners plus a short stretch of each edge.
+ * The cache is shared by every frame using the theme. */
+static cairo_surface_t *
+theme_get_frame_cache(struct theme *t, int top_margin, uint32_t flags)
+{
+	cairo_surface_t *surface;
+	cairo_t *cr;
+	int left, right, top, bottom, key;
+
+	key = flags & (THEME_FRAME_ACTIVE | THEME_FRAME_MAXIMIZED);
+	if (top_margin != t->titlebar_height)
+		key |= THEME_FRAME_NO_TITLE;
+
+	if (t->frame_cache[key])
+		return t->frame_cache[key];
+
+	theme_get_frame_corners(t, top_margin, flags,
+				&left, &right, &top, &bottom);
+	surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+					     left + FRAME_CACHE_EDGE + right,
+					     top + FRAME_CACHE_EDGE + bottom);
+	cr = cairo_create(surface);
+	theme_render_frame_border(t, cr,
+				  left + FRAME_CACHE_EDGE + right,
+				  top + FRAME_CACHE_EDGE + bottom,
+				  top_margin, flags);
+	if (cairo_status(cr) != CAIRO_STATUS_SUCCESS) {
+		cairo_destroy(cr);
+		cairo_surface_destroy(surface);
+		return NULL;
+	}
+	cairo_destroy(cr);
+
+	t->frame_cache[key] = surface;
+
+	return surface;
+}
+
+/* Fill the destination rectangle with the source rectangle of
+ * pattern, scaled to fit. */
+static void
+paint_slice(cairo_t *cr, cairo_pattern_t *pattern,
+	    int sx, int sy, int sw, int sh, int dx, int dy, int dw, int dh)
+{
+	cairo_matrix_t matrix;
+
+	if (dw <= 0 || dh <= 0)
+		return;
+
+	cairo_matrix_init_translate(&matrix, sx, sy);
+	cairo_matrix_scale(&matrix, (double) sw / dw, (double) sh / dh);
+	cairo_matrix_translate(&matrix, -dx, -dy);
+	cairo_pattern_set_matrix(pattern, &matrix);
+	cairo_rectangle(cr, dx, dy, dw, dh);
+	cairo_fill(cr);
+}
+
+static void
+theme_compose_frame_border(struct theme *t,
+			   cairo_t *cr, int width, int height,
+			   int top_margin, uint32_t flags)
+{
+	cairo_surface_t *cache;
+	cairo_pattern_t *pattern;
+	int left, right, top, bottom, w, h, e;
+
+	theme_get_frame_corners(t, top_margin, flags,
+				&left, &right, &top, &bottom);
+	cache = NULL;
+	if (width >= left + right && height >= top + bottom)
+		cache = theme_get_frame_cache(t, top_margin, flags);
+	if (cache == NULL) {
+		theme_render_frame_border(t, cr, width, height,
+					  top_margin, flags);
+		return;
+	}
+
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_rgba(cr, 0, 0, 0, 0);
+	cairo_paint(cr);
+
+	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+	pattern = cairo_pattern_create_for_surface(cache);
+	cairo_pattern_set_filter(pattern, CAIRO_FILTER_NEAREST);
+	cairo_set_source(cr, pattern);
+
+	e = FRAME_CACHE_EDGE;
+	w = width - left - right;
+	h = height - top - bottom;
+
+	/* Corners */
+	paint_slice(cr, pattern, 0, 0, left, top, 0, 0, left, top);
+	paint_slice(cr, pattern, left + e, 0, right, top,
+		    width - right, 0, right, top);
+	paint_slice(cr, pattern, 0, top + e, left, bottom,
+		    0, height - bottom, left, bottom);
+	paint_slice(cr, pattern, left + e, top + e, right, bottom,
+		    width - right, height - bottom, right, bottom);
+
+	/* Edges */
+	paint_slice(cr, pattern, left, 0, e, top, left, 0, w, top);
+	paint_slice(cr, pattern, left, top + e, e, bottom,
+		    left, height - bottom, w, bottom);
+	paint_slice(cr, pattern, 0, top, left, e, 0, top, left, h);
+	paint_slice(cr, pattern, left + e, top, right, e,
+		    width - right, top, right, h);
+
+	cairo_pattern_destroy(pattern);
+}
+
+void
+theme_render_frame(struct theme *t,
+		   cairo_t *cr, int width, int height,
+		   const char *title, uint32_t flags)
+{
+	cairo_text_extents_t extents;
+	cairo_font_extents_t font_extents;
+	int x, y, margin, top_margin;
+
+	if (flags & THEME_FRAME_MAXIMIZED)
+		margin = 0;
+	else
+		margin = t->margin;
+
 	if (title)
 		top_margin = t->titlebar_height;
 	else
 		top_margin = t->width;
 
-	tile_source(cr, source,
-		    margin, margin,
-		    width - margin * 2, height - margin * 2,
-		    t->width, top_margin);
+	theme_compose_frame_border(t, cr, width, height, top_margin, flags);
 
 	if (title) {
 		cairo_rectangle (cr, margin + t->width, margin,
@@ -47,6 +47,8 @@ struct theme {
 	cairo_surface_t *active_frame;
 	cairo_surface_t *inactive_frame;
 	cairo_surface_t *shadow;
+	/* Pre-rendered borders, indexed by THEME_FRAME_* flags */
+	cairo_surface_t *frame_cache[8];
 	int frame_radius;
 	int margin;
 	int width;
@@ -22,6 +22,7 @@
 
 #include "config.h"
 
+#include <stdint.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -41,23 +42,133 @@
 	const __typeof__( ((type *)0)->member ) *__mptr = (ptr);	\
 	(type *)( (char *)__mptr - offsetof(type,member) );})
 
+/* Sections, entries and their strings are carved out of a few large
+ * blocks that are freed together, and looked up through hash tables
+ * built once the whole file is parsed.  Hash chains keep file order,
+ * so lookups return the same, first, match the old list walks did. */
+
+#define CONFIG_BLOCK_SIZE 4096
+
+struct config_block {
+	struct config_block *next;
+	size_t used, size;
+	char data[];
+};
+
 struct weston_config_entry {
 	char *key;
 	char *value;
+	uint32_t key_hash;
+	struct weston_config_section *section;
+	struct weston_config_entry *next_hash;	/* by section and key */
+	struct weston_config_entry *next_keyed;	/* by name, key and value */
 	struct wl_list link;
 };
 
 struct weston_config_section {
+	struct weston_config *config;
 	char *name;
+	uint32_t name_hash;
+	struct weston_config_section *next_hash;
 	struct wl_list entry_list;
 	struct wl_list link;
 };
 
 struct weston_config {
 	struct wl_list section_list;
+	struct config_block *blocks;
+	int num_sections, num_entries;
+
+	struct weston_config_section **section_table;
+	struct weston_config_entry **entry_table;
+	struct weston_config_entry **keyed_table;
+	uint32_t section_mask, entry_mask;
+
 	char path[PATH_MAX];
 };
 
+static void *
+config_alloc(struct weston_config *config, size_t size)
+{
+	struct config_block *block = config->blocks;
+	size_t block_size;
+	void *p;
+
+	size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+	if (block == NULL || block->size - block->used < size) {
+		block_size = size > CONFIG_BLOCK_SIZE ?
+			size : CONFIG_BLOCK_SIZE;
+		block = malloc(sizeof *block + block_size);
+		if (block == NULL)
+			return NULL;
+		block->used = 0;
+		block->size = block_size;
+		block->next = config->blocks;
+		config->blocks = block;
+	}
+
+	p = block->data + block->used;
+	block->used += size;
+
+	return p;
+}
+
+static char *
+config_strdup(struct weston_config *config, const char *s)
+{
+	size_t len = strlen(s) + 1;
+	char *p;
+
+	p = config_alloc(config, len);
+	if (p)
+		memcpy(p, s, len);
+
+	return p;
+}
+
+/* FNV-1a, continued across the strings of a compound key. */
+static uint32_t
+config_hash(uint32_t hash, const char *s)
+{
+	while (*s) {
+		hash ^= (unsigned char) *s++;
+		hash *= 16777619;
+	}
+
+	/* Separate the parts of a compound key. */
+	hash ^= 0xff;
+	hash *= 16777619;
+
+	return hash;
+}
+
+#define CONFIG_HASH_INIT 2166136261u
+
+static uint32_t
+entry_hash(struct weston_config_section *section, uint32_t key_hash)
+{
+	return key_hash ^ (uint32_t) ((uintptr_t) section * 2654435761u);
+}
+
+static uint32_t
+keyed_hash(const char *section, const char *key, const char *value)
+{
+	return config_hash(config_hash(config_hash(CONFIG_HASH_INIT,
+						   section), key), value);
+}
+
+static uint32_t
+table_mask(int count)
+{
+	uint32_t size = 16;
+
+	while (size < (uint32_t) count * 2)
+		size *= 2;
+
+	return size - 1;
+}
+
 static int
 open_config_file(struct weston_config *c, const char *name)
 {
@@ -119,12 +230,20 @@ static struct weston_config_entry *
 config_section_get_entry(struct weston_config_section *section,
 			 const char *key)
 {
+	struct weston_config *config;
 	struct weston_config_entry *e;
+	uint32_t key_hash, hash;
 
 	if (section == NULL)
 		return NULL;
-	wl_list_for_each(e, &section->entry_list, link)
-		if (strcmp(e->key, key) == 0)
+
+	config = section->config;
+	key_hash = config_hash(CONFIG_HASH_INIT, key);
+	hash = entry_hash(section, key_hash);
+	for (e = config->entry_table[hash & config->entry_mask];
+	     e; e = e->next_hash)
+		if (e->section == section && e->key_hash == key_hash &&
+		    strcmp(e->key, key) == 0)
 			return e;
 
 	return NULL;
@@ -137,19 +256,29 @@ weston_config_get_section(struct weston_config *config, const char *section,
 {
 	struct weston_config_section *s;
 	struct weston_config_entry *e;
+	uint32_t hash;
 
 	if (config == NULL)
 		return NULL;
-	wl_list_for_each(s, &config->section_list, link) {
-		if (strcmp(s->name, section) != 0)
-			continue;
-		if (key == NULL)
-			return s;
-		e = config_section_get_entry(s, key);
-		if (e && strcmp(e->value, value) == 0)
-			return s;
+
+	if (key == NULL) {
+		hash = config_hash(CONFIG_HASH_INIT, section);
+		for (s = config->section_table[hash & config->section_mask];
+		     s; s = s->next_hash)
+			if (s->name_hash == hash && strcmp(s->name, section) == 0)
+				return s;
+
+		return NULL;
 	}
 
+	hash = keyed_hash(section, key, value);
+	for (e = config->keyed_table[hash & config->entry_mask];
+	     e; e = e->next_keyed)
+		if (strcmp(e->value, value) == 0 &&
+		    strcmp(e->key, key) == 0 &&
+		    strcmp(e->section->name, section) == 0)
+			return e->section;
+
 	return NULL;
 }
 
@@ -287,10 +416,20 @@ config_add_section(struct weston_config *config, const char *name)
 {
 	struct weston_config_section *section;
 
-	section = malloc(sizeof *section);
-	section->name = strdup(name);
+	section = config_alloc(config, sizeof *section);
+	if (section == NULL)
+		return NULL;
+
+	section->name = config_strdup(config, name);
+	if (section->name == NULL)
+		return NULL;
+
+	section->config = config;
+	section->name_hash = config_hash(CONFIG_HASH_INIT, name);
+	section->next_hash = NULL;
 	wl_list_init(&section->entry_list);
 	wl_list_insert(config->section_list.prev, &section->link);
+	config->num_sections++;
 
 	return section;
 }
@@ -299,16 +438,89 @@ static struct weston_config_entry *
 section_add_entry(struct weston_config_section *section,
 		  const char *key, const char *value)
 {
+	struct weston_config *config = section->config;
 	struct weston_config_entry *entry;
 
-	entry = malloc(sizeof *entry);
-	entry->key = strdup(key);
-	entry->value = strdup(value);
+	entry = config_alloc(config, sizeof *entry);
+	if (entry == NULL)
+		return NULL;
+
+	entry->key = config_strdup(config, key);
+	entry->value = config_strdup(config, value);
+	if (entry->key == NULL || entry->value == NULL)
+		return NULL;
+
+	entry->key_hash = config_hash(CONFIG_HASH_INIT, key);
+	entry->section = section;
+	entry->next_hash = NULL;
+	entry->next_keyed = NULL;
 	wl_list_insert(section->entry_list.prev, &entry->link);
+	config->num_entries++;
 
 	return entry;
 }
 
+/* Walking backwards and pushing onto the chain heads leaves every
+ * chain in file order. */
+static int
+config_build_index(struct weston_config *config)
+{
+	struct weston_config_section *s;
+	struct weston_config_entry *e, **bucket;
+	uint32_t hash;
+
+	config->section_mask = table_mask(config->num_sections);
+	config->entry_mask = table_mask(config->num_entries);
+	config->section_table =
+		config_alloc(config, (config->section_mask + 1) *
+			     sizeof *config->section_table);
+	config->entry_table =
+		config_alloc(config, (config->entry_mask + 1) *
+			     sizeof *config->entry_table);
+	config->keyed_table =
+		config_alloc(config, (config->entry_mask + 1) *
+			     sizeof *config->keyed_table);
+	if (!config->section_table || !config->entry_table ||
+	    !config->keyed_table)
+		return -1;
+
+	memset(config->section_table, 0,
+	       (config->section_mask + 1) * sizeof *config->section_table);
+	memset(config->entry_table, 0,
+	       (config->entry_mask + 1) * sizeof *config->entry_table);
+	memset(config->keyed_table, 0,
+	       (config->entry_mask + 1) * sizeof *config->keyed_table);
+
+	wl_list_for_each_reverse(s, &config->section_list, link) {
+		s->next_hash =
+			config->section_table[s->name_hash &
+					      config->section_mask];
+		config->section_table[s->name_hash & config->section_mask] = s;
+
+		wl_list_for_each_reverse(e, &s->entry_list, link) {
+			hash = entry_hash(s, e->key_hash) & config->entry_mask;
+			e->next_hash = config->entry_table[hash];
+			config->entry_table[hash] = e;
+		}
+	}
+
+	/* Only the first occurrence of a key in a section counts for
+	 * keyed section lookups, as it does for the getters. */
+	wl_list_for_each_reverse(s, &config->section_list, link) {
+		wl_list_for_each_reverse(e, &s->entry_list, link) {
+			if (config_section_get_entry(s, e->key) != e)
+				continue;
+			hash = keyed_hash(s->name, e->key, e->value) &
+				config->entry_mask;
+			bucket = &config->keyed_table[hash];
+			e->next_keyed = *bucket;
+			*bucket = e;
+		}
+	}
+
+	return 0;
+}
+
 struct weston_config *
 weston_config_parse(const char *name)
 {
@@ -322,6 +534,7 @@ weston_config_parse(const char *name)
 	if (config == NULL)
 		return NULL;
 
+	memset(config, 0, sizeof *config);
 	wl_list_init(&config->section_list);
 
 	fd = open_config_file(config, name);
@@ -332,6 +545,7 @@ weston_config_parse(const char *name)
 
 	fp = fdopen(fd, "r");
 	if (fp == NULL) {
+		close(fd);
 		free(config);
 		return NULL;
 	}
@@ -352,6 +566,8 @@ weston_config_parse(const char *name)
 			}
 			p[0] = '\0';
 			section = config_add_section(config, &line[1]);
+			if (section == NULL)
+				goto oom;
 			continue;
 		default:
 			p = strchr(line, '=');
@@ -372,14 +588,26 @@ weston_config_parse(const char *name)
 				p[i - 1] = '\0';
 				i--;
 			}
-			section_add_entry(section, line, p);
+			if (section_add_entry(section, line, p) == NULL)
+				goto oom;
 			continue;
 		}
 	}
 
 	fclose(fp);
 
+	if (config_build_index(config) < 0) {
+		weston_config_destroy(config);
+		return NULL;
+	}
+
 	return config;
+
+oom:
+	fprintf(stderr, "out of memory parsing config file\n");
+	fclose(fp);
+	weston_config_destroy(config);
+	return NULL;
 }
 
 const char *
@@ -411,23 +639,43 @@ weston_config_next_section(struct weston_config *config,
 	return 1;
 }
 
+int
+weston_config_section_equal(struct weston_config_section *a,
+			    struct weston_config_section *b)
+{
+	struct wl_list *la, *lb;
+	struct weston_config_entry *ea, *eb;
+
+	if (a == NULL || b == NULL)
+		return a == b;
+
+	if (strcmp(a->name, b->name) != 0)
+		return 0;
+
+	for (la = a->entry_list.next, lb = b->entry_list.next;
+	     la != &a->entry_list && lb != &b->entry_list;
+	     la = la->next, lb = lb->next) {
+		ea = container_of(la, struct weston_config_entry, link);
+		eb = container_of(lb, struct weston_config_entry, link);
+		if (strcmp(ea->key, eb->key) != 0 ||
+		    strcmp(ea->value, eb->value) != 0)
+			return 0;
+	}
+
+	return la == &a->entry_list && lb == &b->entry_list;
+}
+
 void
 weston_config_destroy(struct weston_config *config)
 {
-	struct weston_config_section *s, *next_s;
-	struct weston_config_entry *e, *next_e;
+	struct config_block *block, *next;
 
 	if (config == NULL)
 		return;
 
-	wl_list_for_each_safe(s, next_s, &config->section_list, link) {
-		wl_list_for_each_safe(e, next_e, &s->entry_list, link) {
-			free(e->key);
-			free(e->value);
-			free(e);
-		}
-		free(s->name);
-		free(s);
+	for (block = config->blocks; block; block = next) {
+		next = block->next;
+		free(block);
 	}
 
 	free(config);
@@ -105,6 +105,10 @@ int weston_config_next_section(struct weston_config *config,
 			       struct weston_config_section **section,
 			       const char **name);
 
+int
+weston_config_section_equal(struct weston_config_section *a,
+			    struct weston_config_section *b);
+
 
 #ifdef  __cplusplus
 }
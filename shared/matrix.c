@@ -36,6 +36,14 @@
 
 #include "matrix.h"
 
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define MATRIX_HAVE_SSE 1
+#include <xmmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__aarch64__)
+#define MATRIX_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
 
 /*
  * Matrices are stored in column-major order, that is the array indices are:
@@ -56,25 +64,107 @@ weston_matrix_init(struct weston_matrix *matrix)
 	memcpy(matrix, &identity, sizeof identity);
 }
 
+/*
+ * Transform kernels: v[i] <- d * v[i] for count column vectors stored
+ * back to back. Multiplying m on the left by n is the same as
+ * transforming each of the four columns of m by n, so every matrix
+ * operation goes through one of these.
+ */
+
+MATRIX_TEST_EXPORT void
+matrix_transform_points_scalar(const float *d, float *v, unsigned int count)
+{
+	float t[4];
+	int i, j;
+
+	for (; count > 0; count--, v += 4) {
+		for (i = 0; i < 4; i++) {
+			t[i] = 0;
+			for (j = 0; j < 4; j++)
+				t[i] += v[j] * d[i + j * 4];
+		}
+		memcpy(v, t, sizeof t);
+	}
+}
+
+#ifdef MATRIX_HAVE_SSE
+static void __attribute__((target("sse")))
+matrix_transform_points_sse(const float *d, float *v, unsigned int count)
+{
+	__m128 c0 = _mm_loadu_ps(d);
+	__m128 c1 = _mm_loadu_ps(d + 4);
+	__m128 c2 = _mm_loadu_ps(d + 8);
+	__m128 c3 = _mm_loadu_ps(d + 12);
+	__m128 t;
+
+	for (; count > 0; count--, v += 4) {
+		t = _mm_mul_ps(c0, _mm_set1_ps(v[0]));
+		t = _mm_add_ps(t, _mm_mul_ps(c1, _mm_set1_ps(v[1])));
+		t = _mm_add_ps(t, _mm_mul_ps(c2, _mm_set1_ps(v[2])));
+		t = _mm_add_ps(t, _mm_mul_ps(c3, _mm_set1_ps(v[3])));
+		_mm_storeu_ps(v, t);
+	}
+}
+#endif
+
+#ifdef MATRIX_HAVE_NEON
+static void
+matrix_transform_points_neon(const float *d, float *v, unsigned int count)
+{
+	float32x4_t c0 = vld1q_f32(d);
+	float32x4_t c1 = vld1q_f32(d + 4);
+	float32x4_t c2 = vld1q_f32(d + 8);
+	float32x4_t c3 = vld1q_f32(d + 12);
+	float32x4_t t;
+
+	for (; count > 0; count--, v += 4) {
+		t = vmulq_n_f32(c0, v[0]);
+		t = vmlaq_n_f32(t, c1, v[1]);
+		t = vmlaq_n_f32(t, c2, v[2]);
+		t = vmlaq_n_f32(t, c3, v[3]);
+		vst1q_f32(v, t);
+	}
+}
+#endif
+
+static void
+matrix_transform_points_init(const float *d, float *v, unsigned int count);
+
+static void (*matrix_transform_points)(const float *d, float *v,
+				       unsigned int count) =
+	matrix_transform_points_init;
+
+/* Pick the kernel on first use. SSE is part of the x86-64 baseline but
+ * not of i386, so check the cpu there; a NEON build already requires
+ * NEON to run. */
+static void
+matrix_transform_points_init(const float *d, float *v, unsigned int count)
+{
+	matrix_transform_points = matrix_transform_points_scalar;
+#if defined(MATRIX_HAVE_SSE)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse"))
+		matrix_transform_points = matrix_transform_points_sse;
+#elif defined(MATRIX_HAVE_NEON)
+	matrix_transform_points = matrix_transform_points_neon;
+#endif
+
+	matrix_transform_points(d, v, count);
+}
+
 /* m <- n * m, that is, m is multiplied on the LEFT. */
 WL_EXPORT void
 weston_matrix_multiply(struct weston_matrix *m, const struct weston_matrix *n)
 {
 	struct weston_matrix tmp;
-	const float *row, *column;
-	div_t d;
-	int i, j;
 
-	for (i = 0; i < 16; i++) {
-		tmp.d[i] = 0;
-		d = div(i, 4);
-		row = m->d + d.quot * 4;
-		column = n->d + d.rem;
-		for (j = 0; j < 4; j++)
-			tmp.d[i] += row[j] * column[j * 4];
+	if (m == n) {
+		tmp = *n;
+		n = &tmp;
 	}
-	tmp.type = m->type | n->type;
-	memcpy(m, &tmp, sizeof tmp);
+
+	matrix_transform_points(n->d, m->d, 4);
+	m->type |= n->type;
 }
 
 WL_EXPORT void
@@ -114,16 +204,15 @@ weston_matrix_rotate_xy(struct weston_matrix *matrix, float cos, float sin)
 WL_EXPORT void
 weston_matrix_transform(struct weston_matrix *matrix, struct weston_vector *v)
 {
-	int i, j;
-	struct weston_vector t;
-
-	for (i = 0; i < 4; i++) {
-		t.f[i] = 0;
-		for (j = 0; j < 4; j++)
-			t.f[i] += v->f[j] * matrix->d[i + j * 4];
-	}
+	matrix_transform_points(matrix->d, v->f, 1);
+}
 
-	*v = t;
+/* v[i] <- m * v[i], for i in [0, count) */
+WL_EXPORT void
+weston_matrix_transform_points(const struct weston_matrix *matrix,
+			       struct weston_vector *v, unsigned int count)
+{
+	matrix_transform_points(matrix->d, v->f, count);
 }
 
 static inline void
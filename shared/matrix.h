@@ -57,6 +57,9 @@ void
 weston_matrix_rotate_xy(struct weston_matrix *matrix, float cos, float sin);
 void
 weston_matrix_transform(struct weston_matrix *matrix, struct weston_vector *v);
+void
+weston_matrix_transform_points(const struct weston_matrix *matrix,
+			       struct weston_vector *v, unsigned int count);
 
 int
 weston_matrix_invert(struct weston_matrix *inverse,
@@ -71,6 +74,9 @@ matrix_invert(double *A, unsigned *p, const struct weston_matrix *matrix);
 void
 inverse_transform(const double *LU, const unsigned *p, float *v);
 
+void
+matrix_transform_points_scalar(const float *d, float *v, unsigned int count);
+
 #else
 #  define MATRIX_TEST_EXPORT static
 #endif
@@ -30,6 +30,7 @@
 #include <sys/epoll.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/syscall.h>
 
 #include "os-compatibility.h"
 
@@ -169,6 +170,100 @@ os_create_anonymous_file(off_t size)
 	return fd;
 }
 
+#ifdef __NR_memfd_create
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC		0x0001U
+#define MFD_ALLOW_SEALING	0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS		1033
+#define F_SEAL_SEAL		0x0001
+#define F_SEAL_SHRINK		0x0002
+#define F_SEAL_GROW		0x0004
+#define F_SEAL_WRITE		0x0008
+#endif
+#endif
+
+static int
+write_all(int fd, const char *data, size_t size)
+{
+	ssize_t len;
+
+	while (size > 0) {
+		len = write(fd, data, size);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		data += len;
+		size -= len;
+	}
+
+	return 0;
+}
+
+/*
+ * Create an empty anonymous file that can be sealed with os_seal_file()
+ * once it has been filled in.  This is a memfd where memfd_create() is
+ * available and an os_create_anonymous_file() otherwise.
+ */
+int
+os_create_sealable_file(void)
+{
+#ifdef __NR_memfd_create
+	int fd;
+
+	fd = syscall(__NR_memfd_create, "weston-shared",
+		     MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd >= 0)
+		return fd;
+#endif
+
+	return os_create_anonymous_file(0);
+}
+
+/*
+ * Seal a file from os_create_sealable_file() against any further
+ * change to its size or contents.  Files that do not support sealing
+ * are left as they are; -1 is only returned when sealing a memfd fails.
+ */
+int
+os_seal_file(int fd)
+{
+#ifdef __NR_memfd_create
+	if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+		  F_SEAL_WRITE | F_SEAL_SEAL) < 0 && errno != EINVAL)
+		return -1;
+#endif
+
+	return 0;
+}
+
+/*
+ * Create an anonymous file holding a copy of the given data, meant to
+ * be shared read-only with clients.  Where memfd_create() is available
+ * the file is sealed, so that neither we nor any client can change or
+ * truncate it under the others; otherwise this falls back to
+ * os_create_anonymous_file().  The file offset is left at the end.
+ */
+int
+os_create_sealed_file(const void *data, size_t size)
+{
+	int fd;
+
+	fd = os_create_sealable_file();
+	if (fd < 0)
+		return -1;
+
+	if (write_all(fd, data, size) < 0 || os_seal_file(fd) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
 #ifndef HAVE_STRCHRNUL
 char *
 strchrnul(const char *s, int c)
@@ -46,6 +46,15 @@ os_epoll_create_cloexec(void);
 int
 os_create_anonymous_file(off_t size);
 
+int
+os_create_sealable_file(void);
+
+int
+os_seal_file(int fd);
+
+int
+os_create_sealed_file(const void *data, size_t size);
+
 #ifndef HAVE_STRCHRNUL
 char *
 strchrnul(const char *s, int c);
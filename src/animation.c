@@ -46,10 +46,106 @@ weston_spring_init(struct weston_spring *spring,
 	spring->max = 1.0;
 }
 
+/* The spring is integrated in 4 ms steps of
+ *
+ *   x' = x + (x - p) + h² (k/10 (T - x) - (1 + friction) (x - p))
+ *
+ * with h = 0.01 and p the previous position. In terms of the distance
+ * to the target, e = x - T, that is the linear recurrence
+ *
+ *   e' = (2 - a - b) e + (b - 1) e_p,  a = h² k/10,  b = h² (1 + friction)
+ *
+ * so n steps are the n-th power of its 2x2 matrix applied to (e, e_p).
+ * The power is taken by squaring, which bounds the cost by the bit
+ * length of n rather than by n. */
+static void
+spring_advance(struct weston_spring *spring, uint32_t steps)
+{
+	const double h2 = 0.01 * 0.01;
+	double a = h2 * spring->k / 10.0;
+	double b = h2 * (1.0 + spring->friction);
+	double m00 = 2.0 - a - b, m01 = b - 1.0, m10 = 1.0, m11 = 0.0;
+	double r00 = 1.0, r01 = 0.0, r10 = 0.0, r11 = 1.0;
+	double t00, t01, t10, t11;
+	double e, e_prev;
+
+	while (steps) {
+		if (steps & 1) {
+			t00 = r00 * m00 + r01 * m10;
+			t01 = r00 * m01 + r01 * m11;
+			t10 = r10 * m00 + r11 * m10;
+			t11 = r10 * m01 + r11 * m11;
+			r00 = t00; r01 = t01; r10 = t10; r11 = t11;
+		}
+
+		steps >>= 1;
+		if (!steps)
+			break;
+
+		t00 = m00 * m00 + m01 * m10;
+		t01 = m00 * m01 + m01 * m11;
+		t10 = m10 * m00 + m11 * m10;
+		t11 = m10 * m01 + m11 * m11;
+		m00 = t00; m01 = t01; m10 = t10; m11 = t11;
+	}
+
+	e = spring->current - spring->target;
+	e_prev = spring->previous - spring->target;
+
+	spring->current = spring->target + r00 * e + r01 * e_prev;
+	spring->previous = spring->target + r10 * e + r11 * e_prev;
+}
+
+static void
+spring_step(struct weston_spring *spring)
+{
+	const double step = 0.01;
+	double force, v, current;
+
+	current = spring->current;
+	v = current - spring->previous;
+	force = spring->k * (spring->target - current) / 10.0 +
+		(spring->previous - current) - v * spring->friction;
+
+	spring->current =
+		current + (current - spring->previous) +
+		force * step * step;
+	spring->previous = current;
+
+	switch (spring->clip) {
+	case WESTON_SPRING_OVERSHOOT:
+		break;
+
+	case WESTON_SPRING_CLAMP:
+		if (spring->current > spring->max) {
+			spring->current = spring->max;
+			spring->previous = spring->max;
+		} else if (spring->current < 0.0) {
+			spring->current = spring->min;
+			spring->previous = spring->min;
+		}
+		break;
+
+	case WESTON_SPRING_BOUNCE:
+		if (spring->current > spring->max) {
+			spring->current =
+				2 * spring->max - spring->current;
+			spring->previous =
+				2 * spring->max - spring->previous;
+		} else if (spring->current < spring->min) {
+			spring->current =
+				2 * spring->min - spring->current;
+			spring->previous =
+				2 * spring->min - spring->previous;
+		}
+		break;
+	}
+}
+
 WL_EXPORT void
 weston_spring_update(struct weston_spring *spring, uint32_t msec)
 {
-	double force, v, current, step;
+	uint32_t steps;
 
 	/* Limit the number of executions of the loop below by ensuring that
 	 * the timestamp for last update of the spring is no more than 1s ago.
@@ -62,49 +158,22 @@ weston_spring_update(struct weston_spring *spring, uint32_t msec)
 		spring->timestamp = msec - 1000;
 	}
 
-	step = 0.01;
-	while (4 < msec - spring->timestamp) {
-		current = spring->current;
-		v = current - spring->previous;
-		force = spring->k * (spring->target - current) / 10.0 +
-			(spring->previous - current) - v * spring->friction;
-
-		spring->current =
-			current + (current - spring->previous) +
-			force * step * step;
-		spring->previous = current;
-
-		switch (spring->clip) {
-		case WESTON_SPRING_OVERSHOOT:
-			break;
-
-		case WESTON_SPRING_CLAMP:
-			if (spring->current > spring->max) {
-				spring->current = spring->max;
-				spring->previous = spring->max;
-			} else if (spring->current < 0.0) {
-				spring->current = spring->min;
-				spring->previous = spring->min;
-			}
-			break;
+	if (msec - spring->timestamp <= 4)
+		return;
 
-		case WESTON_SPRING_BOUNCE:
-			if (spring->current > spring->max) {
-				spring->current =
-					2 * spring->max - spring->current;
-				spring->previous =
-					2 * spring->max - spring->previous;
-			} else if (spring->current < spring->min) {
-				spring->current =
-					2 * spring->min - spring->current;
-				spring->previous =
-					2 * spring->min - spring->previous;
-			}
-			break;
-		}
+	/* Number of 4 ms steps until at most 4 ms are left over. */
+	steps = (msec - spring->timestamp - 1) / 4;
+	spring->timestamp += 4 * steps;
 
-		spring->timestamp += 4;
+	/* Clamping and bouncing act on every step, so only a free spring
+	 * can skip ahead in one go. */
+	if (spring->clip == WESTON_SPRING_OVERSHOOT) {
+		spring_advance(spring, steps);
+		return;
 	}
+
+	while (steps--)
+		spring_step(spring);
 }
 
 WL_EXPORT int
@@ -160,6 +229,9 @@ weston_view_animation_frame(struct weston_animation *base,
 	struct weston_view_animation *animation =
 		container_of(base,
 			     struct weston_view_animation, animation);
+	struct weston_matrix matrix;
+	float alpha;
+	int geometry_changed;
 
 	if (base->frame_counter <= 1)
 		animation->spring.timestamp = msecs;
@@ -172,10 +244,20 @@ weston_view_animation_frame(struct weston_animation *base,
 		return;
 	}
 
+	matrix = animation->transform.matrix;
+	alpha = animation->view->alpha;
+
 	if (animation->frame)
 		animation->frame(animation);
 
-	weston_view_geometry_dirty(animation->view);
+	/* Alpha only needs the transformation redone when it moves to or
+	 * from 1.0, where the view's opaque region changes. */
+	geometry_changed =
+		memcmp(&matrix, &animation->transform.matrix,
+		       sizeof matrix) != 0 ||
+		(alpha == 1.0) != (animation->view->alpha == 1.0);
+
+	weston_view_damage_animation(animation->view, geometry_changed);
 	weston_view_schedule_repaint(animation->view);
 }
 
@@ -34,8 +34,22 @@ struct weston_binding {
 	void *handler;
 	void *data;
 	struct wl_list link;
+	struct wl_list hash_link;
 };
 
+/* Key and button bindings are chained into a bucket picked from the
+ * (key or button, modifier) pair in addition to the registration
+ * ordered list. Appending to the bucket keeps bindings for the same
+ * pair in registration order, so dispatch calls them in the same order
+ * as a walk of the full list would. */
+static uint32_t
+binding_hash(uint32_t code, uint32_t modifier)
+{
+	uint32_t hash = (code ^ (modifier << 9)) * 2654435761u;
+
+	return (hash >> 16) & (WESTON_BINDING_HASH_SIZE - 1);
+}
+
 static struct weston_binding *
 weston_compositor_add_binding(struct weston_compositor *compositor,
 			      uint32_t key, uint32_t button, uint32_t axis,
@@ -53,6 +67,7 @@ weston_compositor_add_binding(struct weston_compositor *compositor,
 	binding->modifier = modifier;
 	binding->handler = handler;
 	binding->data = data;
+	wl_list_init(&binding->hash_link);
 
 	return binding;
 }
@@ -71,6 +86,9 @@ weston_compositor_add_key_binding(struct weston_compositor *compositor,
 		return NULL;
 
 	wl_list_insert(compositor->key_binding_list.prev, &binding->link);
+	wl_list_insert(compositor->key_binding_hash[binding_hash(key,
+								 modifier)].prev,
+		       &binding->hash_link);
 
 	return binding;
 }
@@ -89,6 +107,9 @@ weston_compositor_add_button_binding(struct weston_compositor *compositor,
 		return NULL;
 
 	wl_list_insert(compositor->button_binding_list.prev, &binding->link);
+	wl_list_insert(compositor->button_binding_hash[binding_hash(button,
+								    modifier)].prev,
+		       &binding->hash_link);
 
 	return binding;
 }
@@ -149,6 +170,7 @@ WL_EXPORT void
 weston_binding_destroy(struct weston_binding *binding)
 {
 	wl_list_remove(&binding->link);
+	wl_list_remove(&binding->hash_link);
 	free(binding);
 }
 
@@ -244,11 +266,14 @@ weston_compositor_run_key_binding(struct weston_compositor *compositor,
 				  enum wl_keyboard_key_state state)
 {
 	struct weston_binding *b;
+	struct wl_list *bucket;
 
 	if (state == WL_KEYBOARD_KEY_STATE_RELEASED)
 		return;
 
-	wl_list_for_each(b, &compositor->key_binding_list, link) {
+	bucket = &compositor->key_binding_hash[binding_hash(key,
+					seat->modifier_state)];
+	wl_list_for_each(b, bucket, hash_link) {
 		if (b->key == key && b->modifier == seat->modifier_state) {
 			weston_key_binding_handler_t handler = b->handler;
 			handler(seat, time, key, b->data);
@@ -270,11 +295,14 @@ weston_compositor_run_button_binding(struct weston_compositor *compositor,
 				     enum wl_pointer_button_state state)
 {
 	struct weston_binding *b;
+	struct wl_list *bucket;
 
 	if (state == WL_POINTER_BUTTON_STATE_RELEASED)
 		return;
 
-	wl_list_for_each(b, &compositor->button_binding_list, link) {
+	bucket = &compositor->button_binding_hash[binding_hash(button,
+					seat->modifier_state)];
+	wl_list_for_each(b, bucket, hash_link) {
 		if (b->button == button && b->modifier == seat->modifier_state) {
 			weston_button_binding_handler_t handler = b->handler;
 			handler(seat, time, button, b->data);
@@ -26,14 +26,24 @@
 #include <string.h>
 #include <linux/input.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <unistd.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
 
 #include "compositor.h"
+#include "../shared/os-compatibility.h"
+
+/* Selections are copied into an anonymous file, sealed once complete,
+ * and served to clients straight from it with sendfile(). */
+
+#define CLIPBOARD_CHUNK_SIZE		(64 * 1024)
+#define CLIPBOARD_DEFAULT_MAX_SIZE	(128 * 1024 * 1024)
 
 struct clipboard_source {
 	struct weston_data_source base;
-	struct wl_array contents;
+	int data_fd;
+	size_t size;
 	struct clipboard *clipboard;
 	struct wl_event_source *event_source;
 	uint32_t serial;
@@ -46,6 +56,7 @@ struct clipboard {
 	struct wl_listener selection_listener;
 	struct wl_listener destroy_listener;
 	struct clipboard_source *source;
+	size_t max_size;
 };
 
 static void clipboard_client_create(struct clipboard_source *source, int fd);
@@ -68,35 +79,96 @@ clipboard_source_unref(struct clipboard_source *source)
 	s = source->base.mime_types.data;
 	free(*s);
 	wl_array_release(&source->base.mime_types);
-	wl_array_release(&source->contents);
+	close(source->data_fd);
 	free(source);
 }
 
+/* Move up to len bytes from the pipe into the data file at the current
+ * size, preferring splice() so the data never passes through user
+ * space. */
+static ssize_t
+clipboard_source_fill(struct clipboard_source *source, int fd, size_t len)
+{
+	char buffer[CLIPBOARD_CHUNK_SIZE];
+	loff_t offset = source->size;
+	ssize_t ret, written, n;
+
+	ret = splice(fd, NULL, source->data_fd, &offset, len,
+		     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (ret >= 0 || (errno != EINVAL && errno != ENOSYS))
+		return ret;
+
+	if (len > sizeof buffer)
+		len = sizeof buffer;
+	ret = read(fd, buffer, len);
+	if (ret <= 0)
+		return ret;
+
+	/* The bytes are gone from the pipe, so a write that can't
+	 * complete loses the selection. */
+	for (written = 0; written < ret; written += n) {
+		n = pwrite(source->data_fd, buffer + written, ret - written,
+			   source->size + written);
+		if (n < 0 && errno == EINTR)
+			n = 0;
+		else if (n <= 0)
+			return -1;
+	}
+
+	return ret;
+}
+
+/* Stop reading from the client and drop the compositor's reference to
+ * the selection.  Readers may still hold references of their own, so
+ * the fd has to go now rather than in the final unref. */
+static void
+clipboard_source_drop(struct clipboard_source *source)
+{
+	struct clipboard *clipboard = source->clipboard;
+
+	if (source->event_source) {
+		wl_event_source_remove(source->event_source);
+		close(source->fd);
+		source->event_source = NULL;
+	}
+
+	clipboard_source_unref(source);
+	if (clipboard->source == source)
+		clipboard->source = NULL;
+}
+
 static int
 clipboard_source_data(int fd, uint32_t mask, void *data)
 {
 	struct clipboard_source *source = data;
 	struct clipboard *clipboard = source->clipboard;
-	char *p;
-	int len, size;
+	size_t room;
+	ssize_t len;
 
-	if (source->contents.alloc - source->contents.size < 1024) {
-		wl_array_add(&source->contents, 1024);
-		source->contents.size -= 1024;
-	}
+	/* Ask for one byte past the cap, so hitting it exactly is not
+	 * mistaken for overflowing it. */
+	room = clipboard->max_size - source->size + 1;
+	if (room > CLIPBOARD_CHUNK_SIZE)
+		room = CLIPBOARD_CHUNK_SIZE;
+
+	len = clipboard_source_fill(source, fd, room);
+	if (len < 0 && (errno == EAGAIN || errno == EINTR))
+		return 1;
 
-	p = source->contents.data + source->contents.size;
-	size = source->contents.alloc - source->contents.size;
-	len = read(fd, p, size);
 	if (len == 0) {
 		wl_event_source_remove(source->event_source);
 		close(fd);
 		source->event_source = NULL;
+		if (os_seal_file(source->data_fd) < 0)
+			weston_log("clipboard: failed to seal selection: %m\n");
 	} else if (len < 0) {
-		clipboard_source_unref(source);
-		clipboard->source = NULL;
+		clipboard_source_drop(source);
+	} else if (source->size + len > clipboard->max_size) {
+		weston_log("clipboard: selection larger than %zu bytes, "
+			   "not keeping it\n", clipboard->max_size);
+		clipboard_source_drop(source);
 	} else {
-		source->contents.size += len;
+		source->size += len;
 	}
 
 	return 1;
@@ -141,7 +213,11 @@ clipboard_source_create(struct clipboard *clipboard,
 	if (source == NULL)
 		return NULL;
 
-	wl_array_init(&source->contents);
+	source->data_fd = os_create_sealable_file();
+	if (source->data_fd < 0)
+		goto err_file;
+	source->size = 0;
+
 	wl_array_init(&source->base.mime_types);
 	source->base.resource = NULL;
 	source->base.accept = clipboard_source_accept;
@@ -158,6 +234,7 @@ clipboard_source_create(struct clipboard *clipboard,
 	*s = strdup(mime_type);
 	if (*s == NULL)
 		goto err_strdup;
+	source->fd = fd;
 	source->event_source =
 		wl_event_loop_add_fd(loop, fd, WL_EVENT_READABLE,
 				     clipboard_source_data, source);
@@ -171,6 +248,8 @@ clipboard_source_create(struct clipboard *clipboard,
  err_strdup:
 	wl_array_release(&source->base.mime_types);
  err_add:
+	close(source->data_fd);
+ err_file:
 	free(source);
 
 	return NULL;
@@ -178,25 +257,46 @@ clipboard_source_create(struct clipboard *clipboard,
 
 struct clipboard_client {
 	struct wl_event_source *event_source;
-	size_t offset;
+	off_t offset;
 	struct clipboard_source *source;
 };
 
+static ssize_t
+clipboard_client_send(struct clipboard_client *client, int fd, size_t len)
+{
+	char buffer[CLIPBOARD_CHUNK_SIZE];
+	ssize_t ret;
+
+	ret = sendfile(fd, client->source->data_fd, &client->offset, len);
+	if (ret >= 0 || (errno != EINVAL && errno != ENOSYS))
+		return ret;
+
+	if (len > sizeof buffer)
+		len = sizeof buffer;
+	ret = pread(client->source->data_fd, buffer, len, client->offset);
+	if (ret <= 0)
+		return ret;
+
+	ret = write(fd, buffer, ret);
+	if (ret > 0)
+		client->offset += ret;
+
+	return ret;
+}
+
 static int
 clipboard_client_data(int fd, uint32_t mask, void *data)
 {
 	struct clipboard_client *client = data;
-	char *p;
 	size_t size;
-	int len;
+	ssize_t len;
 
-	size = client->source->contents.size;
-	p = client->source->contents.data;
-	len = write(fd, p + client->offset, size - client->offset);
-	if (len > 0)
-		client->offset += len;
+	size = client->source->size;
+	len = clipboard_client_send(client, fd, size - client->offset);
+	if (len < 0 && (errno == EAGAIN || errno == EINTR))
+		return 1;
 
-	if (client->offset == size || len <= 0) {
+	if ((size_t) client->offset == size || len <= 0) {
 		close(fd);
 		wl_event_source_remove(client->event_source);
 		clipboard_source_unref(client->source);
@@ -215,6 +315,14 @@ clipboard_client_create(struct clipboard_source *source, int fd)
 		wl_display_get_event_loop(seat->compositor->wl_display);
 
 	client = malloc(sizeof *client);
+	if (client == NULL) {
+		close(fd);
+		return;
+	}
+
+	/* Never block the compositor on a reader that is slow to drain
+	 * its end of the pipe. */
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
 
 	client->offset = 0;
 	client->source = source;
@@ -246,9 +354,7 @@ clipboard_set_selection(struct wl_listener *listener, void *data)
 	}
 
 	if (clipboard->source)
-		clipboard_source_unref(clipboard->source);
-
-	clipboard->source = NULL;
+		clipboard_source_drop(clipboard->source);
 
 	mime_types = source->mime_types.data;
 
@@ -282,12 +388,21 @@ struct clipboard *
 clipboard_create(struct weston_seat *seat)
 {
 	struct clipboard *clipboard;
+	struct weston_config_section *s;
+	uint32_t max_size;
 
 	clipboard = zalloc(sizeof *clipboard);
 	if (clipboard == NULL)
 		return NULL;
 
 	clipboard->seat = seat;
+	clipboard->max_size = CLIPBOARD_DEFAULT_MAX_SIZE;
+	s = weston_config_get_section(seat->compositor->config,
+				      "core", NULL, NULL);
+	if (weston_config_section_get_uint(s, "clipboard-max-size",
+					   &max_size, 0) == 0 && max_size > 0)
+		clipboard->max_size = max_size;
+
 	clipboard->selection_listener.notify = clipboard_set_selection;
 	clipboard->destroy_listener.notify = clipboard_destroy;
 
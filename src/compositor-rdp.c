@@ -25,6 +25,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
 #include <linux/input.h>
 
 #include <freerdp/freerdp.h>
@@ -38,9 +42,21 @@
 
 #include "compositor.h"
 #include "pixman-renderer.h"
+#include "rdp-raw.h"
 
 #define MAX_FREERDP_FDS 32
 #define DEFAULT_AXIS_STEP_DISTANCE wl_fixed_from_int(10)
+#define DEFAULT_ENCODER_THREADS 2
+#define MAX_ENCODER_THREADS 16
+#define RFX_TILE_SIZE 64
+#define RDP_FRAME_HISTORY 32
+#define RDP_MAX_UNACKED_FRAMES 2
+#define RDP_ACK_TIMEOUT_USEC 2000000
+#define RDP_MAX_POINTER_SIZE 96
+
+#ifndef CAPSET_TYPE_FRAME_ACKNOWLEDGE
+#define CAPSET_TYPE_FRAME_ACKNOWLEDGE 0x001E
+#endif
 
 struct rdp_compositor_config {
 	int width;
@@ -52,9 +68,11 @@ struct rdp_compositor_config {
 	char *server_key;
 	char *extra_modes;
 	int env_socket;
+	int encoder_threads;
 };
 
 struct rdp_output;
+struct rdp_encoder;
 
 struct rdp_compositor {
 	struct weston_compositor base;
@@ -62,6 +80,7 @@ struct rdp_compositor {
 	freerdp_listener *listener;
 	struct wl_event_source *listener_events[MAX_FREERDP_FDS];
 	struct rdp_output *output;
+	struct rdp_encoder *encoder;
 
 	char *server_cert;
 	char *server_key;
@@ -86,10 +105,84 @@ struct rdp_output {
 	struct weston_output base;
 	struct wl_event_source *finish_frame_timer;
 	pixman_image_t *shadow_surface;
+	struct weston_plane cursor_plane;
 
 	struct wl_list peers;
 };
 
+struct rdp_encoder_frame;
+
+/* A horizontal slice of a frame, aligned on the RemoteFX tile grid, that
+ * a worker thread encodes on its own with one of the peer's slice
+ * contexts. */
+struct rdp_encoder_slice {
+	struct rdp_encoder_frame *frame;
+	struct wl_list link;
+
+	RFX_CONTEXT *rfx_context;
+	wStream *stream;
+	RFX_RECT *rects;
+	int nrects;
+	int y, height;		/* relative to the frame extents */
+	uint32_t encode_usec;
+};
+
+struct rdp_encoder_frame {
+	struct rdp_peer_context *peer;
+	struct wl_list link;
+
+	pixman_image_t *snapshot;
+	pixman_box32_t extents;
+	struct rdp_encoder_slice *slices;
+	int slice_count;
+	int pending;		/* slices not encoded yet, under encoder mutex */
+	uint64_t submit_usec;
+};
+
+struct rdp_encoder {
+	struct rdp_compositor *compositor;
+
+	pthread_t threads[MAX_ENCODER_THREADS];
+	int thread_count;
+	pthread_mutex_t mutex;
+	pthread_cond_t job_cond;
+	pthread_cond_t done_cond;
+	int destroying;
+
+	struct wl_list jobs;		/* rdp_encoder_slice::link */
+	struct wl_list done;		/* rdp_encoder_frame::link */
+
+	int done_fd;
+	struct wl_event_source *done_source;
+};
+
+struct rdp_encoder_stats {
+	uint32_t frames;
+	uint64_t total_latency_usec;
+	uint64_t total_encode_usec;
+	uint32_t max_latency_usec;
+};
+
+/* Frame acknowledgement based flow control: a peer only gets a new frame
+ * when it has less than max_unacked frames in flight, damage is held back
+ * and merged otherwise. */
+struct rdp_peer_flow {
+	uint32_t max_unacked;		/* 0 if the peer does not ack */
+	uint32_t last_frame_id;
+	uint32_t last_acked_id;
+	uint64_t sent_usec[RDP_FRAME_HISTORY];
+	uint32_t sent_bytes[RDP_FRAME_HISTORY];
+	uint32_t frame_bytes;
+	pixman_region32_t held_damage;
+
+	uint32_t frames_sent;
+	uint32_t frames_held;
+	uint32_t rtt_usec;		/* smoothed */
+	uint32_t throughput;		/* acknowledged bytes per second */
+	uint64_t window_start_usec;
+	uint32_t window_bytes;
+};
+
 struct rdp_peer_context {
 	rdpContext _p;
 
@@ -99,6 +192,29 @@ struct rdp_peer_context {
 	wStream *encode_stream;
 	RFX_RECT *rfx_rects;
 	NSC_CONTEXT *nsc_context;
+	struct rdp_raw_encoder raw_encoder;
+
+	/* threaded RemoteFX encoding, one context per slice */
+	RFX_CONTEXT *slice_rfx_contexts[MAX_ENCODER_THREADS];
+	wStream *slice_streams[MAX_ENCODER_THREADS];
+	struct rdp_encoder_frame *encoding_frame;
+	pixman_region32_t pending_damage;
+	struct rdp_encoder_stats encoder_stats;
+
+	struct rdp_peer_flow flow;
+
+	/* the tiles as last sent to this peer */
+	struct weston_tile_hash *tile_hash;
+
+	/* the peer's pointer sprite, drawn by the client */
+	int pointer_enabled;
+	int pointer_visible;
+	struct weston_view *cursor_view;
+	struct weston_buffer *cursor_buffer;
+	int cursor_damaged;
+	wl_fixed_t pointer_x, pointer_y;
+	BYTE pointer_xor[RDP_MAX_POINTER_SIZE * RDP_MAX_POINTER_SIZE * 4];
+	BYTE pointer_and[RDP_MAX_POINTER_SIZE * RDP_MAX_POINTER_SIZE / 8];
 
 	struct rdp_peers_item item;
 };
@@ -115,6 +231,58 @@ rdp_compositor_config_init(struct rdp_compositor_config *config) {
 	config->server_key = NULL;
 	config->extra_modes = NULL;
 	config->env_socket = 0;
+	config->encoder_threads = DEFAULT_ENCODER_THREADS;
+}
+
+static uint64_t
+rdp_get_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void
+rdp_peer_begin_frame(freerdp_peer *peer)
+{
+	RdpPeerContext *context = (RdpPeerContext *)peer->context;
+	rdpUpdate *update = peer->update;
+	SURFACE_FRAME_MARKER *marker = &update->surface_frame_marker;
+
+	marker->frameId++;
+	marker->frameAction = SURFACECMD_FRAMEACTION_BEGIN;
+	update->SurfaceFrameMarker(peer->context, marker);
+
+	context->flow.frame_bytes = 0;
+}
+
+static void
+rdp_peer_surface_bits(freerdp_peer *peer, SURFACE_BITS_COMMAND *cmd)
+{
+	RdpPeerContext *context = (RdpPeerContext *)peer->context;
+
+	context->flow.frame_bytes += cmd->bitmapDataLength;
+	peer->update->SurfaceBits(peer->context, cmd);
+}
+
+static void
+rdp_peer_end_frame(freerdp_peer *peer)
+{
+	RdpPeerContext *context = (RdpPeerContext *)peer->context;
+	struct rdp_peer_flow *flow = &context->flow;
+	rdpUpdate *update = peer->update;
+	SURFACE_FRAME_MARKER *marker = &update->surface_frame_marker;
+	int i;
+
+	marker->frameAction = SURFACECMD_FRAMEACTION_END;
+	update->SurfaceFrameMarker(peer->context, marker);
+
+	i = marker->frameId % RDP_FRAME_HISTORY;
+	flow->sent_usec[i] = rdp_get_usec();
+	flow->sent_bytes[i] = flow->frame_bytes;
+	flow->last_frame_id = marker->frameId;
+	flow->frames_sent++;
 }
 
 static void
@@ -167,7 +335,7 @@ rdp_peer_refresh_rfx(pixman_region32_t *damage, pixman_image_t *image, freerdp_p
 	cmd->bitmapDataLength = Stream_GetPosition(context->encode_stream);
 	cmd->bitmapData = Stream_Buffer(context->encode_stream);
 
-	update->SurfaceBits(update->context, cmd);
+	rdp_peer_surface_bits(peer, cmd);
 }
 
 
@@ -203,92 +371,723 @@ rdp_peer_refresh_nsc(pixman_region32_t *damage, pixman_image_t *image, freerdp_p
 			pixman_image_get_stride(image));
 	cmd->bitmapDataLength = Stream_GetPosition(context->encode_stream);
 	cmd->bitmapData = Stream_Buffer(context->encode_stream);
-	update->SurfaceBits(update->context, cmd);
+	rdp_peer_surface_bits(peer, cmd);
 }
 
 static void
-pixman_image_flipped_subrect(const pixman_box32_t *rect, pixman_image_t *img, BYTE *dest) {
-	int stride = pixman_image_get_stride(img);
-	int h;
-	int toCopy = (rect->x2 - rect->x1) * 4;
-	int height = (rect->y2 - rect->y1);
-	const BYTE *src = (const BYTE *)pixman_image_get_data(img);
-	src += ((rect->y2-1) * stride) + (rect->x1 * 4);
-
-	for (h = 0; h < height; h++, src -= stride, dest += toCopy)
-		   memcpy(dest, src, toCopy);
+rdp_peer_send_raw(SURFACE_BITS_COMMAND *cmd, void *data)
+{
+	rdp_peer_surface_bits(data, cmd);
 }
 
 static void
 rdp_peer_refresh_raw(pixman_region32_t *region, pixman_image_t *image, freerdp_peer *peer)
 {
+	RdpPeerContext *context = (RdpPeerContext *)peer->context;
+
+	if (rdp_raw_encode(&context->raw_encoder, region, image,
+			   peer->settings->MultifragMaxRequestSize,
+			   &peer->update->surface_bits_command,
+			   rdp_peer_send_raw, peer) < 0)
+		weston_log("unable to allocate the raw encoding buffer\n");
+}
+
+static RFX_CONTEXT *
+rdp_rfx_context_new(freerdp_peer *client)
+{
+	RFX_CONTEXT *rfx_context;
+
+	rfx_context = rfx_context_new();
+	if (!rfx_context)
+		return NULL;
+
+	rfx_context->mode = RLGR3;
+	rfx_context->width = client->settings->DesktopWidth;
+	rfx_context->height = client->settings->DesktopHeight;
+	rfx_context_set_pixel_format(rfx_context, RDP_PIXEL_FORMAT_B8G8R8A8);
+
+	return rfx_context;
+}
+
+static int
+rdp_peer_init_slice_context(RdpPeerContext *context, int i)
+{
+	if (context->slice_rfx_contexts[i])
+		return 0;
+
+	context->slice_rfx_contexts[i] = rdp_rfx_context_new(context->item.peer);
+	if (!context->slice_rfx_contexts[i])
+		return -1;
+
+	context->slice_streams[i] = Stream_New(NULL, 65536);
+	if (!context->slice_streams[i]) {
+		rfx_context_free(context->slice_rfx_contexts[i]);
+		context->slice_rfx_contexts[i] = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+rdp_encoder_frame_destroy(struct rdp_encoder_frame *frame)
+{
+	int i;
+
+	for (i = 0; i < frame->slice_count; i++)
+		free(frame->slices[i].rects);
+	free(frame->slices);
+	if (frame->snapshot)
+		pixman_image_unref(frame->snapshot);
+	free(frame);
+}
+
+/* Copies the damaged part of the shadow surface so that the compositor can
+ * keep rendering while the workers encode, and cuts the damage into
+ * horizontal slices aligned on the RemoteFX tile grid. */
+static struct rdp_encoder_frame *
+rdp_encoder_frame_create(struct rdp_encoder *encoder, RdpPeerContext *context,
+			 pixman_region32_t *damage)
+{
+	struct rdp_output *output = encoder->compositor->output;
+	struct rdp_encoder_frame *frame;
+	struct rdp_encoder_slice *slice;
+	pixman_box32_t *rects, *extents;
+	RFX_RECT *rfxRect;
+	int width, height, nrects, tile_rows, rows_per_slice;
+	int i, j, y1, y2;
+
+	frame = zalloc(sizeof *frame);
+	if (!frame)
+		return NULL;
+
+	extents = pixman_region32_extents(damage);
+	frame->peer = context;
+	frame->extents = *extents;
+	wl_list_init(&frame->link);
+
+	width = extents->x2 - extents->x1;
+	height = extents->y2 - extents->y1;
+	frame->snapshot = pixman_image_create_bits(PIXMAN_x8r8g8b8,
+						   width, height, NULL,
+						   width * 4);
+	if (!frame->snapshot)
+		goto err;
+
+	rects = pixman_region32_rectangles(damage, &nrects);
+	for (i = 0; i < nrects; i++)
+		pixman_image_composite32(PIXMAN_OP_SRC,
+					 output->shadow_surface, NULL,
+					 frame->snapshot,
+					 rects[i].x1, rects[i].y1, 0, 0,
+					 rects[i].x1 - extents->x1,
+					 rects[i].y1 - extents->y1,
+					 rects[i].x2 - rects[i].x1,
+					 rects[i].y2 - rects[i].y1);
+
+	tile_rows = (height + RFX_TILE_SIZE - 1) / RFX_TILE_SIZE;
+	rows_per_slice = (tile_rows + encoder->thread_count - 1) /
+		encoder->thread_count;
+	frame->slice_count = (tile_rows + rows_per_slice - 1) / rows_per_slice;
+	frame->slices = calloc(frame->slice_count, sizeof *frame->slices);
+	if (!frame->slices)
+		goto err;
+
+	for (i = 0; i < frame->slice_count; i++) {
+		slice = &frame->slices[i];
+		slice->frame = frame;
+		wl_list_init(&slice->link);
+
+		if (rdp_peer_init_slice_context(context, i) < 0)
+			goto err;
+		slice->rfx_context = context->slice_rfx_contexts[i];
+		slice->stream = context->slice_streams[i];
+
+		slice->y = i * rows_per_slice * RFX_TILE_SIZE;
+		slice->height = MIN(height - slice->y,
+				    rows_per_slice * RFX_TILE_SIZE);
+
+		slice->rects = malloc(nrects * sizeof *slice->rects);
+		if (!slice->rects)
+			goto err;
+
+		for (j = 0; j < nrects; j++) {
+			y1 = MAX(rects[j].y1 - extents->y1, slice->y);
+			y2 = MIN(rects[j].y2 - extents->y1,
+				 slice->y + slice->height);
+			if (y1 >= y2)
+				continue;
+
+			rfxRect = &slice->rects[slice->nrects++];
+			rfxRect->x = rects[j].x1 - extents->x1;
+			rfxRect->y = y1 - slice->y;
+			rfxRect->width = rects[j].x2 - rects[j].x1;
+			rfxRect->height = y2 - y1;
+		}
+	}
+
+	frame->pending = frame->slice_count;
+	frame->submit_usec = rdp_get_usec();
+
+	return frame;
+
+err:
+	rdp_encoder_frame_destroy(frame);
+	return NULL;
+}
+
+static void
+rdp_encoder_encode_slice(struct rdp_encoder_slice *slice)
+{
+	struct rdp_encoder_frame *frame = slice->frame;
+	int stride = pixman_image_get_stride(frame->snapshot);
+	BYTE *data;
+	uint64_t start;
+
+	Stream_Clear(slice->stream);
+	Stream_SetPosition(slice->stream, 0);
+	if (!slice->nrects)
+		return;
+
+	start = rdp_get_usec();
+	data = (BYTE *)pixman_image_get_data(frame->snapshot) +
+		slice->y * stride;
+	rfx_compose_message(slice->rfx_context, slice->stream,
+			    slice->rects, slice->nrects, data,
+			    frame->extents.x2 - frame->extents.x1,
+			    slice->height, stride);
+	slice->encode_usec = rdp_get_usec() - start;
+}
+
+static void
+rdp_encoder_notify(struct rdp_encoder *encoder)
+{
+	uint64_t one = 1;
+
+	/* Writing to an eventfd only fails when the counter would overflow,
+	 * and then the main loop already has a wakeup pending. */
+	if (write(encoder->done_fd, &one, sizeof one) != sizeof one)
+		return;
+}
+
+static void *
+rdp_encoder_thread_function(void *data)
+{
+	struct rdp_encoder *encoder = data;
+	struct rdp_encoder_slice *slice;
+	struct rdp_encoder_frame *frame;
+
+	pthread_mutex_lock(&encoder->mutex);
+
+	while (!encoder->destroying) {
+		if (wl_list_empty(&encoder->jobs)) {
+			pthread_cond_wait(&encoder->job_cond, &encoder->mutex);
+			continue;
+		}
+
+		slice = container_of(encoder->jobs.next,
+				     struct rdp_encoder_slice, link);
+		wl_list_remove(&slice->link);
+		wl_list_init(&slice->link);
+
+		pthread_mutex_unlock(&encoder->mutex);
+		rdp_encoder_encode_slice(slice);
+		pthread_mutex_lock(&encoder->mutex);
+
+		frame = slice->frame;
+		if (--frame->pending == 0) {
+			wl_list_insert(encoder->done.prev, &frame->link);
+			pthread_cond_broadcast(&encoder->done_cond);
+			rdp_encoder_notify(encoder);
+		}
+	}
+
+	pthread_mutex_unlock(&encoder->mutex);
+
+	return NULL;
+}
+
+static void
+rdp_encoder_send_frame(struct rdp_encoder_frame *frame)
+{
+	RdpPeerContext *context = frame->peer;
+	freerdp_peer *peer = context->item.peer;
 	rdpUpdate *update = peer->update;
 	SURFACE_BITS_COMMAND *cmd = &update->surface_bits_command;
-	SURFACE_FRAME_MARKER *marker = &update->surface_frame_marker;
-	pixman_box32_t *rect, subrect;
-	int nrects, i;
-	int heightIncrement, remainingHeight, top;
+	struct rdp_encoder_stats *stats = &context->encoder_stats;
+	struct rdp_encoder_slice *slice;
+	uint32_t latency;
+	int i;
 
-	rect = pixman_region32_rectangles(region, &nrects);
-	if (!nrects)
+	rdp_peer_begin_frame(peer);
+
+	cmd->bpp = 32;
+	cmd->codecID = peer->settings->RemoteFxCodecId;
+	cmd->destLeft = frame->extents.x1;
+	cmd->destRight = frame->extents.x2;
+	cmd->width = frame->extents.x2 - frame->extents.x1;
+
+	for (i = 0; i < frame->slice_count; i++) {
+		slice = &frame->slices[i];
+		stats->total_encode_usec += slice->encode_usec;
+		if (!slice->nrects)
+			continue;
+
+		cmd->destTop = frame->extents.y1 + slice->y;
+		cmd->destBottom = cmd->destTop + slice->height;
+		cmd->height = slice->height;
+		cmd->bitmapDataLength = Stream_GetPosition(slice->stream);
+		cmd->bitmapData = Stream_Buffer(slice->stream);
+		rdp_peer_surface_bits(peer, cmd);
+	}
+
+	rdp_peer_end_frame(peer);
+
+	latency = rdp_get_usec() - frame->submit_usec;
+	stats->frames++;
+	stats->total_latency_usec += latency;
+	if (latency > stats->max_latency_usec)
+		stats->max_latency_usec = latency;
+}
+
+static void
+rdp_encoder_submit(struct rdp_encoder *encoder, RdpPeerContext *context,
+		   pixman_region32_t *damage)
+{
+	struct rdp_output *output = encoder->compositor->output;
+	struct rdp_encoder_frame *frame;
+	int i;
+
+	/* Frames of a peer go out in order: while one is being encoded, new
+	 * damage is merged and encoded once that frame has been sent. */
+	if (context->encoding_frame) {
+		pixman_region32_union(&context->pending_damage,
+				      &context->pending_damage, damage);
 		return;
+	}
 
-	marker->frameId++;
-	marker->frameAction = SURFACECMD_FRAMEACTION_BEGIN;
-	update->SurfaceFrameMarker(peer->context, marker);
+	frame = rdp_encoder_frame_create(encoder, context, damage);
+	if (!frame) {
+		rdp_peer_begin_frame(context->item.peer);
+		rdp_peer_refresh_rfx(damage, output->shadow_surface,
+				     context->item.peer);
+		rdp_peer_end_frame(context->item.peer);
+		return;
+	}
 
-	cmd->bpp = 32;
-	cmd->codecID = 0;
+	context->encoding_frame = frame;
 
-	for (i = 0; i < nrects; i++, rect++) {
-		/*weston_log("rect(%d,%d, %d,%d)\n", rect->x1, rect->y1, rect->x2, rect->y2);*/
-		cmd->destLeft = rect->x1;
-		cmd->destRight = rect->x2;
-		cmd->width = rect->x2 - rect->x1;
+	pthread_mutex_lock(&encoder->mutex);
+	for (i = 0; i < frame->slice_count; i++)
+		wl_list_insert(encoder->jobs.prev, &frame->slices[i].link);
+	pthread_cond_broadcast(&encoder->job_cond);
+	pthread_mutex_unlock(&encoder->mutex);
+}
 
-		heightIncrement = peer->settings->MultifragMaxRequestSize / (16 + cmd->width * 4);
-		remainingHeight = rect->y2 - rect->y1;
-		top = rect->y1;
+static int
+rdp_encoder_done(int fd, uint32_t mask, void *data)
+{
+	struct rdp_encoder *encoder = data;
+	struct rdp_encoder_frame *frame, *next;
+	RdpPeerContext *context;
+	struct wl_list done;
+	uint64_t count;
 
-		subrect.x1 = rect->x1;
-		subrect.x2 = rect->x2;
+	if (read(fd, &count, sizeof count) != sizeof count)
+		return 0;
 
-		while (remainingHeight) {
-			   cmd->height = (remainingHeight > heightIncrement) ? heightIncrement : remainingHeight;
-			   cmd->destTop = top;
-			   cmd->destBottom = top + cmd->height;
-			   cmd->bitmapDataLength = cmd->width * cmd->height * 4;
-			   cmd->bitmapData = (BYTE *)realloc(cmd->bitmapData, cmd->bitmapDataLength);
+	wl_list_init(&done);
+	pthread_mutex_lock(&encoder->mutex);
+	wl_list_insert_list(&done, &encoder->done);
+	wl_list_init(&encoder->done);
+	pthread_mutex_unlock(&encoder->mutex);
 
-			   subrect.y1 = top;
-			   subrect.y2 = top + cmd->height;
-			   pixman_image_flipped_subrect(&subrect, image, cmd->bitmapData);
+	wl_list_for_each_safe(frame, next, &done, link) {
+		context = frame->peer;
 
-			   /*weston_log("*  sending (%d,%d, %d,%d)\n", subrect.x1, subrect.y1, subrect.x2, subrect.y2); */
-			   update->SurfaceBits(peer->context, cmd);
+		rdp_encoder_send_frame(frame);
+		context->encoding_frame = NULL;
+		rdp_encoder_frame_destroy(frame);
 
-			   remainingHeight -= cmd->height;
-			   top += cmd->height;
+		if (pixman_region32_not_empty(&context->pending_damage)) {
+			rdp_encoder_submit(encoder, context,
+					   &context->pending_damage);
+			pixman_region32_clear(&context->pending_damage);
 		}
 	}
 
-	marker->frameAction = SURFACECMD_FRAMEACTION_END;
-	update->SurfaceFrameMarker(peer->context, marker);
+	return 1;
+}
+
+/* Waits for the frame being encoded for a peer, if any, and drops it. */
+static void
+rdp_encoder_cancel(struct rdp_encoder *encoder, RdpPeerContext *context)
+{
+	struct rdp_encoder_frame *frame = context->encoding_frame;
+	struct rdp_encoder_slice *slice;
+	int i;
+
+	if (!frame)
+		return;
+
+	pthread_mutex_lock(&encoder->mutex);
+
+	for (i = 0; i < frame->slice_count; i++) {
+		slice = &frame->slices[i];
+		if (!wl_list_empty(&slice->link)) {
+			wl_list_remove(&slice->link);
+			wl_list_init(&slice->link);
+			frame->pending--;
+		}
+	}
+
+	while (frame->pending > 0)
+		pthread_cond_wait(&encoder->done_cond, &encoder->mutex);
+
+	wl_list_remove(&frame->link);
+
+	pthread_mutex_unlock(&encoder->mutex);
+
+	rdp_encoder_frame_destroy(frame);
+	context->encoding_frame = NULL;
+}
+
+static void
+rdp_encoder_destroy(struct rdp_encoder *encoder)
+{
+	struct rdp_encoder_slice *slice, *next_slice;
+	struct rdp_encoder_frame *frame, *next;
+	int i;
+
+	pthread_mutex_lock(&encoder->mutex);
+	encoder->destroying = 1;
+	pthread_cond_broadcast(&encoder->job_cond);
+	pthread_mutex_unlock(&encoder->mutex);
+
+	for (i = 0; i < encoder->thread_count; i++)
+		pthread_join(encoder->threads[i], NULL);
+
+	/* With the workers gone, a frame is either waiting on the slices
+	 * still queued or fully encoded and not sent yet; drop both. */
+	wl_list_for_each_safe(slice, next_slice, &encoder->jobs, link) {
+		frame = slice->frame;
+		wl_list_remove(&slice->link);
+		wl_list_init(&slice->link);
+		if (--frame->pending == 0) {
+			frame->peer->encoding_frame = NULL;
+			rdp_encoder_frame_destroy(frame);
+		}
+	}
+
+	wl_list_for_each_safe(frame, next, &encoder->done, link) {
+		wl_list_remove(&frame->link);
+		frame->peer->encoding_frame = NULL;
+		rdp_encoder_frame_destroy(frame);
+	}
+
+	if (encoder->done_source)
+		wl_event_source_remove(encoder->done_source);
+	if (encoder->done_fd >= 0)
+		close(encoder->done_fd);
+
+	pthread_cond_destroy(&encoder->done_cond);
+	pthread_cond_destroy(&encoder->job_cond);
+	pthread_mutex_destroy(&encoder->mutex);
+	free(encoder);
+}
+
+static struct rdp_encoder *
+rdp_encoder_create(struct rdp_compositor *c, int thread_count)
+{
+	struct rdp_encoder *encoder;
+	struct wl_event_loop *loop;
+	int i;
+
+	encoder = zalloc(sizeof *encoder);
+	if (!encoder)
+		return NULL;
+
+	encoder->compositor = c;
+	wl_list_init(&encoder->jobs);
+	wl_list_init(&encoder->done);
+	pthread_mutex_init(&encoder->mutex, NULL);
+	pthread_cond_init(&encoder->job_cond, NULL);
+	pthread_cond_init(&encoder->done_cond, NULL);
+
+	encoder->done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (encoder->done_fd < 0)
+		goto err;
+
+	loop = wl_display_get_event_loop(c->base.wl_display);
+	encoder->done_source = wl_event_loop_add_fd(loop, encoder->done_fd,
+						    WL_EVENT_READABLE,
+						    rdp_encoder_done, encoder);
+	if (!encoder->done_source)
+		goto err;
+
+	for (i = 0; i < thread_count; i++) {
+		if (pthread_create(&encoder->threads[i], NULL,
+				   rdp_encoder_thread_function, encoder) != 0)
+			break;
+		encoder->thread_count++;
+	}
+
+	if (encoder->thread_count == 0)
+		goto err;
+
+	return encoder;
+
+err:
+	rdp_encoder_destroy(encoder);
+	return NULL;
 }
 
 static void
 rdp_peer_refresh_region(pixman_region32_t *region, freerdp_peer *peer)
 {
 	RdpPeerContext *context = (RdpPeerContext *)peer->context;
-	struct rdp_output *output = context->rdpCompositor->output;
+	struct rdp_compositor *c = context->rdpCompositor;
+	struct rdp_output *output = c->output;
 	rdpSettings *settings = peer->settings;
 
+	if (settings->RemoteFxCodec && c->encoder) {
+		rdp_encoder_submit(c->encoder, context, region);
+		return;
+	}
+
+	rdp_peer_begin_frame(peer);
 	if (settings->RemoteFxCodec)
 		rdp_peer_refresh_rfx(region, output->shadow_surface, peer);
 	else if (settings->NSCodec)
 		rdp_peer_refresh_nsc(region, output->shadow_surface, peer);
 	else
 		rdp_peer_refresh_raw(region, output->shadow_surface, peer);
+	rdp_peer_end_frame(peer);
+}
+
+static int
+rdp_peer_flow_can_send(RdpPeerContext *context)
+{
+	struct rdp_peer_flow *flow = &context->flow;
+	uint64_t sent;
+
+	if (!flow->max_unacked ||
+	    flow->last_frame_id - flow->last_acked_id < flow->max_unacked)
+		return 1;
+
+	/* Some clients announce frame acknowledgement but never send any,
+	 * don't let them freeze. */
+	sent = flow->sent_usec[(flow->last_acked_id + 1) % RDP_FRAME_HISTORY];
+	if (rdp_get_usec() - sent > RDP_ACK_TIMEOUT_USEC) {
+		weston_log("RDP peer %s does not acknowledge frames, "
+			   "disabling flow control\n",
+			   context->item.peer->hostname);
+		flow->max_unacked = 0;
+		return 1;
+	}
+
+	return 0;
+}
+
+static void
+rdp_peer_flush_damage(RdpPeerContext *context)
+{
+	struct rdp_peer_flow *flow = &context->flow;
+	pixman_region32_t damage;
+
+	if (!pixman_region32_not_empty(&flow->held_damage))
+		return;
+
+	pixman_region32_init(&damage);
+	pixman_region32_copy(&damage, &flow->held_damage);
+	pixman_region32_clear(&flow->held_damage);
+
+	rdp_peer_refresh_region(&damage, context->item.peer);
+
+	pixman_region32_fini(&damage);
+}
+
+/* Sends damage to a peer, or holds it until the peer acknowledges enough
+ * of the frames it was sent. */
+static void
+rdp_peer_update_region(pixman_region32_t *region, RdpPeerContext *context)
+{
+	struct rdp_peer_flow *flow = &context->flow;
+
+	pixman_region32_union(&flow->held_damage, &flow->held_damage, region);
+
+	if (!rdp_peer_flow_can_send(context)) {
+		flow->frames_held++;
+		return;
+	}
+
+	rdp_peer_flush_damage(context);
+}
+
+static void
+rdp_peer_send_pointer(RdpPeerContext *context, struct weston_view *ev)
+{
+	freerdp_peer *client = context->item.peer;
+	rdpPointerUpdate *pointer = client->update->pointer;
+	POINTER_NEW_UPDATE *pointer_new = &pointer->pointer_new;
+	POINTER_COLOR_UPDATE *color = &pointer_new->colorPtrAttr;
+	struct weston_pointer *seat_pointer = context->item.seat.pointer;
+	struct wl_shm_buffer *shm_buffer;
+	int32_t scale = ev->surface->buffer_scale;
+	int width, height, stride, x, y;
+	uint32_t *row;
+	BYTE *data;
+
+	/* rdp_output_prepare_cursor_view() only lets 32 bpp buffers of at
+	 * most RDP_MAX_POINTER_SIZE pixels a side through */
+	shm_buffer = ev->surface->buffer_ref.buffer->shm_buffer;
+	width = wl_shm_buffer_get_width(shm_buffer);
+	height = wl_shm_buffer_get_height(shm_buffer);
+	stride = wl_shm_buffer_get_stride(shm_buffer);
+	data = wl_shm_buffer_get_data(shm_buffer);
+
+	/* pointer bitmaps are bottom-up; with a 32 bpp xor mask the
+	 * client takes transparency from alpha, so the and mask is empty */
+	for (y = 0; y < height; y++) {
+		row = (uint32_t *) (context->pointer_xor +
+				    (height - 1 - y) * width * 4);
+		memcpy(row, data + y * stride, width * 4);
+		if (wl_shm_buffer_get_format(shm_buffer) ==
+		    WL_SHM_FORMAT_XRGB8888)
+			for (x = 0; x < width; x++)
+				row[x] |= 0xff000000;
+	}
+
+	color->cacheIndex = 0;
+	color->xPos = MIN(MAX(seat_pointer->hotspot_x * scale, 0), width - 1);
+	color->yPos = MIN(MAX(seat_pointer->hotspot_y * scale, 0), height - 1);
+	color->width = width;
+	color->height = height;
+	color->lengthXorMask = width * height * 4;
+	color->xorMaskData = context->pointer_xor;
+	color->lengthAndMask = ((width + 15) / 16) * 2 * height;
+	color->andMaskData = context->pointer_and;
+	memset(context->pointer_and, 0, color->lengthAndMask);
+
+	pointer_new->xorBpp = 32;
+	pointer->PointerNew(client->context, pointer_new);
+}
+
+/* Sends the peer's cursor as RDP pointer updates, instead of rendering it
+ * into the frames. */
+static void
+rdp_peer_update_pointer(RdpPeerContext *context)
+{
+	freerdp_peer *client = context->item.peer;
+	rdpPointerUpdate *pointer = client->update->pointer;
+	struct weston_pointer *seat_pointer = context->item.seat.pointer;
+	struct weston_view *ev = context->cursor_view;
+
+	context->cursor_view = NULL;
+
+	if (!ev) {
+		if (context->pointer_visible) {
+			pointer->pointer_system.type = SYSPTR_NULL;
+			pointer->PointerSystem(client->context,
+					       &pointer->pointer_system);
+			context->pointer_visible = 0;
+			context->cursor_buffer = NULL;
+		}
+		return;
+	}
+
+	/* only a new buffer or new contents change the shape; moving the
+	 * sprite damages the cursor plane but doesn't need a resend */
+	if (!context->pointer_visible || context->cursor_damaged ||
+	    context->cursor_buffer != ev->surface->buffer_ref.buffer) {
+		rdp_peer_send_pointer(context, ev);
+		context->pointer_visible = 1;
+		context->cursor_buffer = ev->surface->buffer_ref.buffer;
+	}
+
+	/* the client moves its pointer itself, only warps are sent */
+	if (seat_pointer->x != context->pointer_x ||
+	    seat_pointer->y != context->pointer_y) {
+		pointer->pointer_position.xPos = wl_fixed_to_int(seat_pointer->x);
+		pointer->pointer_position.yPos = wl_fixed_to_int(seat_pointer->y);
+		pointer->PointerPosition(client->context,
+					 &pointer->pointer_position);
+		context->pointer_x = seat_pointer->x;
+		context->pointer_y = seat_pointer->y;
+	}
+}
+
+static int
+rdp_output_prepare_cursor_view(struct rdp_output *output,
+			       struct weston_view *ev)
+{
+	struct rdp_peers_item *item;
+	RdpPeerContext *context, *owner = NULL;
+	struct weston_buffer *buffer;
+	struct wl_shm_buffer *shm_buffer;
+	uint32_t format;
+
+	/* the frames are shared by all peers, so a cursor can only be
+	 * left out of them when every peer draws pointers itself */
+	wl_list_for_each(item, &output->peers, link) {
+		if (!(item->flags & RDP_PEER_ACTIVATED))
+			continue;
+
+		context = (RdpPeerContext *)item->peer->context;
+		if (!context->pointer_enabled)
+			return 0;
+		if (item->seat.pointer && item->seat.pointer->sprite == ev)
+			owner = context;
+	}
+
+	if (!owner)
+		return 0;
+
+	buffer = ev->surface->buffer_ref.buffer;
+	if (!buffer)
+		return 0;
+
+	/* anything the client can't show pixel for pixel as a 32 bpp
+	 * pointer is rendered into the frames */
+	shm_buffer = wl_shm_buffer_get(buffer->resource);
+	if (!shm_buffer)
+		return 0;
+	format = wl_shm_buffer_get_format(shm_buffer);
+	if ((format != WL_SHM_FORMAT_ARGB8888 &&
+	     format != WL_SHM_FORMAT_XRGB8888) ||
+	    wl_shm_buffer_get_width(shm_buffer) > RDP_MAX_POINTER_SIZE ||
+	    wl_shm_buffer_get_height(shm_buffer) > RDP_MAX_POINTER_SIZE ||
+	    ev->surface->buffer_transform != WL_OUTPUT_TRANSFORM_NORMAL ||
+	    ev->surface->buffer_scale != output->base.current_scale)
+		return 0;
+
+	/* surface damage is only flushed after the planes are assigned,
+	 * so it still tells whether the cursor has new contents since the
+	 * last repaint */
+	owner->cursor_view = ev;
+	owner->cursor_damaged =
+		pixman_region32_not_empty(&ev->surface->damage);
+	return 1;
+}
+
+static void
+rdp_assign_planes(struct weston_output *output_base)
+{
+	struct rdp_output *output = container_of(output_base, struct rdp_output, base);
+	struct weston_compositor *ec = output_base->compositor;
+	struct weston_view *ev;
+
+	/* only the cursor sent to the peer needs its buffer after the
+	 * repaint, everything else may release it early */
+	wl_list_for_each(ev, &ec->view_list, link) {
+		if (rdp_output_prepare_cursor_view(output, ev)) {
+			ev->surface->keep_buffer = 1;
+			weston_view_move_to_plane(ev, &output->cursor_plane);
+		} else {
+			ev->surface->keep_buffer = 0;
+			weston_view_move_to_plane(ev, &ec->primary_plane);
+		}
+	}
 }
 
 static void
@@ -308,17 +1107,38 @@ rdp_output_repaint(struct weston_output *output_base, pixman_region32_t *damage)
 	struct rdp_output *output = container_of(output_base, struct rdp_output, base);
 	struct weston_compositor *ec = output->base.compositor;
 	struct rdp_peers_item *outputPeer;
+	RdpPeerContext *context;
+	pixman_region32_t refined;
 
 	pixman_renderer_output_set_buffer(output_base, output->shadow_surface);
 	ec->renderer->repaint_output(&output->base, damage);
 
+	pixman_region32_clear(&output->cursor_plane.damage);
+	wl_list_for_each(outputPeer, &output->peers, link) {
+		if (outputPeer->flags & RDP_PEER_ACTIVATED)
+			rdp_peer_update_pointer((RdpPeerContext *)outputPeer->peer->context);
+	}
+
+	pixman_region32_init(&refined);
 	wl_list_for_each(outputPeer, &output->peers, link) {
 		if ((outputPeer->flags & RDP_PEER_ACTIVATED) &&
 				(outputPeer->flags & RDP_PEER_OUTPUT_ENABLED))
 		{
-			rdp_peer_refresh_region(damage, outputPeer->peer);
+			context = (RdpPeerContext *)outputPeer->peer->context;
+
+			/* only send the tiles that changed since this peer
+			 * last got them */
+			pixman_region32_copy(&refined, damage);
+			if (context->tile_hash)
+				weston_tile_hash_refine(context->tile_hash,
+							pixman_image_get_data(output->shadow_surface),
+							pixman_image_get_stride(output->shadow_surface),
+							&refined);
+			if (pixman_region32_not_empty(&refined))
+				rdp_peer_update_region(&refined, context);
 		}
 	}
+	pixman_region32_fini(&refined);
 
 	pixman_region32_subtract(&ec->primary_plane.damage,
 				 &ec->primary_plane.damage, damage);
@@ -333,6 +1153,7 @@ rdp_output_destroy(struct weston_output *output_base)
 	struct rdp_output *output = (struct rdp_output *)output_base;
 
 	wl_event_source_remove(output->finish_frame_timer);
+	weston_plane_release(&output->cursor_plane);
 	free(output);
 }
 
@@ -360,6 +1181,7 @@ static int
 rdp_switch_mode(struct weston_output *output, struct weston_mode *target_mode) {
 	struct rdp_output *rdpOutput = container_of(output, struct rdp_output, base);
 	struct rdp_peers_item *rdpPeer;
+	RdpPeerContext *peerCtx;
 	rdpSettings *settings;
 	pixman_image_t *new_shadow_buffer;
 	struct weston_mode *local_mode;
@@ -389,6 +1211,14 @@ rdp_switch_mode(struct weston_output *output, struct weston_mode *target_mode) {
 	rdpOutput->shadow_surface = new_shadow_buffer;
 
 	wl_list_for_each(rdpPeer, &rdpOutput->peers, link) {
+		peerCtx = (RdpPeerContext *)rdpPeer->peer->context;
+		if (peerCtx->tile_hash) {
+			weston_tile_hash_destroy(peerCtx->tile_hash);
+			peerCtx->tile_hash =
+				weston_tile_hash_create(target_mode->width,
+							target_mode->height);
+		}
+
 		settings = rdpPeer->peer->settings;
 		if(!settings->DesktopResize) {
 			/* too bad this peer does not support desktop resize */
@@ -402,6 +1232,29 @@ rdp_switch_mode(struct weston_output *output, struct weston_mode *target_mode) {
 	return 0;
 }
 
+static void
+rdp_stats_binding(struct weston_seat *seat, uint32_t time, uint32_t key,
+		  void *data)
+{
+	struct rdp_compositor *c = data;
+	struct rdp_peers_item *item;
+	RdpPeerContext *context;
+	struct rdp_peer_flow *flow;
+
+	wl_list_for_each(item, &c->output->peers, link) {
+		context = (RdpPeerContext *)item->peer->context;
+		flow = &context->flow;
+
+		weston_log("RDP peer %s: rtt %u us, %u bytes/s, "
+			   "%u/%u frames unacked, %u sent, %u held back\n",
+			   item->peer->hostname, flow->rtt_usec,
+			   flow->throughput,
+			   flow->last_frame_id - flow->last_acked_id,
+			   flow->max_unacked, flow->frames_sent,
+			   flow->frames_held);
+	}
+}
+
 static int
 parse_extra_modes(const char *modes_str, struct rdp_output *output) {
 	const char *startAt = modes_str;
@@ -488,13 +1341,16 @@ rdp_compositor_create_output(struct rdp_compositor *c, int width, int height,
 
 	weston_output_move(&output->base, 0, 0);
 
+	weston_plane_init(&output->cursor_plane, &c->base, 0, 0);
+	weston_compositor_stack_plane(&c->base, &output->cursor_plane, NULL);
+
 	loop = wl_display_get_event_loop(c->base.wl_display);
 	output->finish_frame_timer = wl_event_loop_add_timer(loop, finish_frame_handler, output);
 
 	output->base.start_repaint_loop = rdp_output_start_repaint_loop;
 	output->base.repaint = rdp_output_repaint;
 	output->base.destroy = rdp_output_destroy;
-	output->base.assign_planes = NULL;
+	output->base.assign_planes = rdp_assign_planes;
 	output->base.set_backlight = NULL;
 	output->base.set_dpms = NULL;
 	output->base.switch_mode = rdp_switch_mode;
@@ -523,6 +1379,12 @@ rdp_restore(struct weston_compositor *ec)
 static void
 rdp_destroy(struct weston_compositor *ec)
 {
+	struct rdp_compositor *c = (struct rdp_compositor *)ec;
+
+	if (c->encoder) {
+		rdp_encoder_destroy(c->encoder);
+		c->encoder = NULL;
+	}
 	weston_compositor_shutdown(ec);
 	ec->renderer->destroy(ec);
 
@@ -574,21 +1436,21 @@ rdp_peer_context_new(freerdp_peer* client, RdpPeerContext* context)
 	context->item.peer = client;
 	context->item.flags = RDP_PEER_OUTPUT_ENABLED;
 
-	context->rfx_context = rfx_context_new();
-	context->rfx_context->mode = RLGR3;
-	context->rfx_context->width = client->settings->DesktopWidth;
-	context->rfx_context->height = client->settings->DesktopHeight;
-	rfx_context_set_pixel_format(context->rfx_context, RDP_PIXEL_FORMAT_B8G8R8A8);
+	context->rfx_context = rdp_rfx_context_new(client);
 
 	context->nsc_context = nsc_context_new();
 	nsc_context_set_pixel_format(context->nsc_context, RDP_PIXEL_FORMAT_B8G8R8A8);
 
 	context->encode_stream = Stream_New(NULL, 65536);
+	pixman_region32_init(&context->pending_damage);
+	pixman_region32_init(&context->flow.held_damage);
+	rdp_raw_encoder_init(&context->raw_encoder);
 }
 
 static void
 rdp_peer_context_free(freerdp_peer* client, RdpPeerContext* context)
 {
+	struct rdp_encoder_stats *stats;
 	int i;
 	if(!context)
 		return;
@@ -599,8 +1461,43 @@ rdp_peer_context_free(freerdp_peer* client, RdpPeerContext* context)
 			wl_event_source_remove(context->events[i]);
 	}
 
-	if(context->item.flags & RDP_PEER_ACTIVATED)
+	if (context->rdpCompositor->encoder)
+		rdp_encoder_cancel(context->rdpCompositor->encoder, context);
+	for (i = 0; i < MAX_ENCODER_THREADS; i++) {
+		if (!context->slice_rfx_contexts[i])
+			continue;
+		Stream_Free(context->slice_streams[i], TRUE);
+		rfx_context_free(context->slice_rfx_contexts[i]);
+	}
+	pixman_region32_fini(&context->pending_damage);
+	pixman_region32_fini(&context->flow.held_damage);
+	rdp_raw_encoder_release(&context->raw_encoder);
+	if (context->tile_hash)
+		weston_tile_hash_destroy(context->tile_hash);
+
+	if (context->flow.frames_sent)
+		weston_log("RDP peer %s: %u frames sent, %u held back, "
+			   "rtt %u us, %u bytes/s\n", client->hostname,
+			   context->flow.frames_sent, context->flow.frames_held,
+			   context->flow.rtt_usec, context->flow.throughput);
+
+	stats = &context->encoder_stats;
+	if (stats->frames)
+		weston_log("RDP peer %s: %u frames encoded, latency avg %u us "
+			   "max %u us, encode time avg %u us\n",
+			   client->hostname, stats->frames,
+			   (uint32_t)(stats->total_latency_usec / stats->frames),
+			   stats->max_latency_usec,
+			   (uint32_t)(stats->total_encode_usec / stats->frames));
+
+	if(context->item.flags & RDP_PEER_ACTIVATED) {
+		/* the sprite goes back to being drawn into the frames */
+		if (context->item.seat.pointer &&
+		    context->item.seat.pointer->sprite)
+			context->item.seat.pointer->sprite->surface->keep_buffer = 0;
 		weston_seat_release(&context->item.seat);
+		weston_output_schedule_repaint(&context->rdpCompositor->output->base);
+	}
 	Stream_Free(context->encode_stream, TRUE);
 	nsc_context_free(context->nsc_context);
 	rfx_context_free(context->rfx_context);
@@ -731,6 +1628,21 @@ xf_peer_post_connect(freerdp_peer* client)
 
 	peerCtx->item.flags |= RDP_PEER_ACTIVATED;
 
+	/* FrameAcknowledge still holds the value we advertised unless the
+	 * client sent the capability set, so only trust it then; the client
+	 * announces how many frames it may leave unacknowledged, 0 meaning
+	 * it doesn't send acknowledgements at all */
+	peerCtx->flow.max_unacked = 0;
+	if (settings->ReceivedCapabilities &&
+	    settings->ReceivedCapabilities[CAPSET_TYPE_FRAME_ACKNOWLEDGE])
+		peerCtx->flow.max_unacked = MIN(settings->FrameAcknowledge,
+						RDP_MAX_UNACKED_FRAMES);
+
+	/* the cursor is sent as pointer updates if the client can cache
+	 * color pointers, and rendered into the frames otherwise */
+	peerCtx->pointer_enabled = settings->ColorPointerFlag &&
+		settings->PointerCacheSize > 0;
+
 	/* disable pointer on the client side */
 	pointer = client->update->pointer;
 	pointer->pointer_system.type = SYSPTR_NULL;
@@ -754,7 +1666,28 @@ static BOOL
 xf_peer_activate(freerdp_peer *client)
 {
 	RdpPeerContext *context = (RdpPeerContext *)client->context;
+	struct rdp_compositor *c = context->rdpCompositor;
+	struct rdp_output *output = c->output;
+	int i;
+
 	rfx_context_reset(context->rfx_context);
+	for (i = 0; i < MAX_ENCODER_THREADS; i++) {
+		if (context->slice_rfx_contexts[i])
+			rfx_context_reset(context->slice_rfx_contexts[i]);
+	}
+
+	/* A (re)activated peer has none of the tiles its hash describes,
+	 * so the next repaint must not drop any of them. */
+	if (context->tile_hash) {
+		weston_tile_hash_reset(context->tile_hash);
+	} else if (c->base.tile_hash) {
+		context->tile_hash = weston_tile_hash_create(output->base.width,
+							     output->base.height);
+		if (!context->tile_hash)
+			weston_log("unable to create tile hash, sending "
+				   "all damage\n");
+	}
+
 	return TRUE;
 }
 
@@ -770,6 +1703,8 @@ xf_mouseEvent(rdpInput *input, UINT16 flags, UINT16 x, UINT16 y) {
 		if(x < output->base.width && y < output->base.height) {
 			wl_x = wl_fixed_from_int((int)x);
 			wl_y = wl_fixed_from_int((int)y);
+			peerContext->pointer_x = wl_x;
+			peerContext->pointer_y = wl_y;
 			notify_motion_absolute(&peerContext->item.seat, weston_compositor_get_time(),
 					wl_x, wl_y);
 		}
@@ -815,6 +1750,8 @@ xf_extendedMouseEvent(rdpInput *input, UINT16 flags, UINT16 x, UINT16 y) {
 	if(x < output->base.width && y < output->base.height) {
 		wl_x = wl_fixed_from_int((int)x);
 		wl_y = wl_fixed_from_int((int)y);
+		peerContext->pointer_x = wl_x;
+		peerContext->pointer_y = wl_y;
 		notify_motion_absolute(&peerContext->item.seat, weston_compositor_get_time(),
 				wl_x, wl_y);
 	}
@@ -897,12 +1834,73 @@ xf_input_unicode_keyboard_event(rdpInput *input, UINT16 flags, UINT16 code)
 }
 
 
+static void
+xf_surface_frame_acknowledge(rdpContext *context, UINT32 frameId)
+{
+	RdpPeerContext *peerContext = (RdpPeerContext *)context;
+	struct rdp_peer_flow *flow = &peerContext->flow;
+	uint64_t now = rdp_get_usec();
+	uint32_t rtt, id;
+
+	/* ignore acks for frames that are unknown or already acked */
+	if (frameId - flow->last_acked_id - 1 >=
+	    flow->last_frame_id - flow->last_acked_id)
+		return;
+
+	for (id = flow->last_acked_id + 1; id != frameId + 1; id++)
+		flow->window_bytes += flow->sent_bytes[id % RDP_FRAME_HISTORY];
+	flow->last_acked_id = frameId;
+
+	rtt = now - flow->sent_usec[frameId % RDP_FRAME_HISTORY];
+	if (flow->rtt_usec)
+		flow->rtt_usec = (7 * flow->rtt_usec + rtt) / 8;
+	else
+		flow->rtt_usec = rtt;
+
+	if (!flow->window_start_usec) {
+		flow->window_start_usec = now;
+	} else if (now - flow->window_start_usec >= 1000000) {
+		flow->throughput = (uint64_t)flow->window_bytes * 1000000 /
+			(now - flow->window_start_usec);
+		flow->window_start_usec = now;
+		flow->window_bytes = 0;
+	}
+
+	if ((peerContext->item.flags & RDP_PEER_ACTIVATED) &&
+	    (peerContext->item.flags & RDP_PEER_OUTPUT_ENABLED))
+		rdp_peer_flush_damage(peerContext);
+}
+
+/* Nothing was sent to the peer while its output was suppressed; send it
+ * whatever changed meanwhile, which its tile hash tells when there is
+ * one. */
+static void
+rdp_peer_resume_output(RdpPeerContext *context)
+{
+	struct rdp_output *output = context->rdpCompositor->output;
+	pixman_region32_t damage;
+
+	pixman_region32_init_rect(&damage, 0, 0,
+				  output->base.width, output->base.height);
+	if (context->tile_hash)
+		weston_tile_hash_refine(context->tile_hash,
+					pixman_image_get_data(output->shadow_surface),
+					pixman_image_get_stride(output->shadow_surface),
+					&damage);
+	if (pixman_region32_not_empty(&damage))
+		rdp_peer_update_region(&damage, context);
+	pixman_region32_fini(&damage);
+}
+
 static void
 xf_suppress_output(rdpContext *context, BYTE allow, RECTANGLE_16 *area) {
 	RdpPeerContext *peerContext = (RdpPeerContext *)context;
-	if(allow)
+	if(allow) {
+		if ((peerContext->item.flags & RDP_PEER_ACTIVATED) &&
+		    !(peerContext->item.flags & RDP_PEER_OUTPUT_ENABLED))
+			rdp_peer_resume_output(peerContext);
 		peerContext->item.flags |= RDP_PEER_OUTPUT_ENABLED;
-	else
+	} else
 		peerContext->item.flags &= (~RDP_PEER_OUTPUT_ENABLED);
 }
 
@@ -936,12 +1934,14 @@ rdp_peer_init(freerdp_peer *client, struct rdp_compositor *c)
 	}
 
 	settings->NlaSecurity = FALSE;
+	settings->FrameAcknowledge = RDP_MAX_UNACKED_FRAMES;
 
 	client->Capabilities = xf_peer_capabilities;
 	client->PostConnect = xf_peer_post_connect;
 	client->Activate = xf_peer_activate;
 
 	client->update->SuppressOutput = xf_suppress_output;
+	client->update->SurfaceFrameAcknowledge = xf_surface_frame_acknowledge;
 
 	input = client->input;
 	input->SynchronizeEvent = xf_input_synchronize_event;
@@ -1021,6 +2021,17 @@ rdp_compositor_create(struct wl_display *display,
 	if (rdp_compositor_create_output(c, config->width, config->height, config->extra_modes) < 0)
 		goto err_compositor;
 
+	if (config->encoder_threads > 0) {
+		c->encoder = rdp_encoder_create(c,
+				MIN(config->encoder_threads, MAX_ENCODER_THREADS));
+		if (!c->encoder)
+			weston_log("unable to start RemoteFX encoder threads, "
+				   "encoding synchronously\n");
+	}
+
+	weston_compositor_add_debug_binding(&c->base, KEY_P,
+					    rdp_stats_binding, c);
+
 	if(!config->env_socket) {
 		c->listener = freerdp_listener_new();
 		c->listener->PeerAccepted = rdp_incoming_peer;
@@ -1086,7 +2097,8 @@ backend_init(struct wl_display *display, int *argc, char *argv[],
 		{ WESTON_OPTION_INTEGER, "port", 0, &config.port },
 		{ WESTON_OPTION_STRING,  "rdp4-key", 0, &config.rdp_key },
 		{ WESTON_OPTION_STRING,  "rdp-tls-cert", 0, &config.server_cert },
-		{ WESTON_OPTION_STRING,  "rdp-tls-key", 0, &config.server_key }
+		{ WESTON_OPTION_STRING,  "rdp-tls-key", 0, &config.server_key },
+		{ WESTON_OPTION_INTEGER, "encoder-threads", 0, &config.encoder_threads },
 	};
 
 	parse_options(rdp_options, ARRAY_LENGTH(rdp_options), argc, argv);
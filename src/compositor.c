@@ -38,6 +38,7 @@
 #include <sys/socket.h>
 #include <sys/utsname.h>
 #include <sys/stat.h>
+#include <sys/inotify.h>
 #include <unistd.h>
 #include <math.h>
 #include <linux/input.h>
@@ -447,6 +448,82 @@ weston_surface_set_color(struct weston_surface *surface,
 	surface->compositor->renderer->surface_set_color(surface, red, green, blue, alpha);
 }
 
+/* Transform n points with one batched matrix call and divide by w.
+ * The output arrays may alias the input arrays. */
+static void
+view_transform_points(const struct weston_matrix *matrix,
+		      const float *in_x, const float *in_y,
+		      float *out_x, float *out_y, int n)
+{
+	struct weston_vector v[8];
+	int i, j, count;
+
+	for (i = 0; i < n; i += count) {
+		count = MIN(n - i, (int) ARRAY_LENGTH(v));
+
+		for (j = 0; j < count; j++) {
+			v[j].f[0] = in_x[i + j];
+			v[j].f[1] = in_y[i + j];
+			v[j].f[2] = 0.0f;
+			v[j].f[3] = 1.0f;
+		}
+
+		weston_matrix_transform_points(matrix, v, count);
+
+		for (j = 0; j < count; j++) {
+			if (fabsf(v[j].f[3]) < 1e-6) {
+				weston_log("warning: numerical instability in "
+					   "%s(), divisor = %g\n", __func__,
+					   v[j].f[3]);
+				out_x[i + j] = 0;
+				out_y[i + j] = 0;
+				continue;
+			}
+
+			out_x[i + j] = v[j].f[0] / v[j].f[3];
+			out_y[i + j] = v[j].f[1] / v[j].f[3];
+		}
+	}
+}
+
+WL_EXPORT void
+weston_view_to_global_points(struct weston_view *view,
+			     const float *sx, const float *sy,
+			     float *x, float *y, int n)
+{
+	int i;
+
+	if (view->transform.enabled) {
+		view_transform_points(&view->transform.matrix,
+				      sx, sy, x, y, n);
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		x[i] = sx[i] + view->geometry.x;
+		y[i] = sy[i] + view->geometry.y;
+	}
+}
+
+WL_EXPORT void
+weston_view_from_global_points(struct weston_view *view,
+			       const float *x, const float *y,
+			       float *vx, float *vy, int n)
+{
+	int i;
+
+	if (view->transform.enabled) {
+		view_transform_points(&view->transform.inverse,
+				      x, y, vx, vy, n);
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		vx[i] = x[i] - view->geometry.x;
+		vy[i] = y[i] - view->geometry.y;
+	}
+}
+
 WL_EXPORT void
 weston_view_to_global_float(struct weston_view *view,
 			    float sx, float sy, float *x, float *y)
@@ -727,12 +804,8 @@ view_compute_bbox(struct weston_view *view, int32_t sx, int32_t sy,
 {
 	float min_x = HUGE_VALF,  min_y = HUGE_VALF;
 	float max_x = -HUGE_VALF, max_y = -HUGE_VALF;
-	int32_t s[4][2] = {
-		{ sx,         sy },
-		{ sx,         sy + height },
-		{ sx + width, sy },
-		{ sx + width, sy + height }
-	};
+	float x[4] = { sx, sx, sx + width, sx + width };
+	float y[4] = { sy, sy + height, sy, sy + height };
 	float int_x, int_y;
 	int i;
 
@@ -742,17 +815,17 @@ view_compute_bbox(struct weston_view *view, int32_t sx, int32_t sy,
 		return;
 	}
 
+	weston_view_to_global_points(view, x, y, x, y, 4);
+
 	for (i = 0; i < 4; ++i) {
-		float x, y;
-		weston_view_to_global_float(view, s[i][0], s[i][1], &x, &y);
-		if (x < min_x)
-			min_x = x;
-		if (x > max_x)
-			max_x = x;
-		if (y < min_y)
-			min_y = y;
-		if (y > max_y)
-			max_y = y;
+		if (x[i] < min_x)
+			min_x = x[i];
+		if (x[i] > max_x)
+			max_x = x[i];
+		if (y[i] < min_y)
+			min_y = y[i];
+		if (y[i] > max_y)
+			max_y = y[i];
 	}
 
 	int_x = floorf(min_x);
@@ -832,8 +905,8 @@ weston_view_update_transform_enable(struct weston_view *view)
 	return 0;
 }
 
-WL_EXPORT void
-weston_view_update_transform(struct weston_view *view)
+static void
+view_update_transform(struct weston_view *view, pixman_region32_t *damage)
 {
 	struct weston_view *parent = view->geometry.parent;
 
@@ -845,7 +918,11 @@ weston_view_update_transform(struct weston_view *view)
 
 	view->transform.dirty = 0;
 
-	weston_view_damage_below(view);
+	if (damage)
+		pixman_region32_union(damage, damage,
+				      &view->transform.boundingbox);
+	else
+		weston_view_damage_below(view);
 
 	pixman_region32_fini(&view->transform.boundingbox);
 	pixman_region32_fini(&view->transform.opaque);
@@ -863,7 +940,11 @@ weston_view_update_transform(struct weston_view *view)
 			weston_view_update_transform_disable(view);
 	}
 
-	weston_view_damage_below(view);
+	if (damage)
+		pixman_region32_union(damage, damage,
+				      &view->transform.boundingbox);
+	else
+		weston_view_damage_below(view);
 
 	weston_view_assign_output(view);
 
@@ -871,6 +952,100 @@ weston_view_update_transform(struct weston_view *view)
 		       view->surface);
 }
 
+static uint64_t
+region_area(pixman_region32_t *region)
+{
+	pixman_box32_t *rects;
+	uint64_t area = 0;
+	int i, n;
+
+	rects = pixman_region32_rectangles(region, &n);
+	for (i = 0; i < n; i++)
+		area += (uint64_t) (rects[i].x2 - rects[i].x1) *
+			(rects[i].y2 - rects[i].y1);
+
+	return area;
+}
+
+WL_EXPORT void
+weston_view_update_transform(struct weston_view *view)
+{
+	struct weston_compositor *ec = view->surface->compositor;
+	pixman_region32_t damage, new_damage;
+
+	if (!view->transform.dirty || !view->transform.animation_dirty) {
+		view_update_transform(view, NULL);
+		return;
+	}
+
+	/* Count what the two weston_view_damage_below() calls add to
+	 * the plane damage, the union of both boxes minus the clip. */
+	view->transform.animation_dirty = 0;
+	pixman_region32_init(&damage);
+	pixman_region32_init(&new_damage);
+	pixman_region32_subtract(&damage, &view->transform.boundingbox,
+				 &view->clip);
+	view_update_transform(view, NULL);
+	pixman_region32_subtract(&new_damage, &view->transform.boundingbox,
+				 &view->clip);
+	pixman_region32_union(&damage, &damage, &new_damage);
+	ec->animation_damage_pixels += region_area(&damage);
+	ec->animation_transform_updates++;
+	pixman_region32_fini(&new_damage);
+	pixman_region32_fini(&damage);
+}
+
+/*
+ * Called by animations after each step. By default this just marks the
+ * view's geometry dirty, and the next repaint damages the old and the
+ * new bounding box one after the other.
+ *
+ * With [core] batch-animation-damage=true the transformation is applied
+ * right away instead, when geometry_changed says it needs to be, and the
+ * union of the two boxes goes into the plane damage as one region. Views
+ * whose geometry was already dirtied by someone else, or that were never
+ * assigned a plane, take the default path.
+ *
+ * Both paths put the same region into the plane damage, the union of
+ * the two boxes minus the clip, and that is what
+ * animation_damage_pixels counts.  What batching saves is work: steps
+ * that only change alpha within (0, 1) don't redo the transformation,
+ * which animation_transform_updates counts.
+ */
+WL_EXPORT void
+weston_view_damage_animation(struct weston_view *view, int geometry_changed)
+{
+	struct weston_compositor *ec = view->surface->compositor;
+	pixman_region32_t damage;
+
+	ec->animation_steps++;
+
+	if (!ec->batch_animation_damage || view->transform.dirty ||
+	    !view->plane) {
+		/* counted when the repaint updates the transformation */
+		if (!view->transform.dirty)
+			view->transform.animation_dirty = 1;
+		weston_view_geometry_dirty(view);
+		return;
+	}
+
+	pixman_region32_init(&damage);
+
+	if (geometry_changed) {
+		weston_view_geometry_dirty(view);
+		view_update_transform(view, &damage);
+		ec->animation_transform_updates++;
+	} else {
+		pixman_region32_copy(&damage, &view->transform.boundingbox);
+	}
+
+	pixman_region32_subtract(&damage, &damage, &view->clip);
+	pixman_region32_union(&view->plane->damage,
+			      &view->plane->damage, &damage);
+	ec->animation_damage_pixels += region_area(&damage);
+	pixman_region32_fini(&damage);
+}
+
 WL_EXPORT void
 weston_view_geometry_dirty(struct weston_view *view)
 {
@@ -1587,6 +1762,9 @@ weston_output_repaint(struct weston_output *output, uint32_t msecs)
 	pixman_region32_t output_damage;
 	int r;
 
+	/* Deliver coalesced pointer motion before the frame is built. */
+	weston_compositor_flush_motion(ec);
+
 	/* Rebuild the surface list and update surface transforms up front. */
 	weston_compositor_build_view_list(ec);
 
@@ -3216,6 +3394,166 @@ weston_environment_get_fd(const char *env)
 	return fd;
 }
 
+static struct weston_config_section *
+config_nth_section(struct weston_config *config, const char *name, int n)
+{
+	struct weston_config_section *s = NULL;
+	const char *s_name;
+
+	while (weston_config_next_section(config, &s, &s_name))
+		if (strcmp(s_name, name) == 0 && n-- == 0)
+			return s;
+
+	return NULL;
+}
+
+static int
+config_section_index(struct weston_config *config,
+		     struct weston_config_section *section, const char *name)
+{
+	struct weston_config_section *s = NULL;
+	const char *s_name;
+	int n = 0;
+
+	while (weston_config_next_section(config, &s, &s_name) &&
+	       s != section)
+		if (strcmp(s_name, name) == 0)
+			n++;
+
+	return n;
+}
+
+static void
+config_emit_changes(struct weston_compositor *ec,
+		    struct weston_config *old, struct weston_config *new)
+{
+	struct weston_config_section *s = NULL, *match;
+	struct weston_config_change change;
+	const char *name;
+	int n;
+
+	while (weston_config_next_section(new, &s, &name)) {
+		n = config_section_index(new, s, name);
+		match = config_nth_section(old, name, n);
+		if (weston_config_section_equal(s, match))
+			continue;
+
+		change.name = name;
+		change.section = s;
+		wl_signal_emit(&ec->config_signal, &change);
+	}
+
+	s = NULL;
+	while (weston_config_next_section(old, &s, &name)) {
+		n = config_section_index(old, s, name);
+		if (config_nth_section(new, name, n))
+			continue;
+
+		change.name = name;
+		change.section = NULL;
+		wl_signal_emit(&ec->config_signal, &change);
+	}
+}
+
+static void
+weston_compositor_reload_config(struct weston_compositor *ec)
+{
+	struct weston_config *config, *old;
+
+	config = weston_config_parse(ec->config_watch_path);
+	if (config == NULL) {
+		weston_log("failed to reload '%s', keeping the current "
+			   "configuration\n", ec->config_watch_path);
+		return;
+	}
+
+	weston_log("reloaded config file '%s'\n", ec->config_watch_path);
+
+	old = ec->config;
+	ec->config = config;
+	config_emit_changes(ec, old, config);
+	weston_config_destroy(old);
+}
+
+static int
+config_watch_handler(int fd, uint32_t mask, void *data)
+{
+	struct weston_compositor *ec = data;
+	char buf[4096]
+		__attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *event;
+	const char *name;
+	ssize_t len;
+	char *p;
+	int changed = 0;
+
+	name = strrchr(ec->config_watch_path, '/') + 1;
+
+	while ((len = read(fd, buf, sizeof buf)) > 0) {
+		for (p = buf; p < buf + len;
+		     p += sizeof *event + event->len) {
+			event = (const struct inotify_event *) p;
+			if (event->len && strcmp(event->name, name) == 0)
+				changed = 1;
+		}
+	}
+
+	if (changed)
+		weston_compositor_reload_config(ec);
+
+	return 1;
+}
+
+/* Watch the directory rather than the file, so editors that save by
+ * renaming a new file over the old one are noticed too. */
+static void
+weston_compositor_watch_config(struct weston_compositor *ec)
+{
+	struct wl_event_loop *loop;
+	const char *path;
+	char *dir;
+
+	path = weston_config_get_full_path(ec->config);
+	ec->config_watch_path = path ? realpath(path, NULL) : NULL;
+	if (ec->config_watch_path == NULL)
+		return;
+
+	ec->config_watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (ec->config_watch_fd < 0) {
+		weston_log("failed to watch config file: %m\n");
+		goto err_path;
+	}
+
+	dir = strdup(ec->config_watch_path);
+	if (dir == NULL)
+		goto err_fd;
+	*strrchr(dir, '/') = '\0';
+	if (inotify_add_watch(ec->config_watch_fd, dir[0] ? dir : "/",
+			      IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		weston_log("failed to watch '%s': %m\n", dir);
+		free(dir);
+		goto err_fd;
+	}
+	free(dir);
+
+	loop = wl_display_get_event_loop(ec->wl_display);
+	ec->config_watch_source =
+		wl_event_loop_add_fd(loop, ec->config_watch_fd,
+				     WL_EVENT_READABLE,
+				     config_watch_handler, ec);
+	if (ec->config_watch_source == NULL)
+		goto err_fd;
+
+	weston_log("watching config file '%s'\n", ec->config_watch_path);
+	return;
+
+err_fd:
+	close(ec->config_watch_fd);
+err_path:
+	free(ec->config_watch_path);
+	ec->config_watch_path = NULL;
+}
+
 WL_EXPORT int
 weston_compositor_init(struct weston_compositor *ec,
 		       struct wl_display *display,
@@ -3225,10 +3563,12 @@ weston_compositor_init(struct weston_compositor *ec,
 	struct wl_event_loop *loop;
 	struct xkb_rule_names xkb_names;
 	struct weston_config_section *s;
+	int i, watch_config;
 
 	ec->config = config;
 	ec->wl_display = display;
 	wl_signal_init(&ec->destroy_signal);
+	wl_signal_init(&ec->config_signal);
 	wl_signal_init(&ec->activate_signal);
 	wl_signal_init(&ec->transform_signal);
 	wl_signal_init(&ec->kill_signal);
@@ -3262,6 +3602,10 @@ weston_compositor_init(struct weston_compositor *ec,
 	wl_list_init(&ec->touch_binding_list);
 	wl_list_init(&ec->axis_binding_list);
 	wl_list_init(&ec->debug_binding_list);
+	for (i = 0; i < WESTON_BINDING_HASH_SIZE; i++) {
+		wl_list_init(&ec->key_binding_hash[i]);
+		wl_list_init(&ec->button_binding_hash[i]);
+	}
 
 	weston_plane_init(&ec->primary_plane, ec, 0, 0);
 	weston_compositor_stack_plane(ec, &ec->primary_plane, NULL);
@@ -3277,10 +3621,23 @@ weston_compositor_init(struct weston_compositor *ec,
 					 (char **) &xkb_names.variant, NULL);
 	weston_config_section_get_string(s, "keymap_options",
 					 (char **) &xkb_names.options, NULL);
+	weston_config_section_get_bool(s, "keymap_cache",
+				       &ec->use_keymap_cache, 1);
 
 	if (weston_compositor_xkb_init(ec, &xkb_names) < 0)
 		return -1;
 
+	s = weston_config_get_section(ec->config, "core", NULL, NULL);
+	weston_config_section_get_bool(s, "coalesce-motion",
+				       &ec->coalesce_motion, 0);
+	weston_config_section_get_bool(s, "batch-animation-damage",
+				       &ec->batch_animation_damage, 0);
+	weston_config_section_get_bool(s, "watch-config", &watch_config, 0);
+	if (watch_config)
+		weston_compositor_watch_config(ec);
+
+	weston_compositor_init_latency(ec);
+
 	ec->ping_handler = NULL;
 
 	screenshooter_create(ec);
@@ -3310,8 +3667,25 @@ weston_compositor_shutdown(struct weston_compositor *ec)
 	struct weston_output *output, *next;
 
 	wl_event_source_remove(ec->idle_source);
+	if (ec->config_watch_source) {
+		wl_event_source_remove(ec->config_watch_source);
+		close(ec->config_watch_fd);
+	}
+	free(ec->config_watch_path);
 	if (ec->input_loop_source)
 		wl_event_source_remove(ec->input_loop_source);
+	if (ec->motion_flush_source)
+		wl_event_source_remove(ec->motion_flush_source);
+	if (ec->coalesce_motion)
+		weston_log("coalesced %u of %u relative pointer motion events\n",
+			   ec->motion_events_coalesced, ec->motion_events);
+	if (ec->animation_steps)
+		weston_log("%u animation steps damaged %llu pixels and "
+			   "updated %u transformations (%s)\n",
+			   ec->animation_steps,
+			   (unsigned long long) ec->animation_damage_pixels,
+			   ec->animation_transform_updates,
+			   ec->batch_animation_damage ? "batched" : "per box");
 
 	/* Destroy all outputs associated with this compositor */
 	wl_list_for_each_safe(output, next, &ec->output_list, link)
@@ -3461,6 +3835,7 @@ on_caught_signal(int s, siginfo_t *siginfo, void *context)
 	 * will allow weston to switch back to gdb on crash and then
 	 * gdb will catch the crash with SIGTRAP.*/
 
+	weston_log_set_synchronous();
 	weston_log("caught signal: %d\n", s);
 
 	print_backtrace();
@@ -3596,6 +3971,9 @@ usage(int error_code)
 		"  -i, --idle-time=SECS\tIdle time in seconds\n"
 		"  --modules\t\tLoad the comma-separated list of modules\n"
 		"  --log==FILE\t\tLog to the given file\n"
+		"  --log-async\t\tWrite the log from a separate thread\n"
+		"  --tile-hash\t\tOnly send the 64x64 tiles whose contents changed\n"
+		"\t\t\tto RDP peers and the screen recorder\n"
 		"  -h, --help\t\tThis help message\n\n");
 
 	fprintf(stderr,
@@ -3648,6 +4026,8 @@ usage(int error_code)
        "  --rdp4-key=FILE\tThe file containing the key for RDP4 encryption\n"
        "  --rdp-tls-cert=FILE\tThe file containing the certificate for TLS encryption\n"
        "  --rdp-tls-key=FILE\tThe file containing the private key for TLS encryption\n"
+       "  --encoder-threads=N\tNumber of RemoteFX encoder threads, 0 to encode\n"
+       "\t\t\tin the compositor thread\n"
        "\n");
 #endif
 
@@ -3682,6 +4062,8 @@ int main(int argc, char *argv[])
 	char *shell = NULL;
 	char *modules, *option_modules = NULL;
 	char *log = NULL;
+	int32_t log_async = 0;
+	int32_t tile_hash = 0;
 	int32_t idle_time = 300;
 	int32_t help = 0;
 	char *socket_name = "wayland-0";
@@ -3696,6 +4078,8 @@ int main(int argc, char *argv[])
 		{ WESTON_OPTION_INTEGER, "idle-time", 'i', &idle_time },
 		{ WESTON_OPTION_STRING, "modules", 0, &option_modules },
 		{ WESTON_OPTION_STRING, "log", 0, &log },
+		{ WESTON_OPTION_BOOLEAN, "log-async", 0, &log_async },
+		{ WESTON_OPTION_BOOLEAN, "tile-hash", 0, &tile_hash },
 		{ WESTON_OPTION_BOOLEAN, "help", 'h', &help },
 		{ WESTON_OPTION_BOOLEAN, "version", 0, &version },
 	};
@@ -3711,6 +4095,9 @@ int main(int argc, char *argv[])
 	}
 
 	weston_log_file_open(log);
+	if (log_async && weston_log_async_start() < 0)
+		weston_log("failed to start the log writer thread, "
+			   "logging synchronously\n");
 	
 	weston_log("%s\n"
 		   STAMP_SPACE "%s\n"
@@ -3769,6 +4156,7 @@ int main(int argc, char *argv[])
 	segv_compositor = ec;
 
 	ec->idle_time = idle_time;
+	ec->tile_hash = tile_hash;
 
 	setenv("WAYLAND_DISPLAY", socket_name, 1);
 
@@ -28,6 +28,7 @@
 extern "C" {
 #endif
 
+#include <sys/time.h>
 #include <pixman.h>
 #include <xkbcommon/xkbcommon.h>
 
@@ -43,6 +44,12 @@ extern "C" {
 #define MIN(x,y) (((x) < (y)) ? (x) : (y))
 #endif
 
+#ifndef MAX
+#define MAX(x,y) (((x) > (y)) ? (x) : (y))
+#endif
+
+#define WESTON_BINDING_HASH_SIZE 64
+
 #define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
 
 #define container_of(ptr, type, member) ({				\
@@ -86,6 +93,15 @@ struct weston_shell_client {
 			       uint32_t edges, int32_t width, int32_t height);
 };
 
+/* Sections are matched by name and by position among the sections of
+ * that name, so the second [output] is compared with the second.
+ * section is the new section, or NULL if it was removed; ec->config
+ * already is the new config when this is emitted. */
+struct weston_config_change {
+	const char *name;
+	struct weston_config_section *section;
+};
+
 struct weston_shell_interface {
 	void *shell;			/* either desktop or tablet */
 
@@ -326,6 +342,9 @@ struct weston_pointer {
 
 	wl_fixed_t x, y;
 	uint32_t button_count;
+
+	int motion_pending;
+	uint32_t motion_time;
 };
 
 
@@ -410,6 +429,8 @@ struct weston_xkb_info {
 	int keymap_fd;
 	size_t keymap_size;
 	char *keymap_area;
+	uint32_t keymap_hash;
+	struct wl_list link;
 	int32_t ref_count;
 	xkb_mod_index_t shift_mod;
 	xkb_mod_index_t caps_mod;
@@ -452,6 +473,31 @@ struct weston_keyboard {
 	struct wl_resource *input_method_resource;
 };
 
+/* Latencies in microseconds, in power of two buckets: bucket 0 counts
+ * latencies below 1 us, bucket i those in [2^(i-1), 2^i) us. */
+#define WESTON_LATENCY_BUCKETS 24
+
+struct weston_latency_histogram {
+	uint32_t bucket[WESTON_LATENCY_BUCKETS];
+	uint32_t count;
+	uint64_t sum, max;
+};
+
+struct weston_input_latency {
+	char *name;
+	struct wl_list link;
+	struct weston_latency_histogram kernel_to_dispatch;
+	struct weston_latency_histogram dispatch_to_flush;
+	struct weston_latency_histogram kernel_to_flush;
+};
+
+/* The input event being processed, as far as latency tracking goes */
+struct weston_latency_event {
+	int valid, dispatched, sent;
+	struct timeval kernel, dispatch;
+	struct weston_input_latency *device;
+};
+
 struct weston_seat {
 	struct wl_list base_resource_list;
 
@@ -492,6 +538,13 @@ struct weston_seat {
 
 	struct input_method *input_method;
 	char *seat_name;
+
+	struct weston_input_latency latency;
+	struct wl_list latency_device_list;
+	struct wl_array latency_pending;
+	struct weston_latency_event latency_event;
+	/* first coalesced motion event not delivered yet */
+	struct weston_latency_event latency_deferred;
 };
 
 enum {
@@ -545,6 +598,13 @@ struct weston_compositor {
 	struct weston_shell_interface shell_interface;
 	struct weston_config *config;
 
+	/* Emitted with a struct weston_config_change for every section
+	 * that differs after the config file was reloaded. */
+	struct wl_signal config_signal;
+	struct wl_event_source *config_watch_source;
+	int config_watch_fd;
+	char *config_watch_path;
+
 	/* surface signals */
 	struct wl_signal activate_signal;
 	struct wl_signal transform_signal;
@@ -579,11 +639,16 @@ struct weston_compositor {
 	struct wl_list touch_binding_list;
 	struct wl_list axis_binding_list;
 	struct wl_list debug_binding_list;
+	/* Key and button bindings, also chained by (key or button,
+	 * modifier) so dispatch only walks bindings that can match. */
+	struct wl_list key_binding_hash[WESTON_BINDING_HASH_SIZE];
+	struct wl_list button_binding_hash[WESTON_BINDING_HASH_SIZE];
 
 	uint32_t state;
 	struct wl_event_source *idle_source;
 	uint32_t idle_inhibit;
 	int idle_time;			/* timeout, s */
+	int tile_hash;			/* drop damage on unchanged tiles */
 
 	/* Repaint state. */
 	struct weston_plane primary_plane;
@@ -606,6 +671,21 @@ struct weston_compositor {
 	struct xkb_rule_names xkb_names;
 	struct xkb_context *xkb_context;
 	struct weston_xkb_info *xkb_info;
+	struct wl_list xkb_info_list;
+	int use_keymap_cache;
+
+	int input_latency_flush_scheduled;
+
+	int coalesce_motion;
+	int motion_flush_armed;
+	struct wl_event_source *motion_flush_source;
+	uint32_t motion_events;
+	uint32_t motion_events_coalesced;
+
+	int batch_animation_damage;
+	uint64_t animation_damage_pixels;
+	uint32_t animation_steps;
+	uint32_t animation_transform_updates;
 
 	/* Raw keyboard processing (no libxkbcommon initialization or handling) */
 	int use_xkbcommon;
@@ -755,6 +835,8 @@ struct weston_view {
 	 */
 	struct {
 		int dirty;
+		/* dirtied by weston_view_damage_animation() */
+		int animation_dirty;
 
 		pixman_region32_t boundingbox;
 		pixman_region32_t opaque;
@@ -880,6 +962,9 @@ weston_view_update_transform(struct weston_view *view);
 void
 weston_view_geometry_dirty(struct weston_view *view);
 
+void
+weston_view_damage_animation(struct weston_view *view, int geometry_changed);
+
 void
 weston_view_to_global_fixed(struct weston_view *view,
 			    wl_fixed_t sx, wl_fixed_t sy,
@@ -887,11 +972,19 @@ weston_view_to_global_fixed(struct weston_view *view,
 void
 weston_view_to_global_float(struct weston_view *view,
 			    float sx, float sy, float *x, float *y);
+void
+weston_view_to_global_points(struct weston_view *view,
+			     const float *sx, const float *sy,
+			     float *x, float *y, int n);
 
 void
 weston_view_from_global_float(struct weston_view *view,
 			      float x, float y, float *vx, float *vy);
 void
+weston_view_from_global_points(struct weston_view *view,
+			       const float *x, const float *y,
+			       float *vx, float *vy, int n);
+void
 weston_view_from_global(struct weston_view *view,
 			int32_t x, int32_t y, int32_t *vx, int32_t *vy);
 void
@@ -928,6 +1021,44 @@ void
 notify_motion(struct weston_seat *seat, uint32_t time,
 	      wl_fixed_t dx, wl_fixed_t dy);
 void
+weston_compositor_flush_motion(struct weston_compositor *ec);
+
+void
+weston_latency_histogram_add(struct weston_latency_histogram *h,
+			     int64_t usec);
+void
+weston_latency_histogram_log(struct weston_latency_histogram *h,
+			     const char *name);
+void
+weston_seat_set_event_time(struct weston_seat *seat,
+			   struct weston_input_latency *device,
+			   const struct timeval *time);
+void
+weston_seat_add_input_latency(struct weston_seat *seat,
+			      struct weston_input_latency *latency,
+			      const char *name);
+void
+weston_seat_remove_input_latency(struct weston_seat *seat,
+				 struct weston_input_latency *latency);
+void
+weston_seat_latency_dispatch(struct weston_seat *seat);
+void
+weston_seat_latency_sent(struct weston_seat *seat);
+void
+weston_seat_latency_defer(struct weston_seat *seat);
+void
+weston_seat_latency_begin_deferred(struct weston_seat *seat,
+				   struct weston_latency_event *saved);
+void
+weston_seat_latency_end_deferred(struct weston_seat *seat,
+				 const struct weston_latency_event *saved);
+void
+weston_seat_init_latency(struct weston_seat *seat);
+void
+weston_seat_release_latency(struct weston_seat *seat);
+void
+weston_compositor_init_latency(struct weston_compositor *ec);
+void
 notify_motion_absolute(struct weston_seat *seat, uint32_t time,
 		       wl_fixed_t x, wl_fixed_t y);
 void
@@ -1201,6 +1332,10 @@ weston_log_file_open(const char *filename);
 void
 weston_log_file_close(void);
 int
+weston_log_async_start(void);
+void
+weston_log_set_synchronous(void);
+int
 weston_vlog(const char *fmt, va_list ap);
 int
 weston_vlog_continue(const char *fmt, va_list ap);
@@ -1231,6 +1366,19 @@ tty_activate_vt(struct tty *tty, int vt);
 void
 screenshooter_create(struct weston_compositor *ec);
 
+struct weston_tile_hash;
+
+struct weston_tile_hash *
+weston_tile_hash_create(int width, int height);
+void
+weston_tile_hash_destroy(struct weston_tile_hash *th);
+void
+weston_tile_hash_reset(struct weston_tile_hash *th);
+int
+weston_tile_hash_refine(struct weston_tile_hash *th,
+			uint32_t *data, int stride,
+			pixman_region32_t *damage);
+
 struct clipboard *
 clipboard_create(struct weston_seat *seat);
 
@@ -197,27 +197,6 @@ configure_touchpad_pressure(struct touchpad_dispatch *touchpad,
 	}
 }
 
-static double
-touchpad_profile(struct weston_motion_filter *filter,
-		 void *data,
-		 double velocity,
-		 uint32_t time)
-{
-	struct touchpad_dispatch *touchpad =
-		(struct touchpad_dispatch *) data;
-
-	double accel_factor;
-
-	accel_factor = velocity * touchpad->constant_accel_factor;
-
-	if (accel_factor > touchpad->max_accel_factor)
-		accel_factor = touchpad->max_accel_factor;
-	else if (accel_factor < touchpad->min_accel_factor)
-		accel_factor = touchpad->min_accel_factor;
-
-	return accel_factor;
-}
-
 static inline struct touchpad_motion *
 motion_history_offset(struct touchpad_dispatch *touchpad, int offset)
 {
@@ -749,7 +728,10 @@ touchpad_init(struct touchpad_dispatch *touchpad,
 	touchpad->hysteresis.center_y = 0;
 
 	/* Configure acceleration profile */
-	accel = create_pointer_accelator_filter(touchpad_profile);
+	accel = create_pointer_accelator_filter_clamped(
+		touchpad->constant_accel_factor,
+		touchpad->min_accel_factor,
+		touchpad->max_accel_factor);
 	if (accel == NULL)
 		return -1;
 	touchpad->filter = accel;
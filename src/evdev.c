@@ -30,6 +30,11 @@
 #include <fcntl.h>
 #include <mtdev.h>
 #include <assert.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 #include "compositor.h"
 #include "evdev.h"
@@ -387,8 +392,427 @@ evdev_process_events(struct evdev_device *device,
 	for (e = ev; e < end; e++) {
 		time = e->time.tv_sec * 1000 + e->time.tv_usec / 1000;
 
+		weston_seat_set_event_time(device->seat, &device->latency,
+					   &e->time);
 		dispatch->interface->process(dispatch, device, e, time);
 	}
+	weston_seat_set_event_time(device->seat, NULL, NULL);
+}
+
+static uint64_t
+evdev_monotonic_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Optional input thread, enabled with [core] input-thread=true.  The
+ * thread waits on all evdev fds, reads events as soon as the kernel
+ * has them, stamps them with the time they were read and pushes them
+ * through a single-producer, single-consumer ring to the main loop.
+ * The main loop drains the ring from an eventfd on the compositor's
+ * input loop, i.e. at the same points where it used to read the
+ * devices directly: after each repaint and whenever it is idle.
+ *
+ * The thread only ever reads from the devices; all event processing
+ * stays on the main thread.  When the ring is too full for another
+ * read, the thread stops reading and leaves the events in the kernel
+ * until the main loop has caught up, so nothing is dropped.
+ */
+#define EVDEV_QUEUE_SIZE	4096
+#define EVDEV_READ_BATCH	32
+
+struct evdev_queued_event {
+	struct evdev_device *device;
+	struct input_event ev;
+	uint64_t read_usec;
+	int died;
+};
+
+struct evdev_input_thread {
+	struct weston_compositor *compositor;
+	pthread_t thread;
+	int epoll_fd;
+	int wake_fd;
+	int ctl_fd;
+	struct wl_event_source *wake_source;
+	int device_count;
+	int quit;
+	int stalled;
+
+	pthread_mutex_t sync_mutex;
+	pthread_cond_t sync_cond;
+	uint32_t sync_request, sync_ack;
+
+	/* head is only written by the input thread, tail only by the
+	 * main thread. */
+	unsigned int head;
+	unsigned int tail;
+	struct evdev_queued_event queue[EVDEV_QUEUE_SIZE];
+
+	int draining;
+	int destroy_pending;
+
+	uint32_t stalls;
+	struct weston_latency_histogram queue_latency;
+};
+
+static struct evdev_input_thread *evdev_input_thread;
+
+static void
+evdev_process_events(struct evdev_device *device,
+		     struct input_event *ev, int count);
+static void
+evdev_input_thread_destroy(struct evdev_input_thread *it);
+
+static unsigned int
+evdev_queue_space(struct evdev_input_thread *it)
+{
+	return EVDEV_QUEUE_SIZE -
+		(it->head - __atomic_load_n(&it->tail, __ATOMIC_SEQ_CST));
+}
+
+static void
+evdev_eventfd_signal(int fd)
+{
+	uint64_t one = 1;
+
+	/* Writing to an eventfd only fails when the counter would overflow,
+	 * and then the reader already has a wakeup pending. */
+	if (write(fd, &one, sizeof one) != sizeof one)
+		return;
+}
+
+static void
+evdev_eventfd_clear(int fd)
+{
+	uint64_t count;
+
+	if (read(fd, &count, sizeof count) != sizeof count)
+		return;
+}
+
+static void
+evdev_input_thread_push(struct evdev_input_thread *it,
+			struct evdev_device *device,
+			struct input_event *ev, int count, int died)
+{
+	struct evdev_queued_event *q;
+	uint64_t now = evdev_monotonic_usec();
+	unsigned int head = it->head;
+	int i;
+
+	for (i = 0; i < count || (died && i == 0); i++) {
+		q = &it->queue[head++ & (EVDEV_QUEUE_SIZE - 1)];
+		q->device = device;
+		q->read_usec = now;
+		q->died = died;
+		if (count)
+			q->ev = ev[i];
+	}
+
+	__atomic_store_n(&it->head, head, __ATOMIC_RELEASE);
+}
+
+static int
+evdev_input_thread_read(struct evdev_input_thread *it,
+			struct evdev_device *device)
+{
+	struct input_event ev[EVDEV_READ_BATCH];
+	int len;
+
+	if (device->mtdev)
+		len = mtdev_get(device->mtdev, device->fd, ev,
+				ARRAY_LENGTH(ev)) *
+			sizeof (struct input_event);
+	else
+		len = read(device->fd, &ev, sizeof ev);
+
+	if (len < 0 || len % sizeof ev[0] != 0) {
+		if (len < 0 && errno != EAGAIN && errno != EINTR) {
+			epoll_ctl(it->epoll_fd, EPOLL_CTL_DEL,
+				  device->fd, NULL);
+			evdev_input_thread_push(it, device, NULL, 0, 1);
+			return 1;
+		}
+		return 0;
+	}
+
+	evdev_input_thread_push(it, device, ev, len / sizeof ev[0], 0);
+
+	return len > 0;
+}
+
+static void *
+evdev_input_thread_func(void *data)
+{
+	struct evdev_input_thread *it = data;
+	struct epoll_event events[16];
+	struct evdev_device *device;
+	struct pollfd pfd;
+	int i, n, pushed;
+
+	for (;;) {
+		/* Nothing here holds on to a device, so it is safe to let
+		 * evdev_input_thread_sync() return. */
+		pthread_mutex_lock(&it->sync_mutex);
+		if (it->sync_ack != it->sync_request) {
+			it->sync_ack = it->sync_request;
+			pthread_cond_broadcast(&it->sync_cond);
+		}
+		pthread_mutex_unlock(&it->sync_mutex);
+
+		if (__atomic_load_n(&it->quit, __ATOMIC_ACQUIRE))
+			break;
+
+		if (evdev_queue_space(it) < EVDEV_READ_BATCH) {
+			__atomic_store_n(&it->stalled, 1, __ATOMIC_SEQ_CST);
+			if (evdev_queue_space(it) < EVDEV_READ_BATCH) {
+				it->stalls++;
+				pfd.fd = it->ctl_fd;
+				pfd.events = POLLIN;
+				poll(&pfd, 1, -1);
+				evdev_eventfd_clear(it->ctl_fd);
+			}
+			__atomic_store_n(&it->stalled, 0, __ATOMIC_SEQ_CST);
+			continue;
+		}
+
+		n = epoll_wait(it->epoll_fd, events, ARRAY_LENGTH(events), -1);
+		pushed = 0;
+		for (i = 0; i < n; i++) {
+			device = events[i].data.ptr;
+			if (device == NULL) {
+				evdev_eventfd_clear(it->ctl_fd);
+				continue;
+			}
+			if (evdev_queue_space(it) < EVDEV_READ_BATCH)
+				continue;
+			pushed |= evdev_input_thread_read(it, device);
+		}
+
+		if (pushed)
+			evdev_eventfd_signal(it->wake_fd);
+	}
+
+	return NULL;
+}
+
+/* Waits until the input thread is between reads, so that a device
+ * removed from its epoll set is no longer referenced by it. */
+static void
+evdev_input_thread_sync(struct evdev_input_thread *it)
+{
+	uint32_t request;
+
+	pthread_mutex_lock(&it->sync_mutex);
+	request = ++it->sync_request;
+	evdev_eventfd_signal(it->ctl_fd);
+	while ((int32_t) (it->sync_ack - request) < 0)
+		pthread_cond_wait(&it->sync_cond, &it->sync_mutex);
+	pthread_mutex_unlock(&it->sync_mutex);
+}
+
+static int
+evdev_input_thread_drain(int fd, uint32_t mask, void *data)
+{
+	struct evdev_input_thread *it = data;
+	struct evdev_queued_event *q;
+	struct weston_compositor *ec = it->compositor;
+	uint64_t now_usec;
+	unsigned int tail, head;
+
+	evdev_eventfd_clear(it->wake_fd);
+
+	now_usec = evdev_monotonic_usec();
+
+	it->draining = 1;
+	tail = it->tail;
+	head = __atomic_load_n(&it->head, __ATOMIC_ACQUIRE);
+	for (; tail != head && !it->destroy_pending; tail++) {
+		q = &it->queue[tail & (EVDEV_QUEUE_SIZE - 1)];
+
+		/* A removed device's events are cleared from the ring in
+		 * evdev_input_thread_remove(). */
+		if (q->device == NULL)
+			continue;
+
+		if (q->died) {
+			weston_log("device %s died\n", q->device->devnode);
+			continue;
+		}
+
+		if (!ec->session_active)
+			continue;
+
+		weston_latency_histogram_add(&it->queue_latency,
+					     now_usec - q->read_usec);
+		evdev_process_events(q->device, &q->ev, 1);
+
+		/* Publish progress as we go, so the thread can keep
+		 * reading while a long run of events is processed. */
+		__atomic_store_n(&it->tail, tail + 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&it->stalled, __ATOMIC_SEQ_CST))
+			evdev_eventfd_signal(it->ctl_fd);
+	}
+
+	it->draining = 0;
+
+	/* The last device went away while its events were processed,
+	 * e.g. on a VT switch triggered by a key binding. */
+	if (it->destroy_pending) {
+		evdev_input_thread_destroy(it);
+		return 1;
+	}
+
+	__atomic_store_n(&it->tail, tail, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&it->stalled, __ATOMIC_SEQ_CST))
+		evdev_eventfd_signal(it->ctl_fd);
+
+	return 1;
+}
+
+static void
+evdev_input_thread_destroy(struct evdev_input_thread *it)
+{
+	__atomic_store_n(&it->quit, 1, __ATOMIC_RELEASE);
+	evdev_eventfd_signal(it->ctl_fd);
+	pthread_join(it->thread, NULL);
+
+	if (it->stalls)
+		weston_log("input thread stalled %u times on a full queue\n",
+			   it->stalls);
+	weston_latency_histogram_log(&it->queue_latency,
+				     "input thread queue");
+
+	wl_event_source_remove(it->wake_source);
+	close(it->epoll_fd);
+	close(it->wake_fd);
+	close(it->ctl_fd);
+	pthread_mutex_destroy(&it->sync_mutex);
+	pthread_cond_destroy(&it->sync_cond);
+	free(it);
+}
+
+static struct evdev_input_thread *
+evdev_input_thread_create(struct weston_compositor *ec)
+{
+	struct evdev_input_thread *it;
+	struct epoll_event ev;
+
+	it = zalloc(sizeof *it);
+	if (it == NULL)
+		return NULL;
+
+	it->compositor = ec;
+	pthread_mutex_init(&it->sync_mutex, NULL);
+	pthread_cond_init(&it->sync_cond, NULL);
+
+	it->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	it->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	it->ctl_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (it->epoll_fd < 0 || it->wake_fd < 0 || it->ctl_fd < 0)
+		goto err_fds;
+
+	memset(&ev, 0, sizeof ev);
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if (epoll_ctl(it->epoll_fd, EPOLL_CTL_ADD, it->ctl_fd, &ev) < 0)
+		goto err_fds;
+
+	it->wake_source = wl_event_loop_add_fd(ec->input_loop, it->wake_fd,
+					       WL_EVENT_READABLE,
+					       evdev_input_thread_drain, it);
+	if (it->wake_source == NULL)
+		goto err_fds;
+
+	if (pthread_create(&it->thread, NULL, evdev_input_thread_func, it)) {
+		wl_event_source_remove(it->wake_source);
+		goto err_fds;
+	}
+
+	weston_log("reading input devices on a separate thread\n");
+
+	return it;
+
+err_fds:
+	weston_log("failed to start the input thread: %m\n");
+	if (it->epoll_fd >= 0)
+		close(it->epoll_fd);
+	if (it->wake_fd >= 0)
+		close(it->wake_fd);
+	if (it->ctl_fd >= 0)
+		close(it->ctl_fd);
+	pthread_mutex_destroy(&it->sync_mutex);
+	pthread_cond_destroy(&it->sync_cond);
+	free(it);
+	return NULL;
+}
+
+static int
+evdev_input_thread_add(struct evdev_device *device)
+{
+	struct weston_compositor *ec = device->seat->compositor;
+	struct weston_config_section *s;
+	struct epoll_event ev;
+	int enabled;
+
+	if (evdev_input_thread == NULL) {
+		s = weston_config_get_section(ec->config, "core", NULL, NULL);
+		weston_config_section_get_bool(s, "input-thread", &enabled, 0);
+		if (!enabled)
+			return -1;
+
+		evdev_input_thread = evdev_input_thread_create(ec);
+		if (evdev_input_thread == NULL)
+			return -1;
+	}
+
+	memset(&ev, 0, sizeof ev);
+	ev.events = EPOLLIN;
+	ev.data.ptr = device;
+	if (epoll_ctl(evdev_input_thread->epoll_fd, EPOLL_CTL_ADD,
+		      device->fd, &ev) < 0) {
+		if (evdev_input_thread->device_count == 0) {
+			evdev_input_thread_destroy(evdev_input_thread);
+			evdev_input_thread = NULL;
+		}
+		return -1;
+	}
+
+	device->input_thread = evdev_input_thread;
+	evdev_input_thread->device_count++;
+
+	return 0;
+}
+
+static void
+evdev_input_thread_remove(struct evdev_device *device)
+{
+	struct evdev_input_thread *it = device->input_thread;
+	unsigned int i, head;
+
+	epoll_ctl(it->epoll_fd, EPOLL_CTL_DEL, device->fd, NULL);
+	evdev_input_thread_sync(it);
+
+	/* Forget whatever the thread queued for this device. */
+	head = __atomic_load_n(&it->head, __ATOMIC_ACQUIRE);
+	for (i = it->tail; i != head; i++)
+		if (it->queue[i & (EVDEV_QUEUE_SIZE - 1)].device == device)
+			it->queue[i & (EVDEV_QUEUE_SIZE - 1)].device = NULL;
+
+	device->input_thread = NULL;
+	if (--it->device_count == 0) {
+		evdev_input_thread = NULL;
+		if (it->draining)
+			it->destroy_pending = 1;
+		else
+			evdev_input_thread_destroy(it);
+	}
 }
 
 static int
@@ -589,6 +1013,9 @@ evdev_configure_device(struct evdev_device *device)
 	return 0;
 }
 
+static void
+evdev_device_free(struct evdev_device *device);
+
 struct evdev_device *
 evdev_device_create(struct weston_seat *seat, const char *path, int device_fd)
 {
@@ -622,7 +1049,7 @@ evdev_device_create(struct weston_seat *seat, const char *path, int device_fd)
 	device->devname = strdup(devname);
 
 	if (!evdev_handle_device(device)) {
-		evdev_device_destroy(device);
+		evdev_device_free(device);
 		return EVDEV_UNHANDLED_DEVICE;
 	}
 
@@ -635,24 +1062,34 @@ evdev_device_create(struct weston_seat *seat, const char *path, int device_fd)
 	if (device->dispatch == NULL)
 		goto err;
 
-	device->source = wl_event_loop_add_fd(ec->input_loop, device->fd,
-					      WL_EVENT_READABLE,
-					      evdev_device_data, device);
-	if (device->source == NULL)
-		goto err;
+	if (evdev_input_thread_add(device) < 0) {
+		device->source = wl_event_loop_add_fd(ec->input_loop,
+						      device->fd,
+						      WL_EVENT_READABLE,
+						      evdev_device_data,
+						      device);
+		if (device->source == NULL)
+			goto err;
+	}
+
+	weston_seat_add_input_latency(seat, &device->latency,
+				      device->devname);
 
 	return device;
 
 err:
-	evdev_device_destroy(device);
+	evdev_device_free(device);
 	return NULL;
 }
 
-void
-evdev_device_destroy(struct evdev_device *device)
+static void
+evdev_device_free(struct evdev_device *device)
 {
 	struct evdev_dispatch *dispatch;
 
+	if (device->input_thread)
+		evdev_input_thread_remove(device);
+
 	if (device->seat_caps & EVDEV_SEAT_POINTER)
 		weston_seat_release_pointer(device->seat);
 	if (device->seat_caps & EVDEV_SEAT_KEYBOARD)
@@ -675,6 +1112,13 @@ evdev_device_destroy(struct evdev_device *device)
 	free(device);
 }
 
+void
+evdev_device_destroy(struct evdev_device *device)
+{
+	weston_seat_remove_input_latency(device->seat, &device->latency);
+	evdev_device_free(device);
+}
+
 void
 evdev_notify_keyboard_focus(struct weston_seat *seat,
 			    struct wl_list *evdev_devices)
@@ -59,6 +59,7 @@ struct evdev_device {
 	struct weston_seat *seat;
 	struct wl_list link;
 	struct wl_event_source *source;
+	struct evdev_input_thread *input_thread;
 	struct weston_output *output;
 	struct evdev_dispatch *dispatch;
 	char *devnode;
@@ -89,6 +90,8 @@ struct evdev_device {
 	enum evdev_device_seat_capability seat_caps;
 
 	int is_mt;
+
+	struct weston_input_latency latency;
 };
 
 /* copied from udev/extras/input_id/input_id.c */
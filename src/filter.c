@@ -47,12 +47,17 @@ weston_filter_dispatch(struct weston_motion_filter *filter,
 #define MAX_VELOCITY_DIFF	1.0
 #define MOTION_TIMEOUT		300 /* (ms) */
 #define NUM_POINTER_TRACKERS	16
-
-struct pointer_tracker {
-	double dx;
-	double dy;
-	uint32_t time;
-	int dir;
+#define TRACKER_MASK		(NUM_POINTER_TRACKERS - 1)
+
+/* The trackers are kept as a structure of arrays embedded in the
+ * accelerator, so feeding a motion event is a straight loop over two
+ * double arrays and the velocity scan touches only the columns it
+ * needs. NUM_POINTER_TRACKERS must be a power of two. */
+struct pointer_trackers {
+	double dx[NUM_POINTER_TRACKERS];
+	double dy[NUM_POINTER_TRACKERS];
+	uint32_t time[NUM_POINTER_TRACKERS];
+	int dir[NUM_POINTER_TRACKERS];
 };
 
 struct pointer_accelerator;
@@ -61,13 +66,19 @@ struct pointer_accelerator {
 
 	accel_profile_func_t profile;
 
+	/* Parameters of the clamped linear profile, see
+	 * create_pointer_accelator_filter_clamped() */
+	double constant_factor;
+	double min_factor;
+	double max_factor;
+
 	double velocity;
 	double last_velocity;
 	int last_dx;
 	int last_dy;
 
-	struct pointer_tracker *trackers;
-	int cur_tracker;
+	struct pointer_trackers trackers;
+	unsigned int cur_tracker;
 };
 
 enum directions {
@@ -133,66 +144,65 @@ feed_trackers(struct pointer_accelerator *accel,
 	      double dx, double dy,
 	      uint32_t time)
 {
-	int i, current;
-	struct pointer_tracker *trackers = accel->trackers;
+	struct pointer_trackers *trackers = &accel->trackers;
+	unsigned int i, current;
 
 	for (i = 0; i < NUM_POINTER_TRACKERS; i++) {
-		trackers[i].dx += dx;
-		trackers[i].dy += dy;
+		trackers->dx[i] += dx;
+		trackers->dy[i] += dy;
 	}
 
-	current = (accel->cur_tracker + 1) % NUM_POINTER_TRACKERS;
+	current = (accel->cur_tracker + 1) & TRACKER_MASK;
 	accel->cur_tracker = current;
 
-	trackers[current].dx = 0.0;
-	trackers[current].dy = 0.0;
-	trackers[current].time = time;
-	trackers[current].dir = get_direction(dx, dy);
+	trackers->dx[current] = 0.0;
+	trackers->dy[current] = 0.0;
+	trackers->time[current] = time;
+	trackers->dir[current] = get_direction(dx, dy);
 }
 
-static struct pointer_tracker *
+static inline unsigned int
 tracker_by_offset(struct pointer_accelerator *accel, unsigned int offset)
 {
-	unsigned int index =
-		(accel->cur_tracker + NUM_POINTER_TRACKERS - offset)
-		% NUM_POINTER_TRACKERS;
-	return &accel->trackers[index];
+	return (accel->cur_tracker - offset) & TRACKER_MASK;
 }
 
-static double
-calculate_tracker_velocity(struct pointer_tracker *tracker, uint32_t time)
+static inline double
+calculate_tracker_velocity(struct pointer_trackers *trackers,
+			   unsigned int index, uint32_t time)
 {
 	int dx;
 	int dy;
 	double distance;
 
-	dx = tracker->dx;
-	dy = tracker->dy;
+	dx = trackers->dx[index];
+	dy = trackers->dy[index];
 	distance = sqrt(dx*dx + dy*dy);
-	return distance / (double)(time - tracker->time);
+	return distance / (double)(time - trackers->time[index]);
 }
 
 static double
 calculate_velocity(struct pointer_accelerator *accel, uint32_t time)
 {
-	struct pointer_tracker *tracker;
+	struct pointer_trackers *trackers = &accel->trackers;
+	unsigned int index;
 	double velocity;
 	double result = 0.0;
 	double initial_velocity;
 	double velocity_diff;
 	unsigned int offset;
 
-	unsigned int dir = tracker_by_offset(accel, 0)->dir;
+	unsigned int dir = trackers->dir[tracker_by_offset(accel, 0)];
 
 	/* Find first velocity */
 	for (offset = 1; offset < NUM_POINTER_TRACKERS; offset++) {
-		tracker = tracker_by_offset(accel, offset);
+		index = tracker_by_offset(accel, offset);
 
-		if (time <= tracker->time)
+		if (time <= trackers->time[index])
 			continue;
 
 		result = initial_velocity =
-			calculate_tracker_velocity(tracker, time);
+			calculate_tracker_velocity(trackers, index, time);
 		if (initial_velocity > 0.0)
 			break;
 	}
@@ -200,19 +210,19 @@ calculate_velocity(struct pointer_accelerator *accel, uint32_t time)
 	/* Find least recent vector within a timelimit, maximum velocity diff
 	 * and direction threshold. */
 	for (; offset < NUM_POINTER_TRACKERS; offset++) {
-		tracker = tracker_by_offset(accel, offset);
+		index = tracker_by_offset(accel, offset);
 
 		/* Stop if too far away in time */
-		if (time - tracker->time > MOTION_TIMEOUT ||
-		    tracker->time > time)
+		if (time - trackers->time[index] > MOTION_TIMEOUT ||
+		    trackers->time[index] > time)
 			break;
 
 		/* Stop if direction changed */
-		dir &= tracker->dir;
+		dir &= trackers->dir[index];
 		if (dir == 0)
 			break;
 
-		velocity = calculate_tracker_velocity(tracker, time);
+		velocity = calculate_tracker_velocity(trackers, index, time);
 
 		/* Stop if velocity differs too much from initial */
 		velocity_diff = fabs(initial_velocity - velocity);
@@ -252,6 +262,40 @@ calculate_acceleration(struct pointer_accelerator *accel,
 	return factor;
 }
 
+/* Closed form of the clamped linear profile. The clamp is written so the
+ * compiler can lower it to min/max instructions rather than branches,
+ * and matches the if/else-if chain callers used to write by hand: the
+ * upper bound wins when min_factor > max_factor. */
+static inline double
+clamped_profile(struct pointer_accelerator *accel, double velocity)
+{
+	double linear = velocity * accel->constant_factor;
+	double factor;
+
+	factor = linear < accel->min_factor ? accel->min_factor : linear;
+	factor = linear > accel->max_factor ? accel->max_factor : factor;
+
+	return factor;
+}
+
+static inline double
+calculate_clamped_acceleration(struct pointer_accelerator *accel,
+			       double velocity)
+{
+	double factor;
+
+	/* Same Simpson's rule as calculate_acceleration(), without going
+	 * through the profile callback. */
+	factor = clamped_profile(accel, velocity);
+	factor += clamped_profile(accel, accel->last_velocity);
+	factor += 4.0 *
+		clamped_profile(accel, (accel->last_velocity + velocity) / 2);
+
+	factor = factor / 6.0;
+
+	return factor;
+}
+
 static double
 soften_delta(double last_delta, double delta)
 {
@@ -273,6 +317,22 @@ apply_softening(struct pointer_accelerator *accel,
 	motion->dy = soften_delta(accel->last_dy, motion->dy);
 }
 
+static void
+accelerator_apply(struct pointer_accelerator *accel,
+		  struct weston_motion_params *motion,
+		  double velocity, double accel_value)
+{
+	motion->dx = accel_value * motion->dx;
+	motion->dy = accel_value * motion->dy;
+
+	apply_softening(accel, motion);
+
+	accel->last_dx = motion->dx;
+	accel->last_dy = motion->dy;
+
+	accel->last_velocity = velocity;
+}
+
 static void
 accelerator_filter(struct weston_motion_filter *filter,
 		   struct weston_motion_params *motion,
@@ -287,15 +347,24 @@ accelerator_filter(struct weston_motion_filter *filter,
 	velocity = calculate_velocity(accel, time);
 	accel_value = calculate_acceleration(accel, data, velocity, time);
 
-	motion->dx = accel_value * motion->dx;
-	motion->dy = accel_value * motion->dy;
+	accelerator_apply(accel, motion, velocity, accel_value);
+}
 
-	apply_softening(accel, motion);
+static void
+clamped_accelerator_filter(struct weston_motion_filter *filter,
+			   struct weston_motion_params *motion,
+			   void *data, uint32_t time)
+{
+	struct pointer_accelerator *accel =
+		(struct pointer_accelerator *) filter;
+	double velocity;
+	double accel_value;
 
-	accel->last_dx = motion->dx;
-	accel->last_dy = motion->dy;
+	feed_trackers(accel, motion->dx, motion->dy, time);
+	velocity = calculate_velocity(accel, time);
+	accel_value = calculate_clamped_acceleration(accel, velocity);
 
-	accel->last_velocity = velocity;
+	accelerator_apply(accel, motion, velocity, accel_value);
 }
 
 static void
@@ -304,7 +373,6 @@ accelerator_destroy(struct weston_motion_filter *filter)
 	struct pointer_accelerator *accel =
 		(struct pointer_accelerator *) filter;
 
-	free(accel->trackers);
 	free(accel);
 }
 
@@ -313,26 +381,54 @@ struct weston_motion_filter_interface accelerator_interface = {
 	accelerator_destroy
 };
 
-struct weston_motion_filter *
-create_pointer_accelator_filter(accel_profile_func_t profile)
+struct weston_motion_filter_interface clamped_accelerator_interface = {
+	clamped_accelerator_filter,
+	accelerator_destroy
+};
+
+static struct pointer_accelerator *
+pointer_accelerator_create(struct weston_motion_filter_interface *interface)
 {
 	struct pointer_accelerator *filter;
 
-	filter = malloc(sizeof *filter);
+	filter = zalloc(sizeof *filter);
 	if (filter == NULL)
 		return NULL;
 
-	filter->base.interface = &accelerator_interface;
+	filter->base.interface = interface;
 	wl_list_init(&filter->base.link);
 
+	return filter;
+}
+
+struct weston_motion_filter *
+create_pointer_accelator_filter(accel_profile_func_t profile)
+{
+	struct pointer_accelerator *filter;
+
+	filter = pointer_accelerator_create(&accelerator_interface);
+	if (filter == NULL)
+		return NULL;
+
 	filter->profile = profile;
-	filter->last_velocity = 0.0;
-	filter->last_dx = 0;
-	filter->last_dy = 0;
 
-	filter->trackers =
-		calloc(NUM_POINTER_TRACKERS, sizeof *filter->trackers);
-	filter->cur_tracker = 0;
+	return &filter->base;
+}
+
+struct weston_motion_filter *
+create_pointer_accelator_filter_clamped(double constant_factor,
+					double min_factor,
+					double max_factor)
+{
+	struct pointer_accelerator *filter;
+
+	filter = pointer_accelerator_create(&clamped_accelerator_interface);
+	if (filter == NULL)
+		return NULL;
+
+	filter->constant_factor = constant_factor;
+	filter->min_factor = min_factor;
+	filter->max_factor = max_factor;
 
 	return &filter->base;
 }
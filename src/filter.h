@@ -64,4 +64,12 @@ typedef double (*accel_profile_func_t)(struct weston_motion_filter *filter,
 WL_EXPORT struct weston_motion_filter *
 create_pointer_accelator_filter(accel_profile_func_t filter);
 
+/* Accelerator using the profile
+ * clamp(velocity * constant_factor, min_factor, max_factor), evaluated
+ * inline instead of through a profile callback. */
+WL_EXPORT struct weston_motion_filter *
+create_pointer_accelator_filter_clamped(double constant_factor,
+					double min_factor,
+					double max_factor);
+
 #endif // _FILTER_H_
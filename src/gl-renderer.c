@@ -106,6 +106,7 @@ struct gl_renderer {
 	struct wl_array vertices;
 	struct wl_array indices; /* only used in compositor-wayland */
 	struct wl_array vtxcnt;
+	struct wl_array clip; /* scratch space for texture_region() */
 
 	PFNGLEGLIMAGETARGETTEXTURE2DOESPROC image_target_texture_2d;
 	PFNEGLCREATEIMAGEKHRPROC create_image;
@@ -195,81 +196,16 @@ gl_renderer_print_egl_error_state(void)
 		egl_error_string(code), (long)code);
 }
 
-#define max(a, b) (((a) > (b)) ? (a) : (b))
-#define min(a, b) (((a) > (b)) ? (b) : (a))
-
 /*
- * Compute the boundary vertices of the intersection of the global coordinate
- * aligned rectangle 'rect', and an arbitrary quadrilateral produced from
- * 'surf_rect' when transformed from surface coordinates into global coordinates.
- * The vertices are written to 'ex' and 'ey', and the return value is the
- * number of vertices. Vertices are produced in clockwise winding order.
- * Guarantees to produce either zero vertices, or 3-8 vertices with non-zero
- * polygon area.
+ * Compute the intersections of the global coordinate aligned rectangles
+ * of 'region' with the quadrilaterals produced from the rectangles of
+ * 'surf_region' when transformed from surface coordinates into global
+ * coordinates. Each intersection is stored as a triangle fan of 3-8
+ * vertices with non-zero area, and the number of fans is returned.
+ *
+ * Each surface rect is transformed once and clipped against all of the
+ * region's rects in one batch.
  */
-static int
-calculate_edges(struct weston_view *ev, pixman_box32_t *rect,
-		pixman_box32_t *surf_rect, GLfloat *ex, GLfloat *ey)
-{
-
-	struct clip_context ctx;
-	int i, n;
-	GLfloat min_x, max_x, min_y, max_y;
-	struct polygon8 surf = {
-		{ surf_rect->x1, surf_rect->x2, surf_rect->x2, surf_rect->x1 },
-		{ surf_rect->y1, surf_rect->y1, surf_rect->y2, surf_rect->y2 },
-		4
-	};
-
-	ctx.clip.x1 = rect->x1;
-	ctx.clip.y1 = rect->y1;
-	ctx.clip.x2 = rect->x2;
-	ctx.clip.y2 = rect->y2;
-
-	/* transform surface to screen space: */
-	for (i = 0; i < surf.n; i++)
-		weston_view_to_global_float(ev, surf.x[i], surf.y[i],
-					    &surf.x[i], &surf.y[i]);
-
-	/* find bounding box: */
-	min_x = max_x = surf.x[0];
-	min_y = max_y = surf.y[0];
-
-	for (i = 1; i < surf.n; i++) {
-		min_x = min(min_x, surf.x[i]);
-		max_x = max(max_x, surf.x[i]);
-		min_y = min(min_y, surf.y[i]);
-		max_y = max(max_y, surf.y[i]);
-	}
-
-	/* First, simple bounding box check to discard early transformed
-	 * surface rects that do not intersect with the clip region:
-	 */
-	if ((min_x >= ctx.clip.x2) || (max_x <= ctx.clip.x1) ||
-	    (min_y >= ctx.clip.y2) || (max_y <= ctx.clip.y1))
-		return 0;
-
-	/* Simple case, bounding box edges are parallel to surface edges,
-	 * there will be only four edges.  We just need to clip the surface
-	 * vertices to the clip rect bounds:
-	 */
-	if (!ev->transform.enabled)
-		return clip_simple(&ctx, &surf, ex, ey);
-
-	/* Transformed case: use a general polygon clipping algorithm to
-	 * clip the surface rectangle with each side of 'rect'.
-	 * The algorithm is Sutherland-Hodgman, as explained in
-	 * http://www.codeguru.com/cpp/misc/misc/graphics/article.php/c8965/Polygon-Clipping.htm
-	 * but without looking at any of that code.
-	 */
-	n = clip_transformed(&ctx, &surf, ex, ey);
-
-	if (n < 3)
-		return 0;
-
-	return n;
-}
-
 static int
 texture_region(struct weston_view *ev, pixman_region32_t *region,
 		pixman_region32_t *surf_region)
@@ -277,10 +213,12 @@ texture_region(struct weston_view *ev, pixman_region32_t *region,
 	struct gl_surface_state *gs = get_surface_state(ev->surface);
 	struct weston_compositor *ec = ev->surface->compositor;
 	struct gl_renderer *gr = get_renderer(ec);
-	GLfloat *v, inv_width, inv_height;
+	GLfloat *v, *ex, *ey, *sx, *sy, inv_width, inv_height;
+	GLfloat *x1, *y1, *x2, *y2;
 	unsigned int *vtxcnt, nvtx = 0;
 	pixman_box32_t *rects, *surf_rects;
-	int i, j, k, nrects, nsurf;
+	struct clip_rects clip;
+	int i, j, k, nrects, nsurf, npoly, first, *polycnt;
 
 	rects = pixman_region32_rectangles(region, &nrects);
 	surf_rects = pixman_region32_rectangles(surf_region, &nsurf);
@@ -291,56 +229,102 @@ texture_region(struct weston_view *ev, pixman_region32_t *region,
 	v = wl_array_add(&gr->vertices, nrects * nsurf * 8 * 4 * sizeof *v);
 	vtxcnt = wl_array_add(&gr->vtxcnt, nrects * nsurf * sizeof *vtxcnt);
 
-	inv_width = 1.0 / gs->pitch;
-        inv_height = 1.0 / gs->height;
+	/* the clip rects, then the edge points in screen space and in
+	 * view space, then the vertex count of each clipped polygon */
+	gr->clip.size = 0;
+	x1 = wl_array_add(&gr->clip, nrects * (36 * sizeof *x1 +
+					       sizeof *polycnt));
+	y1 = x1 + nrects;
+	x2 = y1 + nrects;
+	y2 = x2 + nrects;
+	ex = y2 + nrects;
+	ey = ex + nrects * 8;
+	sx = ey + nrects * 8;
+	sy = sx + nrects * 8;
+	polycnt = (int *) (sy + nrects * 8);
 
 	for (i = 0; i < nrects; i++) {
-		pixman_box32_t *rect = &rects[i];
-		for (j = 0; j < nsurf; j++) {
-			pixman_box32_t *surf_rect = &surf_rects[j];
-			GLfloat sx, sy, bx, by;
-			GLfloat ex[8], ey[8];          /* edge points in screen space */
-			int n;
-
-			/* The transformed surface, after clipping to the clip region,
-			 * can have as many as eight sides, emitted as a triangle-fan.
-			 * The first vertex in the triangle fan can be chosen arbitrarily,
-			 * since the area is guaranteed to be convex.
-			 *
-			 * If a corner of the transformed surface falls outside of the
-			 * clip region, instead of emitting one vertex for the corner
-			 * of the surface, up to two are emitted for two corresponding
-			 * intersection point(s) between the surface and the clip region.
-			 *
-			 * To do this, we first calculate the (up to eight) points that
-			 * form the intersection of the clip rect and the transformed
-			 * surface.
-			 */
-			n = calculate_edges(ev, rect, surf_rect, ex, ey);
-			if (n < 3)
-				continue;
+		x1[i] = rects[i].x1;
+		y1[i] = rects[i].y1;
+		x2[i] = rects[i].x2;
+		y2[i] = rects[i].y2;
+	}
 
-			/* emit edge points: */
-			for (k = 0; k < n; k++) {
-				weston_view_from_global_float(ev, ex[k], ey[k],
-							      &sx, &sy);
-				/* position: */
-				*(v++) = ex[k];
-				*(v++) = ey[k];
-				/* texcoord: */
-				weston_surface_to_buffer_float(ev->surface,
-							       sx, sy,
-							       &bx, &by);
-				*(v++) = bx * inv_width;
-				if (gs->y_inverted) {
-					*(v++) = by * inv_height;
-				} else {
-					*(v++) = (gs->height - by) * inv_height;
-				}
-			}
+	clip.x1 = x1;
+	clip.y1 = y1;
+	clip.x2 = x2;
+	clip.y2 = y2;
+	clip.n = nrects;
+
+	inv_width = 1.0 / gs->pitch;
+        inv_height = 1.0 / gs->height;
 
-			vtxcnt[nvtx++] = n;
+	for (j = 0; j < nsurf; j++) {
+		pixman_box32_t *surf_rect = &surf_rects[j];
+		struct polygon8 surf = {
+			{ surf_rect->x1, surf_rect->x2,
+			  surf_rect->x2, surf_rect->x1 },
+			{ surf_rect->y1, surf_rect->y1,
+			  surf_rect->y2, surf_rect->y2 },
+			4
+		};
+		GLfloat bx, by;
+
+		/* transform surface to screen space: */
+		weston_view_to_global_points(ev, surf.x, surf.y,
+					     surf.x, surf.y, surf.n);
+
+		/* The transformed surface, after clipping to a clip rect,
+		 * can have as many as eight sides, emitted as a triangle-fan.
+		 * The first vertex in the triangle fan can be chosen
+		 * arbitrarily, since the area is guaranteed to be convex.
+		 *
+		 * If a corner of the transformed surface falls outside of
+		 * the clip rect, instead of emitting one vertex for the
+		 * corner of the surface, up to two are emitted for two
+		 * corresponding intersection point(s) between the surface
+		 * and the clip rect.
+		 *
+		 * When the surface is not transformed, its edges are
+		 * parallel to the clip rect edges, and clamping its
+		 * vertices to the clip rect is enough. Otherwise a general
+		 * polygon clipping algorithm clips it with each side of the
+		 * clip rect. The algorithm is Sutherland-Hodgman, as
+		 * explained in
+		 * http://www.codeguru.com/cpp/misc/misc/graphics/article.php/c8965/Polygon-Clipping.htm
+		 * but without looking at any of that code.
+		 */
+		if (ev->transform.enabled)
+			npoly = clip_transformed_batch(&surf, &clip,
+						       ex, ey, polycnt);
+		else
+			npoly = clip_simple_batch(&surf, &clip,
+						  ex, ey, polycnt);
+
+		for (i = 0, first = 0; i < npoly; i++)
+			first += polycnt[i];
+
+		weston_view_from_global_points(ev, ex, ey, sx, sy, first);
+
+		/* emit edge points: */
+		for (k = 0; k < first; k++) {
+			/* position: */
+			*(v++) = ex[k];
+			*(v++) = ey[k];
+			/* texcoord: */
+			weston_surface_to_buffer_float(ev->surface,
+						       sx[k], sy[k],
+						       &bx, &by);
+			*(v++) = bx * inv_width;
+			if (gs->y_inverted) {
+				*(v++) = by * inv_height;
+			} else {
+				*(v++) = (gs->height - by) * inv_height;
+			}
 		}
+
+		for (i = 0; i < npoly; i++)
+			vtxcnt[nvtx++] = polycnt[i];
 	}
 
 	return nvtx;
@@ -1629,6 +1613,7 @@ gl_renderer_destroy(struct weston_compositor *ec)
 	wl_array_release(&gr->vertices);
 	wl_array_release(&gr->indices);
 	wl_array_release(&gr->vtxcnt);
+	wl_array_release(&gr->clip);
 
 	/* We would normally remove the bindings here but they should have
 	 * already been removed when the compositor shutdown */
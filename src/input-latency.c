@@ -0,0 +1,308 @@
+/*
+ * Copyright © 2014 Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <linux/input.h>
+
+#include "compositor.h"
+
+/*
+ * Input-to-client latency.  Backends that know when the kernel saw an
+ * event (evdev) tag the seat with that time around the notify_*()
+ * call.  The input code records when the event is dispatched and, if
+ * it is sent to a client, queues a sample; the samples are completed
+ * from an idle callback that flushes the clients' connections and
+ * takes the flush time.  Each stage is aggregated per seat and per
+ * device into log2 histograms that the debug binding (mod+shift+space,
+ * then I) writes to the log.
+ */
+
+WL_EXPORT void
+weston_latency_histogram_add(struct weston_latency_histogram *h,
+			     int64_t usec)
+{
+	unsigned int i = 0;
+
+	if (usec < 0)
+		return;
+
+	while (i < WESTON_LATENCY_BUCKETS - 1 && usec >= (1ll << i))
+		i++;
+
+	h->bucket[i]++;
+	h->count++;
+	h->sum += usec;
+	if ((uint64_t) usec > h->max)
+		h->max = usec;
+}
+
+WL_EXPORT void
+weston_latency_histogram_log(struct weston_latency_histogram *h,
+			     const char *name)
+{
+	unsigned int i;
+
+	if (h->count == 0)
+		return;
+
+	weston_log("%s latency over %u events: mean %llu us, max %llu us\n",
+		   name, h->count, (unsigned long long) (h->sum / h->count),
+		   (unsigned long long) h->max);
+	for (i = 0; i < WESTON_LATENCY_BUCKETS; i++) {
+		if (h->bucket[i] == 0)
+			continue;
+		if (i == 0)
+			weston_log_continue(STAMP_SPACE "        < 1 us: %u\n",
+					    h->bucket[i]);
+		else if (i == WESTON_LATENCY_BUCKETS - 1)
+			weston_log_continue(STAMP_SPACE "  >= %8u us: %u\n",
+					    1u << (i - 1), h->bucket[i]);
+		else
+			weston_log_continue(STAMP_SPACE "  < %9u us: %u\n",
+					    1u << i, h->bucket[i]);
+	}
+}
+
+static int64_t
+timeval_diff_usec(const struct timeval *a, const struct timeval *b)
+{
+	return (int64_t) (a->tv_sec - b->tv_sec) * 1000000 +
+		(a->tv_usec - b->tv_usec);
+}
+
+struct latency_sample {
+	struct timeval kernel;
+	struct timeval dispatch;
+	struct weston_input_latency *device;
+};
+
+static void
+input_latency_add(struct weston_input_latency *latency,
+		  const struct latency_sample *sample,
+		  const struct timeval *flush)
+{
+	weston_latency_histogram_add(&latency->dispatch_to_flush,
+				     timeval_diff_usec(flush,
+						       &sample->dispatch));
+	weston_latency_histogram_add(&latency->kernel_to_flush,
+				     timeval_diff_usec(flush,
+						       &sample->kernel));
+}
+
+static void
+input_latency_flush(void *data)
+{
+	struct weston_compositor *ec = data;
+	struct latency_sample *sample;
+	struct weston_seat *seat;
+	struct timeval now;
+
+	ec->input_latency_flush_scheduled = 0;
+
+	/* This is what wl_display_run() would do right after us. */
+	wl_display_flush_clients(ec->wl_display);
+	gettimeofday(&now, NULL);
+
+	wl_list_for_each(seat, &ec->seat_list, link) {
+		wl_array_for_each(sample, &seat->latency_pending) {
+			input_latency_add(&seat->latency, sample, &now);
+			if (sample->device)
+				input_latency_add(sample->device, sample, &now);
+		}
+		seat->latency_pending.size = 0;
+	}
+}
+
+WL_EXPORT void
+weston_seat_set_event_time(struct weston_seat *seat,
+			   struct weston_input_latency *device,
+			   const struct timeval *time)
+{
+	seat->latency_event.valid = time != NULL;
+	if (time)
+		seat->latency_event.kernel = *time;
+	seat->latency_event.device = device;
+	seat->latency_event.dispatched = 0;
+	seat->latency_event.sent = 0;
+}
+
+void
+weston_seat_latency_dispatch(struct weston_seat *seat)
+{
+	struct weston_input_latency *device = seat->latency_event.device;
+	int64_t usec;
+
+	if (!seat->latency_event.valid || seat->latency_event.dispatched)
+		return;
+
+	gettimeofday(&seat->latency_event.dispatch, NULL);
+	seat->latency_event.dispatched = 1;
+
+	usec = timeval_diff_usec(&seat->latency_event.dispatch,
+				 &seat->latency_event.kernel);
+	weston_latency_histogram_add(&seat->latency.kernel_to_dispatch, usec);
+	if (device)
+		weston_latency_histogram_add(&device->kernel_to_dispatch, usec);
+}
+
+void
+weston_seat_latency_sent(struct weston_seat *seat)
+{
+	struct weston_compositor *ec = seat->compositor;
+	struct latency_sample *sample;
+	struct wl_event_loop *loop;
+
+	if (!seat->latency_event.dispatched || seat->latency_event.sent)
+		return;
+
+	sample = wl_array_add(&seat->latency_pending, sizeof *sample);
+	if (!sample)
+		return;
+
+	sample->kernel = seat->latency_event.kernel;
+	sample->dispatch = seat->latency_event.dispatch;
+	sample->device = seat->latency_event.device;
+	seat->latency_event.sent = 1;
+
+	if (!ec->input_latency_flush_scheduled) {
+		loop = wl_display_get_event_loop(ec->wl_display);
+		wl_event_loop_add_idle(loop, input_latency_flush, ec);
+		ec->input_latency_flush_scheduled = 1;
+	}
+}
+
+/* Coalesced motion is delivered later, when the seat may already be
+ * processing another event.  The first deferred motion event is kept
+ * aside, and put back in place while the motion is finally sent, so
+ * that the samples include the time spent waiting for the flush. */
+void
+weston_seat_latency_defer(struct weston_seat *seat)
+{
+	if (!seat->latency_event.dispatched || seat->latency_deferred.valid)
+		return;
+
+	seat->latency_deferred = seat->latency_event;
+}
+
+void
+weston_seat_latency_begin_deferred(struct weston_seat *seat,
+				   struct weston_latency_event *saved)
+{
+	*saved = seat->latency_event;
+	seat->latency_event = seat->latency_deferred;
+	seat->latency_deferred.valid = 0;
+}
+
+void
+weston_seat_latency_end_deferred(struct weston_seat *seat,
+				 const struct weston_latency_event *saved)
+{
+	seat->latency_event = *saved;
+}
+
+WL_EXPORT void
+weston_seat_add_input_latency(struct weston_seat *seat,
+			      struct weston_input_latency *latency,
+			      const char *name)
+{
+	latency->name = strdup(name);
+	wl_list_insert(seat->latency_device_list.prev, &latency->link);
+}
+
+WL_EXPORT void
+weston_seat_remove_input_latency(struct weston_seat *seat,
+				 struct weston_input_latency *latency)
+{
+	struct latency_sample *sample;
+
+	wl_array_for_each(sample, &seat->latency_pending)
+		if (sample->device == latency)
+			sample->device = NULL;
+	if (seat->latency_event.device == latency)
+		seat->latency_event.device = NULL;
+	if (seat->latency_deferred.device == latency)
+		seat->latency_deferred.device = NULL;
+
+	wl_list_remove(&latency->link);
+	free(latency->name);
+	latency->name = NULL;
+}
+
+static void
+input_latency_log(struct weston_input_latency *latency)
+{
+	char name[128];
+
+	snprintf(name, sizeof name, "%s: kernel-to-dispatch", latency->name);
+	weston_latency_histogram_log(&latency->kernel_to_dispatch, name);
+	snprintf(name, sizeof name, "%s: dispatch-to-flush", latency->name);
+	weston_latency_histogram_log(&latency->dispatch_to_flush, name);
+	snprintf(name, sizeof name, "%s: kernel-to-flush", latency->name);
+	weston_latency_histogram_log(&latency->kernel_to_flush, name);
+}
+
+static void
+input_latency_binding(struct weston_seat *seat, uint32_t time, uint32_t key,
+		      void *data)
+{
+	struct weston_compositor *ec = data;
+	struct weston_input_latency *device;
+	struct weston_seat *s;
+
+	wl_list_for_each(s, &ec->seat_list, link) {
+		if (s->latency.kernel_to_dispatch.count == 0) {
+			weston_log("seat %s: no timestamped input yet\n",
+				   s->seat_name);
+			continue;
+		}
+
+		input_latency_log(&s->latency);
+		wl_list_for_each(device, &s->latency_device_list, link)
+			input_latency_log(device);
+	}
+}
+
+void
+weston_seat_init_latency(struct weston_seat *seat)
+{
+	seat->latency.name = seat->seat_name;
+	wl_list_init(&seat->latency_device_list);
+	wl_array_init(&seat->latency_pending);
+}
+
+void
+weston_seat_release_latency(struct weston_seat *seat)
+{
+	wl_array_release(&seat->latency_pending);
+}
+
+void
+weston_compositor_init_latency(struct weston_compositor *ec)
+{
+	weston_compositor_add_debug_binding(ec, KEY_I,
+					    input_latency_binding, ec);
+}
@@ -29,6 +29,11 @@
 #include <assert.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
 #include "../shared/os-compatibility.h"
 #include "compositor.h"
@@ -124,6 +129,7 @@ default_grab_pointer_motion(struct weston_pointer_grab *grab, uint32_t time)
 					      pointer->x, pointer->y,
 					      &sx, &sy);
 		wl_pointer_send_motion(resource, time, sx, sy);
+		weston_seat_latency_sent(pointer->seat);
 	}
 }
 
@@ -150,6 +156,8 @@ default_grab_pointer_button(struct weston_pointer_grab *grab,
 					       time,
 					       button,
 					       state_w);
+
+		weston_seat_latency_sent(pointer->seat);
 	}
 
 	if (pointer->button_count == 0 &&
@@ -262,6 +270,8 @@ default_grab_keyboard_key(struct weston_keyboard_grab *grab,
 					     time,
 					     key,
 					     state);
+
+		weston_seat_latency_sent(keyboard->seat);
 	}
 }
 
@@ -738,6 +748,84 @@ move_pointer(struct weston_seat *seat, wl_fixed_t x, wl_fixed_t y)
 	}
 }
 
+/*
+ * Motion coalescing.  High rate mice report relative motion up to a
+ * thousand times a second, and delivering every event means a repick
+ * and a client wakeup each time.  With [core] coalesce-motion=true the
+ * pointer position and cursor still follow every event, but the grab
+ * is only told about the motion once per frame: at the start of the
+ * next output repaint, before any button, axis or key event from the
+ * same seat, or after one frame period at most if nothing repaints.
+ */
+static void
+weston_pointer_flush_motion(struct weston_pointer *pointer)
+{
+	struct weston_latency_event saved;
+
+	if (!pointer->motion_pending)
+		return;
+
+	pointer->motion_pending = 0;
+	weston_seat_latency_begin_deferred(pointer->seat, &saved);
+	pointer->grab->interface->focus(pointer->grab);
+	pointer->grab->interface->motion(pointer->grab, pointer->motion_time);
+	weston_seat_latency_end_deferred(pointer->seat, &saved);
+}
+
+WL_EXPORT void
+weston_compositor_flush_motion(struct weston_compositor *ec)
+{
+	struct weston_seat *seat;
+
+	if (!ec->motion_flush_armed)
+		return;
+
+	wl_list_for_each(seat, &ec->seat_list, link)
+		if (seat->pointer)
+			weston_pointer_flush_motion(seat->pointer);
+
+	ec->motion_flush_armed = 0;
+	wl_event_source_timer_update(ec->motion_flush_source, 0);
+}
+
+static int
+motion_flush_handler(void *data)
+{
+	weston_compositor_flush_motion(data);
+
+	return 1;
+}
+
+static int
+schedule_motion_flush(struct weston_compositor *ec)
+{
+	struct weston_output *output;
+	struct wl_event_loop *loop;
+	int32_t refresh = 60000;
+
+	if (ec->motion_flush_armed)
+		return 0;
+
+	if (!ec->motion_flush_source) {
+		loop = wl_display_get_event_loop(ec->wl_display);
+		ec->motion_flush_source =
+			wl_event_loop_add_timer(loop, motion_flush_handler, ec);
+		if (!ec->motion_flush_source)
+			return -1;
+	}
+
+	wl_list_for_each(output, &ec->output_list, link)
+		if (output->current_mode &&
+		    output->current_mode->refresh > refresh)
+			refresh = output->current_mode->refresh;
+
+	ec->motion_flush_armed = 1;
+	wl_event_source_timer_update(ec->motion_flush_source,
+				     MAX(1000000 / refresh, 1));
+
+	return 0;
+}
+
 WL_EXPORT void
 notify_motion(struct weston_seat *seat,
 	      uint32_t time, wl_fixed_t dx, wl_fixed_t dy)
@@ -745,10 +833,24 @@ notify_motion(struct weston_seat *seat,
 	struct weston_compositor *ec = seat->compositor;
 	struct weston_pointer *pointer = seat->pointer;
 
+	weston_seat_latency_dispatch(seat);
 	weston_compositor_wake(ec);
 
 	move_pointer(seat, pointer->x + dx, pointer->y + dy);
 
+	if (ec->coalesce_motion) {
+		ec->motion_events++;
+		if (pointer->motion_pending)
+			ec->motion_events_coalesced++;
+		pointer->motion_pending = 1;
+		pointer->motion_time = time;
+		if (schedule_motion_flush(ec) == 0) {
+			weston_seat_latency_defer(seat);
+			return;
+		}
+		pointer->motion_pending = 0;
+	}
+
 	pointer->grab->interface->focus(pointer->grab);
 	pointer->grab->interface->motion(pointer->grab, time);
 }
@@ -760,6 +862,8 @@ notify_motion_absolute(struct weston_seat *seat,
 	struct weston_compositor *ec = seat->compositor;
 	struct weston_pointer *pointer = seat->pointer;
 
+	weston_pointer_flush_motion(pointer);
+	weston_seat_latency_dispatch(seat);
 	weston_compositor_wake(ec);
 
 	move_pointer(seat, x, y);
@@ -788,10 +892,13 @@ notify_button(struct weston_seat *seat, uint32_t time, int32_t button,
 {
 	struct weston_compositor *compositor = seat->compositor;
 	struct weston_pointer *pointer = seat->pointer;
-	struct weston_surface *focus =
-		(struct weston_surface *) pointer->focus;
+	struct weston_surface *focus;
 	uint32_t serial = wl_display_next_serial(compositor->wl_display);
 
+	weston_pointer_flush_motion(pointer);
+	weston_seat_latency_dispatch(seat);
+	focus = (struct weston_surface *) pointer->focus;
+
 	if (state == WL_POINTER_BUTTON_STATE_PRESSED) {
 		if (compositor->ping_handler && focus)
 			compositor->ping_handler(focus, serial);
@@ -824,12 +931,15 @@ notify_axis(struct weston_seat *seat, uint32_t time, uint32_t axis,
 {
 	struct weston_compositor *compositor = seat->compositor;
 	struct weston_pointer *pointer = seat->pointer;
-	struct weston_surface *focus =
-		(struct weston_surface *) pointer->focus;
+	struct weston_surface *focus;
 	uint32_t serial = wl_display_next_serial(compositor->wl_display);
 	struct wl_resource *resource;
 	struct wl_list *resource_list;
 
+	weston_pointer_flush_motion(pointer);
+	weston_seat_latency_dispatch(seat);
+	focus = (struct weston_surface *) pointer->focus;
+
 	if (compositor->ping_handler && focus)
 		compositor->ping_handler(focus, serial);
 
@@ -843,9 +953,11 @@ notify_axis(struct weston_seat *seat, uint32_t time, uint32_t axis,
 		return;
 
 	resource_list = &pointer->focus_resource_list;
-	wl_resource_for_each(resource, resource_list)
+	wl_resource_for_each(resource, resource_list) {
 		wl_pointer_send_axis(resource, time, axis,
 				     value);
+		weston_seat_latency_sent(seat);
+	}
 }
 
 #ifdef ENABLE_XKBCOMMON
@@ -959,7 +1071,8 @@ send_modifiers(struct wl_resource *resource, uint32_t serial, struct weston_keyb
 }
 
 static struct weston_xkb_info *
-weston_xkb_info_create(struct xkb_keymap *keymap);
+weston_xkb_info_create(struct weston_compositor *ec,
+		       struct xkb_keymap *keymap, const char *cached_str);
 static void
 weston_xkb_info_destroy(struct weston_xkb_info *xkb_info);
 
@@ -972,7 +1085,8 @@ update_keymap(struct weston_seat *seat)
 	xkb_mod_mask_t latched_mods;
 	xkb_mod_mask_t locked_mods;
 
-	xkb_info = weston_xkb_info_create(seat->pending_keymap);
+	xkb_info = weston_xkb_info_create(seat->compositor,
+					  seat->pending_keymap, NULL);
 
 	xkb_keymap_unref(seat->pending_keymap);
 	seat->pending_keymap = NULL;
@@ -1048,6 +1162,10 @@ notify_key(struct weston_seat *seat, uint32_t time, uint32_t key,
 	uint32_t serial = wl_display_next_serial(compositor->wl_display);
 	uint32_t *k, *end;
 
+	if (seat->pointer)
+		weston_pointer_flush_motion(seat->pointer);
+	weston_seat_latency_dispatch(seat);
+
 	if (state == WL_KEYBOARD_KEY_STATE_PRESSED) {
 		if (compositor->ping_handler && focus)
 			compositor->ping_handler(focus, serial);
@@ -1591,6 +1709,7 @@ weston_compositor_xkb_init(struct weston_compositor *ec,
 	ec->use_xkbcommon = 1;
 
 	if (ec->xkb_context == NULL) {
+		wl_list_init(&ec->xkb_info_list);
 		ec->xkb_context = xkb_context_new(0);
 		if (ec->xkb_context == NULL) {
 			weston_log("failed to create XKB context\n");
@@ -1616,6 +1735,8 @@ weston_xkb_info_destroy(struct weston_xkb_info *xkb_info)
 	if (--xkb_info->ref_count > 0)
 		return;
 
+	wl_list_remove(&xkb_info->link);
+
 	if (xkb_info->keymap)
 		xkb_map_unref(xkb_info->keymap);
 
@@ -1647,17 +1768,74 @@ weston_compositor_xkb_destroy(struct weston_compositor *ec)
 	xkb_context_unref(ec->xkb_context);
 }
 
+static uint32_t
+keymap_hash(const char *str, size_t size)
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		hash = (hash ^ (unsigned char) str[i]) * 16777619u;
+
+	return hash;
+}
+
+static struct weston_xkb_info *
+weston_xkb_info_lookup(struct weston_compositor *ec,
+		       const char *keymap_str, size_t size, uint32_t hash)
+{
+	struct weston_xkb_info *xkb_info;
+
+	wl_list_for_each(xkb_info, &ec->xkb_info_list, link) {
+		if (xkb_info->keymap_hash == hash &&
+		    xkb_info->keymap_size == size &&
+		    memcmp(xkb_info->keymap_area, keymap_str, size) == 0)
+			return xkb_info;
+	}
+
+	return NULL;
+}
+
+/* Keymaps are shared: seats and devices whose keymaps serialise to the
+ * same text get the same weston_xkb_info, and thus send the same
+ * sealed, read-only file to every client.  cached_str, when given, is
+ * the keymap already serialised (e.g. from the keymap cache) and saves
+ * serialising it again. */
 static struct weston_xkb_info *
-weston_xkb_info_create(struct xkb_keymap *keymap)
+weston_xkb_info_create(struct weston_compositor *ec,
+		       struct xkb_keymap *keymap, const char *cached_str)
 {
-	struct weston_xkb_info *xkb_info = zalloc(sizeof *xkb_info);
+	struct weston_xkb_info *xkb_info;
+	char *keymap_str = NULL;
+	size_t size;
+	uint32_t hash;
+
+	if (cached_str == NULL) {
+		keymap_str = xkb_map_get_as_string(keymap);
+		if (keymap_str == NULL) {
+			weston_log("failed to get string version of keymap\n");
+			return NULL;
+		}
+		cached_str = keymap_str;
+	}
+	size = strlen(cached_str) + 1;
+	hash = keymap_hash(cached_str, size);
+
+	xkb_info = weston_xkb_info_lookup(ec, cached_str, size, hash);
+	if (xkb_info) {
+		xkb_info->ref_count++;
+		free(keymap_str);
+		return xkb_info;
+	}
+
+	xkb_info = zalloc(sizeof *xkb_info);
 	if (xkb_info == NULL)
-		return NULL;
+		goto err_keymap_str;
 
 	xkb_info->keymap = xkb_map_ref(keymap);
 	xkb_info->ref_count = 1;
-
-	char *keymap_str;
+	xkb_info->keymap_hash = hash;
+	xkb_info->keymap_size = size;
 
 	xkb_info->shift_mod = xkb_map_mod_get_index(xkb_info->keymap,
 						    XKB_MOD_NAME_SHIFT);
@@ -1680,51 +1858,338 @@ weston_xkb_info_create(struct xkb_keymap *keymap)
 	xkb_info->scroll_led = xkb_map_led_get_index(xkb_info->keymap,
 						     XKB_LED_NAME_SCROLL);
 
-	keymap_str = xkb_map_get_as_string(xkb_info->keymap);
-	if (keymap_str == NULL) {
-		weston_log("failed to get string version of keymap\n");
-		goto err_keymap;
-	}
-	xkb_info->keymap_size = strlen(keymap_str) + 1;
-
-	xkb_info->keymap_fd = os_create_anonymous_file(xkb_info->keymap_size);
+	xkb_info->keymap_fd = os_create_sealed_file(cached_str, size);
 	if (xkb_info->keymap_fd < 0) {
 		weston_log("creating a keymap file for %lu bytes failed: %m\n",
 			(unsigned long) xkb_info->keymap_size);
-		goto err_keymap_str;
+		goto err_keymap;
 	}
 
 	xkb_info->keymap_area = mmap(NULL, xkb_info->keymap_size,
-				     PROT_READ | PROT_WRITE,
-				     MAP_SHARED, xkb_info->keymap_fd, 0);
+				     PROT_READ, MAP_SHARED,
+				     xkb_info->keymap_fd, 0);
 	if (xkb_info->keymap_area == MAP_FAILED) {
 		weston_log("failed to mmap() %lu bytes\n",
 			(unsigned long) xkb_info->keymap_size);
 		goto err_dev_zero;
 	}
-	strcpy(xkb_info->keymap_area, keymap_str);
 	free(keymap_str);
 
+	wl_list_insert(&ec->xkb_info_list, &xkb_info->link);
+
 	return xkb_info;
 
 err_dev_zero:
 	close(xkb_info->keymap_fd);
-err_keymap_str:
-	free(keymap_str);
 err_keymap:
 	xkb_map_unref(xkb_info->keymap);
 	free(xkb_info);
+err_keymap_str:
+	free(keymap_str);
 	return NULL;
 }
 
+/*
+ * Compiled keymap cache.  Compiling a keymap from RMLVO names means
+ * resolving and parsing a good part of xkeyboard-config, which is a
+ * noticeable share of startup on slow machines.  The serialised result
+ * is stored in $XDG_CACHE_HOME/weston, keyed by the RMLVO names, the
+ * xkeyboard-config version and a stamp of the xkb data files, and on the
+ * next start the keymap is parsed straight from the mmap()ed cache file.
+ */
+#define KEYMAP_CACHE_MAGIC "weston-keymap-cache 1\n"
+
+#ifndef XKEYBOARD_CONFIG_VERSION
+#define XKEYBOARD_CONFIG_VERSION "unknown"
+#endif
+
+/* The newest mtime and the number of files among the xkb data a keymap
+ * can include.  Which files that is is only known after compiling, so
+ * every rules, keycodes, types, compat and symbols file in every include
+ * path counts; stat()ing them is still far cheaper than a compile. */
+struct keymap_cache_stamp {
+	struct timespec newest;
+	unsigned int files;
+};
+
+static void
+keymap_cache_stamp_dir(struct keymap_cache_stamp *stamp, const char *dir,
+		       int depth)
+{
+	struct dirent *ent;
+	struct stat st;
+	char *path;
+	DIR *d;
+
+	d = opendir(dir);
+	if (!d)
+		return;
+
+	while ((ent = readdir(d)) != NULL) {
+		if (ent->d_name[0] == '.')
+			continue;
+		if (asprintf(&path, "%s/%s", dir, ent->d_name) < 0)
+			continue;
+
+		if (stat(path, &st) == 0) {
+			if (S_ISDIR(st.st_mode)) {
+				if (depth > 0)
+					keymap_cache_stamp_dir(stamp, path,
+							       depth - 1);
+			} else {
+				stamp->files++;
+				if (st.st_mtim.tv_sec > stamp->newest.tv_sec ||
+				    (st.st_mtim.tv_sec == stamp->newest.tv_sec &&
+				     st.st_mtim.tv_nsec > stamp->newest.tv_nsec))
+					stamp->newest = st.st_mtim;
+			}
+		}
+		free(path);
+	}
+
+	closedir(d);
+}
+
+static char *
+keymap_cache_key(struct weston_compositor *ec)
+{
+	static const char *components[] = {
+		"rules", "keycodes", "types", "compat", "symbols"
+	};
+	struct xkb_rule_names *names = &ec->xkb_names;
+	struct keymap_cache_stamp stamp;
+	char *path, *key;
+	unsigned int i, j;
+	int ret;
+
+	memset(&stamp, 0, sizeof stamp);
+	for (i = 0; i < xkb_context_num_include_paths(ec->xkb_context); i++) {
+		for (j = 0; j < ARRAY_LENGTH(components); j++) {
+			ret = asprintf(&path, "%s/%s",
+				       xkb_context_include_path_get(ec->xkb_context, i),
+				       components[j]);
+			if (ret < 0)
+				return NULL;
+			keymap_cache_stamp_dir(&stamp, path, 2);
+			free(path);
+		}
+	}
+
+	ret = asprintf(&key, "rules=%s model=%s layout=%s variant=%s "
+		       "options=%s xkeyboard-config=%s files=%u "
+		       "mtime=%ld.%09ld\n",
+		       names->rules, names->model, names->layout,
+		       names->variant ? names->variant : "",
+		       names->options ? names->options : "",
+		       XKEYBOARD_CONFIG_VERSION, stamp.files,
+		       (long) stamp.newest.tv_sec, (long) stamp.newest.tv_nsec);
+	if (ret < 0)
+		return NULL;
+
+	return key;
+}
+
+static char *
+keymap_cache_path(const char *key)
+{
+	const char *dir, *home;
+	uint64_t hash = 14695981039346656037ull;
+	char *path;
+	int ret;
+
+	for (; *key; key++)
+		hash = (hash ^ (unsigned char) *key) * 1099511628211ull;
+
+	dir = getenv("XDG_CACHE_HOME");
+	home = getenv("HOME");
+	if (dir && dir[0] == '/')
+		ret = asprintf(&path, "%s/weston/keymap-%016llx",
+			       dir, (unsigned long long) hash);
+	else if (home)
+		ret = asprintf(&path, "%s/.cache/weston/keymap-%016llx",
+			       home, (unsigned long long) hash);
+	else
+		return NULL;
+
+	if (ret < 0)
+		return NULL;
+
+	return path;
+}
+
+struct keymap_cache_map {
+	void *area;
+	size_t size;
+	const char *keymap_str;
+};
+
 static int
-weston_compositor_build_global_keymap(struct weston_compositor *ec)
+keymap_cache_open(const char *path, const char *key,
+		  struct keymap_cache_map *map)
+{
+	size_t header = strlen(KEYMAP_CACHE_MAGIC) + strlen(key);
+	struct stat st;
+	char *area;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st) < 0 || (size_t) st.st_size <= header) {
+		close(fd);
+		return -1;
+	}
+
+	area = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (area == MAP_FAILED)
+		return -1;
+
+	if (memcmp(area, KEYMAP_CACHE_MAGIC, strlen(KEYMAP_CACHE_MAGIC)) ||
+	    memcmp(area + strlen(KEYMAP_CACHE_MAGIC), key, strlen(key)) ||
+	    area[st.st_size - 1] != '\0') {
+		munmap(area, st.st_size);
+		return -1;
+	}
+
+	map->area = area;
+	map->size = st.st_size;
+	map->keymap_str = area + header;
+
+	return 0;
+}
+
+static void
+keymap_cache_mkdir(const char *path)
+{
+	char *dir, *p;
+
+	dir = strdup(path);
+	if (!dir)
+		return;
+
+	/* Create the last two components, i.e. .cache and weston. */
+	p = strrchr(dir, '/');
+	if (p) {
+		*p = '\0';
+		p = strrchr(dir, '/');
+		if (p) {
+			*p = '\0';
+			mkdir(dir, 0700);
+			*p = '/';
+		}
+		mkdir(dir, 0700);
+	}
+	free(dir);
+}
+
+static void
+keymap_cache_store(const char *path, const char *key, const char *keymap_str)
+{
+	FILE *fp;
+	char *tmp;
+	int fd;
+
+	keymap_cache_mkdir(path);
+
+	if (asprintf(&tmp, "%s.XXXXXX", path) < 0)
+		return;
+
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		weston_log("keymap cache: failed to create %s: %m\n", tmp);
+		free(tmp);
+		return;
+	}
+
+	fp = fdopen(fd, "w");
+	if (!fp) {
+		close(fd);
+		unlink(tmp);
+		free(tmp);
+		return;
+	}
+
+	fputs(KEYMAP_CACHE_MAGIC, fp);
+	fputs(key, fp);
+	fwrite(keymap_str, 1, strlen(keymap_str) + 1, fp);
+
+	if (fclose(fp) != 0 || rename(tmp, path) < 0) {
+		weston_log("keymap cache: failed to write %s: %m\n", path);
+		unlink(tmp);
+	}
+	free(tmp);
+}
+
+static uint32_t
+keymap_elapsed_usec(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1000000 +
+		(now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+static struct xkb_keymap *
+keymap_cache_lookup(struct weston_compositor *ec, const char *path,
+		    const char *key, struct keymap_cache_map *map)
 {
 	struct xkb_keymap *keymap;
 
+	if (keymap_cache_open(path, key, map) < 0)
+		return NULL;
+
+	keymap = xkb_keymap_new_from_string(ec->xkb_context, map->keymap_str,
+					    XKB_KEYMAP_FORMAT_TEXT_V1, 0);
+	if (keymap == NULL) {
+		weston_log("keymap cache: %s is unusable, recompiling\n",
+			   path);
+		munmap(map->area, map->size);
+		unlink(path);
+	}
+
+	return keymap;
+}
+
+static int
+weston_compositor_build_global_keymap(struct weston_compositor *ec)
+{
+	struct xkb_keymap *keymap = NULL;
+	struct keymap_cache_map map = { NULL, 0, NULL };
+	struct timespec start;
+	char *key = NULL, *path = NULL, *keymap_str;
+
 	if (ec->xkb_info != NULL)
 		return 0;
 
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (ec->use_keymap_cache) {
+		key = keymap_cache_key(ec);
+		if (key)
+			path = keymap_cache_path(key);
+		if (path)
+			keymap = keymap_cache_lookup(ec, path, key, &map);
+	}
+
+	if (keymap) {
+		ec->xkb_info = weston_xkb_info_create(ec, keymap,
+						      map.keymap_str);
+		munmap(map.area, map.size);
+		xkb_map_unref(keymap);
+		free(key);
+		free(path);
+		if (ec->xkb_info == NULL)
+			return -1;
+
+		weston_log("loaded XKB keymap from cache in %u us\n",
+			   keymap_elapsed_usec(&start));
+		return 0;
+	}
+
 	keymap = xkb_map_new_from_names(ec->xkb_context,
 					&ec->xkb_names,
 					0);
@@ -1735,10 +2200,22 @@ weston_compositor_build_global_keymap(struct weston_compositor *ec)
 			ec->xkb_names.rules, ec->xkb_names.model,
 			ec->xkb_names.layout, ec->xkb_names.variant,
 			ec->xkb_names.options);
+		free(key);
+		free(path);
 		return -1;
 	}
 
-	ec->xkb_info = weston_xkb_info_create(keymap);
+	keymap_str = xkb_map_get_as_string(keymap);
+	weston_log("compiled XKB keymap in %u us\n",
+		   keymap_elapsed_usec(&start));
+
+	if (keymap_str && path)
+		keymap_cache_store(path, key, keymap_str);
+	free(key);
+	free(path);
+
+	ec->xkb_info = weston_xkb_info_create(ec, keymap, keymap_str);
+	free(keymap_str);
 	if (ec->xkb_info == NULL)
 		return -1;
 
@@ -1793,7 +2270,8 @@ weston_seat_init_keyboard(struct weston_seat *seat, struct xkb_keymap *keymap)
 #ifdef ENABLE_XKBCOMMON
 	if (seat->compositor->use_xkbcommon) {
 		if (keymap != NULL) {
-			seat->xkb_info = weston_xkb_info_create(keymap);
+			seat->xkb_info = weston_xkb_info_create(seat->compositor,
+								keymap, NULL);
 			if (seat->xkb_info == NULL)
 				return -1;
 		} else {
@@ -1873,6 +2351,7 @@ weston_seat_release_pointer(struct weston_seat *seat)
 					 wl_fixed_from_int(0),
 					 wl_fixed_from_int(0));
 		weston_pointer_cancel_grab(pointer);
+		pointer->motion_pending = 0;
 
 		if (pointer->sprite)
 			pointer_unmap_sprite(pointer);
@@ -1934,6 +2413,7 @@ weston_seat_init(struct weston_seat *seat, struct weston_compositor *ec,
 	seat->modifier_state = 0;
 	seat->num_tp = 0;
 	seat->seat_name = strdup(seat_name);
+	weston_seat_init_latency(seat);
 
 	wl_list_insert(ec->seat_list.prev, &seat->link);
 
@@ -1967,6 +2447,7 @@ weston_seat_release(struct weston_seat *seat)
 	if (seat->touch)
 		weston_touch_destroy(seat->touch);
 
+	weston_seat_release_latency(seat);
 	free (seat->seat_name);
 
 	wl_global_destroy(seat->global);
@@ -24,8 +24,13 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
 #include <sys/time.h>
 #include <time.h>
 
@@ -35,32 +40,317 @@
 
 static FILE *weston_logfile = NULL;
 
-static int cached_tm_mday = -1;
+/* Per thread: once weston_log_set_synchronous() runs, the writer thread
+ * and the thread that crashed may both be formatting timestamps. */
+static __thread int cached_tm_mday = -1;
+static __thread time_t cached_sec = -1;
+static __thread char cached_stamp[16];
+
+/* Asynchronous mode: producers format each message into a slot of a
+ * bounded lock-free ring (Vyukov style, so the occasional helper thread
+ * that logs does not corrupt it) and a writer thread drains the ring to
+ * the log file.  Nothing on the producer side ever blocks on I/O; when
+ * the ring is full the message is dropped and counted. */
+#define LOG_RING_SIZE		1024
+#define LOG_SLOT_TEXT		256
+#define LOG_RATE_BURST		20
+#define LOG_RATE_ENTRIES	64
+
+struct log_slot {
+	unsigned long seq;
+	struct timeval tv;
+	const char *fmt;
+	int continuation;
+	char *heap;
+	char text[LOG_SLOT_TEXT];
+};
+
+struct log_rate {
+	const char *fmt;
+	time_t window;
+	unsigned int count;
+	unsigned int suppressed;
+};
+
+static struct {
+	int running;
+	int enqueuers;
+	int quit;
+	int sleeping;
+	int efd;
+	pthread_t thread;
+	unsigned long enqueue_pos;
+	unsigned long dequeue_pos;
+	unsigned int dropped;
+	int suppressing;
+	struct log_rate rate[LOG_RATE_ENTRIES];
+	struct log_slot *slots;
+} log_async;
+
+static __thread int log_async_head_dropped;
+
+static int
+weston_log_format_timestamp(const struct timeval *tv)
+{
+	struct tm brokendown_time;
+	char string[128];
+
+	if (tv->tv_sec != cached_sec) {
+		localtime_r(&tv->tv_sec, &brokendown_time);
+		if (brokendown_time.tm_mday != cached_tm_mday) {
+			strftime(string, sizeof string, "%Y-%m-%d %Z",
+				 &brokendown_time);
+			fprintf(weston_logfile, "Date: %s\n", string);
+
+			cached_tm_mday = brokendown_time.tm_mday;
+		}
+
+		strftime(cached_stamp, sizeof cached_stamp, "%H:%M:%S",
+			 &brokendown_time);
+		cached_sec = tv->tv_sec;
+	}
+
+	return fprintf(weston_logfile, "[%s.%03li] ",
+		       cached_stamp, (long) tv->tv_usec / 1000);
+}
 
 static int weston_log_timestamp(void)
 {
 	struct timeval tv;
-	struct tm *brokendown_time;
-	char string[128];
 
 	gettimeofday(&tv, NULL);
 
-	brokendown_time = localtime(&tv.tv_sec);
-	if (brokendown_time->tm_mday != cached_tm_mday) {
-		strftime(string, sizeof string, "%Y-%m-%d %Z", brokendown_time);
-		fprintf(weston_logfile, "Date: %s\n", string);
+	return weston_log_format_timestamp(&tv);
+}
+
+static void
+log_async_wake(void)
+{
+	uint64_t one = 1;
+
+	/* Writing to an eventfd only fails when the counter would overflow,
+	 * and then the writer already has a wakeup pending. */
+	if (write(log_async.efd, &one, sizeof one) != sizeof one)
+		return;
+}
+
+static int
+log_async_enqueue(int continuation, const char *prefix,
+		  const char *fmt, va_list ap)
+{
+	struct log_slot *slot;
+	unsigned long pos, seq;
+	long diff;
+	va_list aq;
+	int len, plen = 0;
+
+	if (continuation && log_async_head_dropped)
+		return 0;
+
+	pos = __atomic_load_n(&log_async.enqueue_pos, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = &log_async.slots[pos & (LOG_RING_SIZE - 1)];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		diff = (long) (seq - pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&log_async.enqueue_pos,
+							&pos, pos + 1, 1,
+							__ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			__atomic_add_fetch(&log_async.dropped, 1,
+					   __ATOMIC_RELAXED);
+			log_async_head_dropped = !continuation;
+			return 0;
+		} else {
+			pos = __atomic_load_n(&log_async.enqueue_pos,
+					      __ATOMIC_RELAXED);
+		}
+	}
+
+	if (!continuation) {
+		gettimeofday(&slot->tv, NULL);
+		log_async_head_dropped = 0;
+	}
+	slot->fmt = fmt;
+	slot->continuation = continuation;
+	slot->heap = NULL;
+
+	if (prefix)
+		plen = snprintf(slot->text, sizeof slot->text, "%s", prefix);
+
+	va_copy(aq, ap);
+	len = vsnprintf(slot->text + plen, sizeof slot->text - plen, fmt, aq);
+	va_end(aq);
+
+	/* Rare long messages (keymaps, capability dumps) spill to the
+	 * heap; if that fails the truncated copy in the slot is used. */
+	if (len >= 0 && plen + len >= (int) sizeof slot->text) {
+		slot->heap = malloc(plen + len + 1);
+		if (slot->heap) {
+			memcpy(slot->heap, slot->text, plen);
+			vsnprintf(slot->heap + plen, len + 1, fmt, ap);
+		}
+	}
+
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	if (__atomic_exchange_n(&log_async.sleeping, 0, __ATOMIC_SEQ_CST))
+		log_async_wake();
+
+	return len < 0 ? len : plen + len;
+}
+
+static struct log_rate *
+log_rate_lookup(const char *fmt)
+{
+	unsigned int h = ((uintptr_t) fmt >> 3) % LOG_RATE_ENTRIES;
+
+	return &log_async.rate[h];
+}
+
+static void
+log_rate_flush(struct log_rate *r)
+{
+	if (r->suppressed == 0)
+		return;
+
+	weston_log_timestamp();
+	fprintf(weston_logfile,
+		"weston_log: suppressed %u repeats of \"%.*s\"\n",
+		r->suppressed, (int) strcspn(r->fmt, "\n"), r->fmt);
+	r->suppressed = 0;
+}
+
+/* Decides, on the writer thread, whether a message may be written.
+ * Each format string may be logged LOG_RATE_BURST times per second;
+ * the excess is counted and summarised when the window rolls over. */
+static int
+log_rate_allow(const struct log_slot *slot)
+{
+	struct log_rate *r;
+
+	if (slot->continuation)
+		return !log_async.suppressing;
+
+	r = log_rate_lookup(slot->fmt);
+	if (r->fmt != slot->fmt || r->window != slot->tv.tv_sec) {
+		if (r->fmt)
+			log_rate_flush(r);
+		r->fmt = slot->fmt;
+		r->window = slot->tv.tv_sec;
+		r->count = 0;
+	}
+
+	log_async.suppressing = ++r->count > LOG_RATE_BURST;
+	if (log_async.suppressing)
+		r->suppressed++;
+
+	return !log_async.suppressing;
+}
+
+static int
+log_async_drain(void)
+{
+	struct log_slot *slot;
+	unsigned long pos;
+	unsigned int dropped;
+	int n = 0;
+
+	for (;;) {
+		pos = log_async.dequeue_pos;
+		slot = &log_async.slots[pos & (LOG_RING_SIZE - 1)];
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1)
+			break;
+
+		if (log_rate_allow(slot)) {
+			if (!slot->continuation)
+				weston_log_format_timestamp(&slot->tv);
+			fputs(slot->heap ? slot->heap : slot->text,
+			      weston_logfile);
+		}
+		free(slot->heap);
+
+		__atomic_store_n(&slot->seq, pos + LOG_RING_SIZE,
+				 __ATOMIC_RELEASE);
+		log_async.dequeue_pos = pos + 1;
+		n++;
+	}
+
+	dropped = __atomic_exchange_n(&log_async.dropped, 0, __ATOMIC_RELAXED);
+	if (dropped) {
+		weston_log_timestamp();
+		fprintf(weston_logfile,
+			"weston_log: dropped %u messages, log buffer full\n",
+			dropped);
+	}
+
+	if (n > 0 || dropped)
+		fflush(weston_logfile);
+
+	return n;
+}
+
+static void *
+log_async_thread(void *data)
+{
+	uint64_t count;
+	int i;
+
+	for (;;) {
+		log_async_drain();
 
-		cached_tm_mday = brokendown_time->tm_mday;
+		__atomic_store_n(&log_async.sleeping, 1, __ATOMIC_SEQ_CST);
+		if (log_async_drain() > 0) {
+			__atomic_store_n(&log_async.sleeping, 0,
+					 __ATOMIC_SEQ_CST);
+			continue;
+		}
+		if (__atomic_load_n(&log_async.quit, __ATOMIC_ACQUIRE))
+			break;
+
+		if (read(log_async.efd, &count, sizeof count) < 0)
+			break;
 	}
 
-	strftime(string, sizeof string, "%H:%M:%S", brokendown_time);
+	for (i = 0; i < LOG_RATE_ENTRIES; i++)
+		if (log_async.rate[i].fmt)
+			log_rate_flush(&log_async.rate[i]);
+	fflush(weston_logfile);
+
+	return NULL;
+}
+
+/* Enqueuers register before they look at running, so that
+ * log_async_stop() can wait for the ones that still saw the writer
+ * running to publish their message. */
+static int
+log_async_enter(void)
+{
+	__atomic_add_fetch(&log_async.enqueuers, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&log_async.running, __ATOMIC_SEQ_CST))
+		return 1;
+
+	__atomic_sub_fetch(&log_async.enqueuers, 1, __ATOMIC_RELEASE);
+	return 0;
+}
 
-	return fprintf(weston_logfile, "[%s.%03li] ", string, tv.tv_usec/1000);
+static void
+log_async_leave(void)
+{
+	__atomic_sub_fetch(&log_async.enqueuers, 1, __ATOMIC_RELEASE);
 }
 
 static void
 custom_handler(const char *fmt, va_list arg)
 {
+	if (log_async_enter()) {
+		log_async_enqueue(0, "libwayland: ", fmt, arg);
+		log_async_leave();
+		return;
+	}
+
 	weston_log_timestamp();
 	fprintf(weston_logfile, "libwayland: ");
 	vfprintf(weston_logfile, fmt, arg);
@@ -80,9 +370,84 @@ weston_log_file_open(const char *filename)
 		setvbuf(weston_logfile, NULL, _IOLBF, 256);
 }
 
+int
+weston_log_async_start(void)
+{
+	unsigned long i;
+
+	if (log_async.running)
+		return 0;
+
+	log_async.slots = calloc(LOG_RING_SIZE, sizeof *log_async.slots);
+	if (!log_async.slots)
+		return -1;
+	for (i = 0; i < LOG_RING_SIZE; i++)
+		log_async.slots[i].seq = i;
+
+	log_async.efd = eventfd(0, EFD_CLOEXEC);
+	if (log_async.efd < 0)
+		goto err_slots;
+
+	log_async.enqueue_pos = 0;
+	log_async.dequeue_pos = 0;
+	log_async.quit = 0;
+	log_async.sleeping = 0;
+
+	/* The writer flushes once per drained batch instead of per line. */
+	if (weston_logfile != stderr)
+		setvbuf(weston_logfile, NULL, _IOFBF, BUFSIZ);
+
+	if (pthread_create(&log_async.thread, NULL, log_async_thread, NULL))
+		goto err_efd;
+
+	__atomic_store_n(&log_async.running, 1, __ATOMIC_RELEASE);
+
+	return 0;
+
+err_efd:
+	close(log_async.efd);
+err_slots:
+	free(log_async.slots);
+	log_async.slots = NULL;
+	return -1;
+}
+
+void
+weston_log_set_synchronous(void)
+{
+	/* Only flips the mode, so that it is usable from a signal
+	 * handler; whatever is queued is left to the writer thread. */
+	__atomic_store_n(&log_async.running, 0, __ATOMIC_RELEASE);
+}
+
+static void
+log_async_stop(void)
+{
+	if (!log_async.slots)
+		return;
+
+	/* Once no enqueuer is left, every claimed slot is published and
+	 * the writer drains them all before it exits. */
+	__atomic_store_n(&log_async.running, 0, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&log_async.enqueuers, __ATOMIC_ACQUIRE) > 0)
+		sched_yield();
+	__atomic_store_n(&log_async.quit, 1, __ATOMIC_RELEASE);
+	log_async_wake();
+	pthread_join(log_async.thread, NULL);
+
+	/* Only this thread touches the queue now. */
+	log_async_drain();
+
+	close(log_async.efd);
+	free(log_async.slots);
+	log_async.slots = NULL;
+}
+
 void
 weston_log_file_close()
 {
+	log_async_stop();
+
 	if ((weston_logfile != stderr) && (weston_logfile != NULL))
 		fclose(weston_logfile);
 	weston_logfile = stderr;
@@ -93,6 +458,12 @@ weston_vlog(const char *fmt, va_list ap)
 {
 	int l;
 
+	if (log_async_enter()) {
+		l = log_async_enqueue(0, NULL, fmt, ap);
+		log_async_leave();
+		return l;
+	}
+
 	l = weston_log_timestamp();
 	l += vfprintf(weston_logfile, fmt, ap);
 
@@ -115,6 +486,14 @@ weston_log(const char *fmt, ...)
 WL_EXPORT int
 weston_vlog_continue(const char *fmt, va_list argp)
 {
+	int l;
+
+	if (log_async_enter()) {
+		l = log_async_enqueue(1, NULL, fmt, argp);
+		log_async_leave();
+		return l;
+	}
+
 	return vfprintf(weston_logfile, fmt, argp);
 }
 
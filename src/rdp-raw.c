@@ -0,0 +1,213 @@
+/*
+ * Copyright © 2014 Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rdp-raw.h"
+
+#ifndef MIN
+#define MIN(x,y) (((x) < (y)) ? (x) : (y))
+#endif
+
+#ifndef MAX
+#define MAX(x,y) (((x) > (y)) ? (x) : (y))
+#endif
+
+/* size of a TS_SURFCMD_STREAM_SURF_BITS header */
+#define SURFACE_BITS_HEADER_SIZE 16
+
+/* Small rectangles are sent as their bounding box when that adds at most
+ * 1/MERGE_WASTE_RATIO more pixels, one command then carries them all. */
+#define MERGE_WASTE_RATIO 4
+
+void
+rdp_raw_encoder_init(struct rdp_raw_encoder *raw)
+{
+	raw->buffer = NULL;
+	raw->buffer_size = 0;
+}
+
+void
+rdp_raw_encoder_release(struct rdp_raw_encoder *raw)
+{
+	free(raw->buffer);
+	rdp_raw_encoder_init(raw);
+}
+
+static int
+rdp_raw_encoder_reserve(struct rdp_raw_encoder *raw, uint32_t size)
+{
+	BYTE *buffer;
+
+	if (size <= raw->buffer_size)
+		return 0;
+
+	buffer = realloc(raw->buffer, size);
+	if (!buffer)
+		return -1;
+
+	raw->buffer = buffer;
+	raw->buffer_size = size;
+	return 0;
+}
+
+/* Raw surface bits are bottom-up, hence one copy per row. */
+static void
+pixman_image_flipped_subrect(const pixman_box32_t *rect, pixman_image_t *img,
+			     BYTE *dest)
+{
+	int stride = pixman_image_get_stride(img);
+	int h;
+	int toCopy = (rect->x2 - rect->x1) * 4;
+	int height = (rect->y2 - rect->y1);
+	const BYTE *src = (const BYTE *)pixman_image_get_data(img);
+	src += ((rect->y2-1) * stride) + (rect->x1 * 4);
+
+	for (h = 0; h < height; h++, src -= stride, dest += toCopy)
+		memcpy(dest, src, toCopy);
+}
+
+static uint32_t
+box_area(const pixman_box32_t *box)
+{
+	return (box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+static int
+rdp_raw_encode_box(struct rdp_raw_encoder *raw, const pixman_box32_t *box,
+		   pixman_image_t *image, uint32_t max_request_size,
+		   SURFACE_BITS_COMMAND *cmd, rdp_raw_send_func_t send,
+		   void *data)
+{
+	pixman_box32_t subrect, strip;
+	int heightIncrement, remainingHeight, top, maxWidth, x;
+
+	/* a single row too wide for one request is cut into strips */
+	maxWidth = 1;
+	if (max_request_size > SURFACE_BITS_HEADER_SIZE + 4)
+		maxWidth = (max_request_size - SURFACE_BITS_HEADER_SIZE) / 4;
+	if (box->x2 - box->x1 > maxWidth) {
+		strip = *box;
+		for (x = box->x1; x < box->x2; x += maxWidth) {
+			strip.x1 = x;
+			strip.x2 = MIN(x + maxWidth, box->x2);
+			if (rdp_raw_encode_box(raw, &strip, image,
+					       max_request_size, cmd,
+					       send, data) < 0)
+				return -1;
+		}
+		return 0;
+	}
+
+	cmd->destLeft = box->x1;
+	cmd->destRight = box->x2;
+	cmd->width = box->x2 - box->x1;
+
+	heightIncrement = max_request_size /
+		(SURFACE_BITS_HEADER_SIZE + cmd->width * 4);
+	if (heightIncrement < 1)
+		heightIncrement = 1;
+	remainingHeight = box->y2 - box->y1;
+	top = box->y1;
+
+	if (rdp_raw_encoder_reserve(raw, cmd->width * 4 *
+			(remainingHeight > heightIncrement ?
+			 heightIncrement : remainingHeight)) < 0)
+		return -1;
+
+	subrect.x1 = box->x1;
+	subrect.x2 = box->x2;
+
+	while (remainingHeight) {
+		cmd->height = (remainingHeight > heightIncrement) ?
+			heightIncrement : remainingHeight;
+		cmd->destTop = top;
+		cmd->destBottom = top + cmd->height;
+		cmd->bitmapDataLength = cmd->width * cmd->height * 4;
+		cmd->bitmapData = raw->buffer;
+
+		subrect.y1 = top;
+		subrect.y2 = top + cmd->height;
+		pixman_image_flipped_subrect(&subrect, image, cmd->bitmapData);
+
+		send(cmd, data);
+
+		remainingHeight -= cmd->height;
+		top += cmd->height;
+	}
+
+	return 0;
+}
+
+/* Sends region of image as uncompressed 32 bpp surface bits, cut into
+ * commands that fit in max_request_size. Returns the number of rectangles
+ * sent after merging, or -1 on allocation failure. */
+int
+rdp_raw_encode(struct rdp_raw_encoder *raw, pixman_region32_t *region,
+	       pixman_image_t *image, uint32_t max_request_size,
+	       SURFACE_BITS_COMMAND *cmd, rdp_raw_send_func_t send,
+	       void *data)
+{
+	pixman_box32_t *rects, box, merged;
+	uint32_t area, merged_area, size;
+	int nrects, i, count = 0;
+
+	rects = pixman_region32_rectangles(region, &nrects);
+
+	cmd->bpp = 32;
+	cmd->codecID = 0;
+
+	i = 0;
+	while (i < nrects) {
+		box = rects[i++];
+		area = box_area(&box);
+
+		/* the rectangles come in y-x bands, neighbours are close */
+		while (i < nrects) {
+			merged.x1 = MIN(box.x1, rects[i].x1);
+			merged.y1 = MIN(box.y1, rects[i].y1);
+			merged.x2 = MAX(box.x2, rects[i].x2);
+			merged.y2 = MAX(box.y2, rects[i].y2);
+			merged_area = box_area(&merged);
+			size = SURFACE_BITS_HEADER_SIZE + merged_area * 4;
+
+			if (size > max_request_size ||
+			    merged_area * MERGE_WASTE_RATIO >
+			    (area + box_area(&rects[i])) * (MERGE_WASTE_RATIO + 1))
+				break;
+
+			box = merged;
+			area += box_area(&rects[i++]);
+		}
+
+		if (rdp_raw_encode_box(raw, &box, image, max_request_size,
+				       cmd, send, data) < 0)
+			return -1;
+		count++;
+	}
+
+	return count;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright © 2014 Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifndef _RDP_RAW_H_
+#define _RDP_RAW_H_
+
+#include <pixman.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/update.h>
+
+typedef void (*rdp_raw_send_func_t)(SURFACE_BITS_COMMAND *cmd, void *data);
+
+/* Grow-only buffer for uncompressed surface bits, it never gets larger
+ * than the peer's MultifragMaxRequestSize. */
+struct rdp_raw_encoder {
+	BYTE *buffer;
+	uint32_t buffer_size;
+};
+
+void
+rdp_raw_encoder_init(struct rdp_raw_encoder *raw);
+void
+rdp_raw_encoder_release(struct rdp_raw_encoder *raw);
+int
+rdp_raw_encode(struct rdp_raw_encoder *raw, pixman_region32_t *region,
+	       pixman_image_t *image, uint32_t max_request_size,
+	       SURFACE_BITS_COMMAND *cmd, rdp_raw_send_func_t send,
+	       void *data);
+
+#endif /* _RDP_RAW_H_ */
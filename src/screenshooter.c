@@ -259,7 +259,8 @@ screenshooter_binding(struct weston_seat *seat, uint32_t time, uint32_t key,
 struct weston_recorder {
 	struct weston_output *output;
 	uint32_t *frame, *rect;
-	uint32_t *tmpbuf;
+	uint32_t *current;
+	struct weston_tile_hash *tile_hash;
 	uint32_t total;
 	int fd;
 	struct wl_listener frame_listener;
@@ -351,6 +352,39 @@ transform_rect(struct weston_output *output, pixman_box32_t *r)
 	r->y2 *= output->current_scale;
 }
 
+/* Reads a rectangle of the output into recorder->current, using the same
+ * row layout as recorder->frame. */
+static void
+weston_recorder_read_rect(struct weston_recorder *recorder,
+			  pixman_box32_t *r, int do_yflip)
+{
+	struct weston_output *output = recorder->output;
+	struct weston_compositor *compositor = output->compositor;
+	int j, y, y_orig, width, height, stride;
+
+	width = r->x2 - r->x1;
+	height = r->y2 - r->y1;
+	stride = output->current_mode->width;
+
+	if (do_yflip)
+		y_orig = output->current_mode->height - r->y2;
+	else
+		y_orig = r->y1;
+
+	compositor->renderer->read_pixels(output,
+			compositor->read_format, recorder->rect,
+			r->x1, y_orig, width, height);
+
+	for (j = 0; j < height; j++) {
+		if (do_yflip)
+			y = r->y2 - j - 1;
+		else
+			y = r->y1 + j;
+		memcpy(recorder->current + stride * y + r->x1,
+		       recorder->rect + width * j, width * 4);
+	}
+}
+
 static void
 weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 {
@@ -360,7 +394,7 @@ weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 	struct weston_compositor *compositor = output->compositor;
 	uint32_t msecs = output->frame_time;
 	pixman_box32_t *r;
-	pixman_region32_t damage;
+	pixman_region32_t damage, buffer_damage;
 	int i, j, k, n, width, height, run, stride;
 	uint32_t delta, prev, *d, *s, *p, next;
 	struct {
@@ -373,22 +407,40 @@ weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 	uint32_t *outbuf;
 
 	do_yflip = !!(compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP);
-	if (do_yflip)
-		outbuf = recorder->rect;
-	else
-		outbuf = recorder->tmpbuf;
+	outbuf = recorder->rect;
 
 	pixman_region32_init(&damage);
 	pixman_region32_intersect(&damage, &output->region,
 				  &output->previous_damage);
 
 	r = pixman_region32_rectangles(&damage, &n);
-	if (n == 0)
+	if (n == 0) {
+		pixman_region32_fini(&damage);
 		return;
+	}
 
 	for (i = 0; i < n; i++)
 		transform_rect(output, &r[i]);
 
+	pixman_region32_init_rects(&buffer_damage, r, n);
+	pixman_region32_fini(&damage);
+
+	r = pixman_region32_rectangles(&buffer_damage, &n);
+	for (i = 0; i < n; i++)
+		weston_recorder_read_rect(recorder, &r[i], do_yflip);
+
+	stride = output->current_mode->width;
+	if (recorder->tile_hash)
+		weston_tile_hash_refine(recorder->tile_hash,
+					recorder->current, stride * 4,
+					&buffer_damage);
+
+	r = pixman_region32_rectangles(&buffer_damage, &n);
+	if (n == 0) {
+		pixman_region32_fini(&buffer_damage);
+		return;
+	}
+
 	header.msecs = msecs;
 	header.nrects = n;
 	v[0].iov_base = &header;
@@ -396,22 +448,11 @@ weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 	v[1].iov_base = r;
 	v[1].iov_len = n * sizeof *r;
 	recorder->total += writev(recorder->fd, v, 2);
-	stride = output->current_mode->width;
 
 	for (i = 0; i < n; i++) {
 		width = r[i].x2 - r[i].x1;
 		height = r[i].y2 - r[i].y1;
 
-		if (do_yflip)
-			y_orig = output->current_mode->height - r[i].y2;
-		else
-			y_orig = r[i].y1;
-
-		compositor->renderer->read_pixels(output,
-				compositor->read_format, recorder->rect,
-				r[i].x1, y_orig, width, height);
-
-		s = recorder->rect;
 		p = outbuf;
 		run = prev = 0; /* quiet gcc */
 		for (j = 0; j < height; j++) {
@@ -419,6 +460,7 @@ weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 				y_orig = r[i].y2 - j - 1;
 			else
 				y_orig = r[i].y1 + j;
+			s = recorder->current + stride * y_orig + r[i].x1;
 			d = recorder->frame + stride * y_orig + r[i].x1;
 
 			for (k = 0; k < width; k++) {
@@ -450,7 +492,7 @@ weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 #endif
 	}
 
-	pixman_region32_fini(&damage);
+	pixman_region32_fini(&buffer_damage);
 	recorder->count++;
 }
 
@@ -461,9 +503,6 @@ weston_recorder_create(struct weston_output *output, const char *filename)
 	struct weston_recorder *recorder;
 	int stride, size;
 	struct { uint32_t magic, format, width, height; } header;
-	int do_yflip;
-
-	do_yflip = !!(compositor->capabilities & WESTON_CAP_CAPTURE_YFLIP);
 
 	recorder = malloc(sizeof *recorder);
 
@@ -471,14 +510,15 @@ weston_recorder_create(struct weston_output *output, const char *filename)
 	size = stride * 4 * output->current_mode->height;
 	recorder->frame = zalloc(size);
 	recorder->rect = malloc(size);
+	recorder->current = zalloc(size);
 	recorder->total = 0;
 	recorder->count = 0;
 	recorder->output = output;
-
-	if (do_yflip)
-		recorder->tmpbuf = NULL;
-	else
-		recorder->tmpbuf = malloc(size);
+	recorder->tile_hash = NULL;
+	if (compositor->tile_hash)
+		recorder->tile_hash =
+			weston_tile_hash_create(output->current_mode->width,
+						output->current_mode->height);
 
 	header.magic = WCAP_HEADER_MAGIC;
 
@@ -520,7 +560,9 @@ weston_recorder_destroy(struct weston_recorder *recorder)
 {
 	wl_list_remove(&recorder->frame_listener.link);
 	close(recorder->fd);
-	free(recorder->tmpbuf);
+	if (recorder->tile_hash)
+		weston_tile_hash_destroy(recorder->tile_hash);
+	free(recorder->current);
 	free(recorder->frame);
 	free(recorder->rect);
 	recorder->output->disable_planes--;
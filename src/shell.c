@@ -39,6 +39,7 @@
 #include "input-method-server-protocol.h"
 #include "workspaces-server-protocol.h"
 #include "../shared/config-parser.h"
+#include "timer-wheel.h"
 
 #define DEFAULT_NUM_WORKSPACES 1
 #define DEFAULT_WORKSPACE_CHANGE_ANIMATION_LENGTH 200
@@ -99,6 +100,7 @@ struct desktop_shell {
 	struct wl_listener idle_listener;
 	struct wl_listener wake_listener;
 	struct wl_listener destroy_listener;
+	struct wl_listener config_listener;
 	struct wl_listener show_input_panel_listener;
 	struct wl_listener hide_input_panel_listener;
 	struct wl_listener update_input_panel_listener;
@@ -153,7 +155,7 @@ struct desktop_shell {
 		int duration;
 		struct wl_resource *binding;
 		struct weston_process process;
-		struct wl_event_source *timer;
+		struct wheel_timer timer;
 	} screensaver;
 
 	struct {
@@ -165,7 +167,7 @@ struct desktop_shell {
 		struct weston_view *view;
 		struct weston_view_animation *animation;
 		enum fade_type type;
-		struct wl_event_source *startup_timer;
+		struct wheel_timer startup_timer;
 	} fade;
 
 	uint32_t binding_modifier;
@@ -174,6 +176,8 @@ struct desktop_shell {
 
 	struct wl_listener output_create_listener;
 	struct wl_list output_list;
+
+	struct timer_wheel timers;
 };
 
 enum shell_surface_type {
@@ -187,8 +191,9 @@ enum shell_surface_type {
 };
 
 struct ping_timer {
-	struct wl_event_source *source;
+	struct wheel_timer timer;
 	uint32_t serial;
+	int pending;
 };
 
 struct shell_surface {
@@ -232,7 +237,7 @@ struct shell_surface {
 		struct weston_view *black_view;
 	} fullscreen;
 
-	struct ping_timer *ping_timer;
+	struct ping_timer ping_timer;
 
 	struct weston_transform workspace_transform;
 
@@ -498,6 +503,33 @@ shell_configuration(struct desktop_shell *shell)
 				       DEFAULT_NUM_WORKSPACES);
 }
 
+/* Pick up the settings that are only consulted when used; the binding
+ * modifier and the workspaces are set up once at startup. */
+static void
+shell_config_changed(struct wl_listener *listener, void *data)
+{
+	struct desktop_shell *shell =
+		container_of(listener, struct desktop_shell, config_listener);
+	struct weston_config_change *change = data;
+	int duration;
+	char *s;
+
+	if (strcmp(change->name, "screensaver") == 0) {
+		free(shell->screensaver.path);
+		weston_config_section_get_string(change->section, "path",
+						 &shell->screensaver.path,
+						 NULL);
+		weston_config_section_get_int(change->section, "duration",
+					      &duration, 60);
+		shell->screensaver.duration = duration * 1000;
+	} else if (strcmp(change->name, "shell") == 0) {
+		weston_config_section_get_string(change->section,
+						 "animation", &s, "none");
+		shell->win_animation_type = get_animation_type(s);
+		free(s);
+	}
+}
+
 static void
 focus_state_destroy(struct focus_state *state)
 {
@@ -722,7 +754,7 @@ view_translate(struct weston_view *view, double d)
 	weston_matrix_init(&shsurf->workspace_transform.matrix);
 	weston_matrix_translate(&shsurf->workspace_transform.matrix,
 				0.0, d, 0.0);
-	weston_view_geometry_dirty(view);
+	weston_view_damage_animation(view, 1);
 }
 
 static void
@@ -1578,14 +1610,11 @@ end_busy_cursor(struct shell_surface *shsurf, struct weston_pointer *pointer)
 static void
 ping_timer_destroy(struct shell_surface *shsurf)
 {
-	if (!shsurf || !shsurf->ping_timer)
+	if (!shsurf || !shsurf->ping_timer.pending)
 		return;
 
-	if (shsurf->ping_timer->source)
-		wl_event_source_remove(shsurf->ping_timer->source);
-
-	free(shsurf->ping_timer);
-	shsurf->ping_timer = NULL;
+	wheel_timer_cancel(&shsurf->shell->timers, &shsurf->ping_timer.timer);
+	shsurf->ping_timer.pending = 0;
 }
 
 static int
@@ -1608,7 +1637,6 @@ static void
 ping_handler(struct weston_surface *surface, uint32_t serial)
 {
 	struct shell_surface *shsurf = get_shell_surface(surface);
-	struct wl_event_loop *loop;
 	int ping_timeout = 200;
 
 	if (!shsurf)
@@ -1619,16 +1647,11 @@ ping_handler(struct weston_surface *surface, uint32_t serial)
 	if (shsurf->surface == shsurf->shell->grab_surface)
 		return;
 
-	if (!shsurf->ping_timer) {
-		shsurf->ping_timer = malloc(sizeof *shsurf->ping_timer);
-		if (!shsurf->ping_timer)
-			return;
-
-		shsurf->ping_timer->serial = serial;
-		loop = wl_display_get_event_loop(surface->compositor->wl_display);
-		shsurf->ping_timer->source =
-			wl_event_loop_add_timer(loop, ping_timeout_handler, shsurf);
-		wl_event_source_timer_update(shsurf->ping_timer->source, ping_timeout);
+	if (!shsurf->ping_timer.pending) {
+		shsurf->ping_timer.pending = 1;
+		shsurf->ping_timer.serial = serial;
+		wheel_timer_update(&shsurf->shell->timers,
+				   &shsurf->ping_timer.timer, ping_timeout);
 
 		wl_shell_surface_send_ping(shsurf->resource, serial);
 	}
@@ -1665,11 +1688,11 @@ shell_surface_pong(struct wl_client *client, struct wl_resource *resource,
 	struct weston_seat *seat;
 	struct weston_compositor *ec = shsurf->surface->compositor;
 
-	if (shsurf->ping_timer == NULL)
+	if (!shsurf->ping_timer.pending)
 		/* Just ignore unsolicited pong. */
 		return;
 
-	if (shsurf->ping_timer->serial == serial) {
+	if (shsurf->ping_timer.serial == serial) {
 		shsurf->unresponsive = 0;
 		wl_list_for_each(seat, &ec->seat_list, link) {
 			if(seat->pointer)
@@ -2537,7 +2560,9 @@ create_shell_surface(void *shell, struct weston_surface *surface,
 	shsurf->fullscreen.type = WL_SHELL_SURFACE_FULLSCREEN_METHOD_DEFAULT;
 	shsurf->fullscreen.framerate = 0;
 	shsurf->fullscreen.black_view = NULL;
-	shsurf->ping_timer = NULL;
+	shsurf->ping_timer.pending = 0;
+	wheel_timer_init(&shsurf->ping_timer.timer,
+			 ping_timeout_handler, shsurf);
 	wl_list_init(&shsurf->fullscreen.transform.link);
 
 	wl_signal_init(&shsurf->destroy_signal);
@@ -3494,26 +3519,30 @@ do_shell_fade_startup(void *data)
 }
 
 static void
-shell_fade_startup(struct desktop_shell *shell)
+queue_shell_fade_startup(struct desktop_shell *shell)
 {
 	struct wl_event_loop *loop;
 
-	if (!shell->fade.startup_timer)
-		return;
-
-	wl_event_source_remove(shell->fade.startup_timer);
-	shell->fade.startup_timer = NULL;
-
 	loop = wl_display_get_event_loop(shell->compositor->wl_display);
 	wl_event_loop_add_idle(loop, do_shell_fade_startup, shell);
 }
 
+static void
+shell_fade_startup(struct desktop_shell *shell)
+{
+	if (!wheel_timer_pending(&shell->fade.startup_timer))
+		return;
+
+	wheel_timer_cancel(&shell->timers, &shell->fade.startup_timer);
+	queue_shell_fade_startup(shell);
+}
+
 static int
 fade_startup_timeout(void *data)
 {
 	struct desktop_shell *shell = data;
 
-	shell_fade_startup(shell);
+	queue_shell_fade_startup(shell);
 	return 0;
 }
 
@@ -3525,8 +3554,6 @@ shell_fade_init(struct desktop_shell *shell)
 	 * fade-in, in case the desktop-shell client takes too long.
 	 */
 
-	struct wl_event_loop *loop;
-
 	if (shell->fade.view != NULL) {
 		weston_log("%s: warning: fade surface already exists\n",
 			   __func__);
@@ -3540,10 +3567,7 @@ shell_fade_init(struct desktop_shell *shell)
 	weston_view_update_transform(shell->fade.view);
 	weston_surface_damage(shell->fade.view->surface);
 
-	loop = wl_display_get_event_loop(shell->compositor->wl_display);
-	shell->fade.startup_timer =
-		wl_event_loop_add_timer(loop, fade_startup_timeout, shell);
-	wl_event_source_timer_update(shell->fade.startup_timer, 15000);
+	wheel_timer_update(&shell->timers, &shell->fade.startup_timer, 15000);
 }
 
 static void
@@ -4019,8 +4043,8 @@ screensaver_configure(struct weston_surface *surface, int32_t sx, int32_t sy, in
 		wl_list_insert(shell->lock_layer.view_list.prev,
 			       &view->layer_link);
 		weston_view_update_transform(view);
-		wl_event_source_timer_update(shell->screensaver.timer,
-					     shell->screensaver.duration);
+		wheel_timer_update(&shell->timers, &shell->screensaver.timer,
+				   shell->screensaver.duration);
 		shell_fade(shell, FADE_IN);
 	}
 }
@@ -4301,71 +4325,133 @@ bind_input_panel(struct wl_client *client,
 	wl_resource_destroy(resource);
 }
 
+struct switcher;
+
+struct switcher_entry {
+	struct switcher *switcher;
+	struct weston_surface *surface;
+	struct wl_listener destroy_listener;
+	struct wl_list link;
+};
+
+/* The switchable surfaces of the workspace are collected once, in
+ * stacking order, when the switcher starts; a Tab step then only moves
+ * to the neighbouring entry instead of walking the whole workspace. */
 struct switcher {
 	struct desktop_shell *shell;
-	struct weston_surface *current;
-	struct wl_listener listener;
+	struct switcher_entry *current;
+	struct wl_list entries;
 	struct weston_keyboard_grab grab;
 };
 
+/* Only views whose alpha actually changes are damaged, so stepping
+ * through a crowded workspace repaints two surfaces, not all of them. */
 static void
-switcher_next(struct switcher *switcher)
+switcher_set_alpha(struct weston_view *view, float alpha)
+{
+	if (view->alpha == alpha)
+		return;
+
+	view->alpha = alpha;
+	weston_view_geometry_dirty(view);
+	weston_surface_damage(view->surface);
+}
+
+static void
+switcher_set_surface_alpha(struct weston_surface *surface, float alpha)
 {
 	struct weston_view *view;
-	struct weston_surface *first = NULL, *prev = NULL, *next = NULL;
 	struct shell_surface *shsurf;
-	struct workspace *ws = get_current_workspace(switcher->shell);
 
-	wl_list_for_each(view, &ws->layer.view_list, layer_link) {
-		switch (get_shell_surface_type(view->surface)) {
-		case SHELL_SURFACE_TOPLEVEL:
-		case SHELL_SURFACE_FULLSCREEN:
-		case SHELL_SURFACE_MAXIMIZED:
-			if (first == NULL)
-				first = view->surface;
-			if (prev == switcher->current)
-				next = view->surface;
-			prev = view->surface;
-			view->alpha = 0.25;
-			weston_view_geometry_dirty(view);
-			weston_surface_damage(view->surface);
-			break;
-		default:
-			break;
-		}
+	wl_list_for_each(view, &surface->views, surface_link)
+		switcher_set_alpha(view, alpha);
 
-		if (is_black_surface(view->surface, NULL)) {
-			view->alpha = 0.25;
-			weston_view_geometry_dirty(view);
-			weston_surface_damage(view->surface);
-		}
-	}
+	shsurf = get_shell_surface(surface);
+	if (shsurf && shsurf->type == SHELL_SURFACE_FULLSCREEN &&
+	    shsurf->fullscreen.black_view)
+		switcher_set_alpha(shsurf->fullscreen.black_view, alpha);
+}
 
-	if (next == NULL)
-		next = first;
+static void
+switcher_next(struct switcher *switcher)
+{
+	struct switcher_entry *next;
 
-	if (next == NULL)
+	if (wl_list_empty(&switcher->entries))
 		return;
 
-	wl_list_remove(&switcher->listener.link);
-	wl_signal_add(&next->destroy_signal, &switcher->listener);
+	if (switcher->current == NULL ||
+	    switcher->current->link.next == &switcher->entries)
+		next = container_of(switcher->entries.next,
+				    struct switcher_entry, link);
+	else
+		next = container_of(switcher->current->link.next,
+				    struct switcher_entry, link);
+
+	if (switcher->current && switcher->current != next)
+		switcher_set_surface_alpha(switcher->current->surface, 0.25);
 
 	switcher->current = next;
-	wl_list_for_each(view, &next->views, surface_link)
-		view->alpha = 1.0;
+	switcher_set_surface_alpha(next->surface, 1.0);
+}
 
-	shsurf = get_shell_surface(switcher->current);
-	if (shsurf && shsurf->type ==SHELL_SURFACE_FULLSCREEN)
-		shsurf->fullscreen.black_view->alpha = 1.0;
+static void
+switcher_entry_destroy(struct switcher_entry *entry)
+{
+	wl_list_remove(&entry->destroy_listener.link);
+	wl_list_remove(&entry->link);
+	free(entry);
 }
 
 static void
 switcher_handle_surface_destroy(struct wl_listener *listener, void *data)
 {
-	struct switcher *switcher =
-		container_of(listener, struct switcher, listener);
+	struct switcher_entry *entry =
+		container_of(listener, struct switcher_entry,
+			     destroy_listener);
+	struct switcher *switcher = entry->switcher;
 
-	switcher_next(switcher);
+	if (switcher->current == entry) {
+		switcher_next(switcher);
+		if (switcher->current == entry)
+			switcher->current = NULL;
+	}
+
+	switcher_entry_destroy(entry);
+}
+
+static void
+switcher_add_entries(struct switcher *switcher)
+{
+	struct workspace *ws = get_current_workspace(switcher->shell);
+	struct switcher_entry *entry;
+	struct weston_view *view;
+
+	wl_list_for_each(view, &ws->layer.view_list, layer_link) {
+		switch (get_shell_surface_type(view->surface)) {
+		case SHELL_SURFACE_TOPLEVEL:
+		case SHELL_SURFACE_FULLSCREEN:
+		case SHELL_SURFACE_MAXIMIZED:
+			switcher_set_alpha(view, 0.25);
+
+			entry = zalloc(sizeof *entry);
+			if (entry == NULL)
+				break;
+			entry->switcher = switcher;
+			entry->surface = view->surface;
+			entry->destroy_listener.notify =
+				switcher_handle_surface_destroy;
+			wl_signal_add(&view->surface->destroy_signal,
+				      &entry->destroy_listener);
+			wl_list_insert(switcher->entries.prev, &entry->link);
+			break;
+		default:
+			break;
+		}
+
+		if (is_black_surface(view->surface, NULL))
+			switcher_set_alpha(view, 0.25);
+	}
 }
 
 static void
@@ -4374,16 +4460,16 @@ switcher_destroy(struct switcher *switcher)
 	struct weston_view *view;
 	struct weston_keyboard *keyboard = switcher->grab.keyboard;
 	struct workspace *ws = get_current_workspace(switcher->shell);
+	struct switcher_entry *entry, *tmp;
 
-	wl_list_for_each(view, &ws->layer.view_list, layer_link) {
-		view->alpha = 1.0;
-		weston_surface_damage(view->surface);
-	}
+	wl_list_for_each(view, &ws->layer.view_list, layer_link)
+		switcher_set_alpha(view, 1.0);
 
 	if (switcher->current)
-		activate(switcher->shell, switcher->current,
+		activate(switcher->shell, switcher->current->surface,
 			 (struct weston_seat *) keyboard->seat);
-	wl_list_remove(&switcher->listener.link);
+	wl_list_for_each_safe(entry, tmp, &switcher->entries, link)
+		switcher_entry_destroy(entry);
 	weston_keyboard_end_grab(keyboard);
 	if (keyboard->input_method_resource)
 		keyboard->grab = &keyboard->input_method_grab;
@@ -4437,11 +4523,11 @@ switcher_binding(struct weston_seat *seat, uint32_t time, uint32_t key,
 	switcher = malloc(sizeof *switcher);
 	switcher->shell = shell;
 	switcher->current = NULL;
-	switcher->listener.notify = switcher_handle_surface_destroy;
-	wl_list_init(&switcher->listener.link);
+	wl_list_init(&switcher->entries);
 
 	restore_all_output_modes(shell->compositor);
 	lower_fullscreen_layer(switcher->shell);
+	switcher_add_entries(switcher);
 	switcher->grab.interface = &switcher_grab;
 	weston_keyboard_start_grab(seat->keyboard, &switcher->grab);
 	weston_keyboard_set_focus(seat->keyboard, NULL);
@@ -4778,11 +4864,18 @@ shell_destroy(struct wl_listener *listener, void *data)
 	if (shell->child.client)
 		wl_client_destroy(shell->child.client);
 
-	if (shell->screensaver.timer)
-		wl_event_source_remove(shell->screensaver.timer);
+	weston_log("shell timers: %u active, %u at most, %llu scheduled, "
+		   "%llu fired, %llu cascaded, %llu timer updates\n",
+		   shell->timers.stats.active, shell->timers.stats.max_active,
+		   (unsigned long long) shell->timers.stats.scheduled,
+		   (unsigned long long) shell->timers.stats.fired,
+		   (unsigned long long) shell->timers.stats.cascaded,
+		   (unsigned long long) shell->timers.stats.rearmed);
+	timer_wheel_release(&shell->timers);
 
 	wl_list_remove(&shell->idle_listener.link);
 	wl_list_remove(&shell->wake_listener.link);
+	wl_list_remove(&shell->config_listener.link);
 	wl_list_remove(&shell->show_input_panel_listener.link);
 	wl_list_remove(&shell->hide_input_panel_listener.link);
 
@@ -4896,12 +4989,20 @@ module_init(struct weston_compositor *ec,
 
 	shell->compositor = ec;
 
+	loop = wl_display_get_event_loop(ec->wl_display);
+	timer_wheel_init(&shell->timers, loop);
+	wheel_timer_init(&shell->screensaver.timer, screensaver_timeout, shell);
+	wheel_timer_init(&shell->fade.startup_timer,
+			 fade_startup_timeout, shell);
+
 	shell->destroy_listener.notify = shell_destroy;
 	wl_signal_add(&ec->destroy_signal, &shell->destroy_listener);
 	shell->idle_listener.notify = idle_handler;
 	wl_signal_add(&ec->idle_signal, &shell->idle_listener);
 	shell->wake_listener.notify = wake_handler;
 	wl_signal_add(&ec->wake_signal, &shell->wake_listener);
+	shell->config_listener.notify = shell_config_changed;
+	wl_signal_add(&ec->config_signal, &shell->config_listener);
 	shell->show_input_panel_listener.notify = show_input_panels;
 	wl_signal_add(&ec->show_input_panel_signal, &shell->show_input_panel_listener);
 	shell->hide_input_panel_listener.notify = hide_input_panels;
@@ -4973,12 +5074,8 @@ module_init(struct weston_compositor *ec,
 
 	setup_output_destroy_handler(ec, shell);
 
-	loop = wl_display_get_event_loop(ec->wl_display);
 	wl_event_loop_add_idle(loop, launch_desktop_shell_process, shell);
 
-	shell->screensaver.timer =
-		wl_event_loop_add_timer(loop, screensaver_timeout, shell);
-
 	wl_list_for_each(seat, &ec->seat_list, link)
 	create_shell_seat(seat);
 
@@ -29,6 +29,11 @@ weston_view_geometry_dirty(struct weston_view *view)
 {
 }
 
+WL_EXPORT void
+weston_view_damage_animation(struct weston_view *view, int geometry_changed)
+{
+}
+
 WL_EXPORT int
 weston_log(const char *fmt, ...)
 {
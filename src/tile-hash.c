@@ -0,0 +1,165 @@
+/*
+ * Copyright © 2014 Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "compositor.h"
+
+#define TILE_SIZE 64
+
+struct weston_tile_hash {
+	int width, height;
+	int tiles_x, tiles_y;
+	uint64_t *hashes;
+	uint8_t *valid;
+
+	uint32_t tiles_checked;
+	uint32_t tiles_dropped;
+};
+
+WL_EXPORT struct weston_tile_hash *
+weston_tile_hash_create(int width, int height)
+{
+	struct weston_tile_hash *th;
+
+	th = zalloc(sizeof *th);
+	if (th == NULL)
+		return NULL;
+
+	th->width = width;
+	th->height = height;
+	th->tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+	th->tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+	th->hashes = calloc(th->tiles_x * th->tiles_y, sizeof *th->hashes);
+	th->valid = calloc(th->tiles_x * th->tiles_y, sizeof *th->valid);
+	if (th->hashes == NULL || th->valid == NULL) {
+		weston_tile_hash_destroy(th);
+		return NULL;
+	}
+
+	return th;
+}
+
+WL_EXPORT void
+weston_tile_hash_destroy(struct weston_tile_hash *th)
+{
+	if (th->tiles_checked)
+		weston_log("tile hash: %u of %u damaged tiles were "
+			   "unchanged\n", th->tiles_dropped, th->tiles_checked);
+
+	free(th->hashes);
+	free(th->valid);
+	free(th);
+}
+
+/* Forget every stored hash, so that the next refine keeps all damage. */
+WL_EXPORT void
+weston_tile_hash_reset(struct weston_tile_hash *th)
+{
+	memset(th->valid, 0, th->tiles_x * th->tiles_y);
+}
+
+/* FNV-1a over the pixels of one tile. */
+static uint64_t
+tile_hash_compute(const uint32_t *data, int stride,
+		  int width, int height)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	int x, y;
+
+	for (y = 0; y < height; y++, data += stride) {
+		for (x = 0; x < width; x++) {
+			h ^= data[x];
+			h *= 0x100000001b3ULL;
+		}
+	}
+
+	return h;
+}
+
+/* Drops from damage the 64x64 tiles whose contents hash to the same value
+ * as the last time they were refined. data points to a 32 bpp image of
+ * the size given at creation, stride is in bytes. Returns the number of
+ * tiles removed from damage. */
+WL_EXPORT int
+weston_tile_hash_refine(struct weston_tile_hash *th,
+			uint32_t *data, int stride,
+			pixman_region32_t *damage)
+{
+	pixman_region32_t unchanged;
+	pixman_box32_t *extents, tile;
+	int tx, ty, tx1, tx2, ty1, ty2, i, dropped = 0;
+	uint64_t h;
+
+	extents = pixman_region32_extents(damage);
+	if (!pixman_region32_not_empty(damage))
+		return 0;
+
+	tx1 = MAX(extents->x1, 0) / TILE_SIZE;
+	ty1 = MAX(extents->y1, 0) / TILE_SIZE;
+	tx2 = MIN((extents->x2 + TILE_SIZE - 1) / TILE_SIZE, th->tiles_x);
+	ty2 = MIN((extents->y2 + TILE_SIZE - 1) / TILE_SIZE, th->tiles_y);
+
+	stride /= sizeof *data;
+	pixman_region32_init(&unchanged);
+
+	for (ty = ty1; ty < ty2; ty++) {
+		for (tx = tx1; tx < tx2; tx++) {
+			tile.x1 = tx * TILE_SIZE;
+			tile.y1 = ty * TILE_SIZE;
+			tile.x2 = MIN(tile.x1 + TILE_SIZE, th->width);
+			tile.y2 = MIN(tile.y1 + TILE_SIZE, th->height);
+
+			if (pixman_region32_contains_rectangle(damage, &tile) ==
+			    PIXMAN_REGION_OUT)
+				continue;
+
+			h = tile_hash_compute(data + tile.y1 * stride + tile.x1,
+					      stride, tile.x2 - tile.x1,
+					      tile.y2 - tile.y1);
+
+			i = ty * th->tiles_x + tx;
+			th->tiles_checked++;
+			if (th->valid[i] && th->hashes[i] == h) {
+				pixman_region32_union_rect(&unchanged,
+							   &unchanged,
+							   tile.x1, tile.y1,
+							   tile.x2 - tile.x1,
+							   tile.y2 - tile.y1);
+				th->tiles_dropped++;
+				dropped++;
+			} else {
+				th->hashes[i] = h;
+				th->valid[i] = 1;
+			}
+		}
+	}
+
+	if (dropped)
+		pixman_region32_subtract(damage, damage, &unchanged);
+	pixman_region32_fini(&unchanged);
+
+	return dropped;
+}
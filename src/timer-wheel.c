@@ -0,0 +1,336 @@
+/*
+ * Copyright © 2014 Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+#include "timer-wheel.h"
+
+#define container_of(ptr, type, member) ({				\
+	const __typeof__( ((type *)0)->member ) *__mptr = (ptr);	\
+	(type *)( (char *)__mptr - offsetof(type,member) );})
+
+#define TIMER_WHEEL_MASK	(TIMER_WHEEL_SIZE - 1)
+
+static uint64_t
+monotonic_msec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint32_t
+wheel_now(struct timer_wheel *wheel)
+{
+	return wheel->get_time() / TIMER_WHEEL_TICK;
+}
+
+static void
+wheel_place(struct timer_wheel *wheel, struct wheel_timer *timer)
+{
+	uint32_t expires = timer->expires;
+	uint32_t delta = expires - wheel->current;
+	int level, slot;
+
+	if ((int32_t) delta < 0) {
+		expires = wheel->current;
+		delta = 0;
+	}
+
+	/* Timers beyond the last level go to the slot their expiry maps
+	 * to; when that slot is cascaded early they are simply placed
+	 * again. */
+	for (level = 0; level < TIMER_WHEEL_LEVELS - 1; level++)
+		if (delta < 1u << ((level + 1) * TIMER_WHEEL_BITS))
+			break;
+
+	slot = (expires >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK;
+	wl_list_insert(wheel->slots[level][slot].prev, &timer->link);
+	timer->level = level;
+	wheel->count[level]++;
+}
+
+static void
+wheel_cascade(struct timer_wheel *wheel, int level)
+{
+	struct wheel_timer *timer;
+	struct wl_list *slot, list;
+	int index;
+
+	index = (wheel->current >> (level * TIMER_WHEEL_BITS)) &
+		TIMER_WHEEL_MASK;
+	slot = &wheel->slots[level][index];
+	if (wl_list_empty(slot))
+		return;
+
+	wl_list_init(&list);
+	wl_list_insert_list(&list, slot);
+	wl_list_init(slot);
+
+	while (!wl_list_empty(&list)) {
+		timer = container_of(list.next, struct wheel_timer, link);
+		wl_list_remove(&timer->link);
+		wheel->count[level]--;
+		wheel_place(wheel, timer);
+		wheel->stats.cascaded++;
+	}
+}
+
+static uint32_t
+wheel_next_tick(struct timer_wheel *wheel)
+{
+	uint32_t tick;
+	int level, i;
+
+	if (wheel->count[0]) {
+		for (i = 1; i <= TIMER_WHEEL_SIZE; i++) {
+			tick = wheel->current + i;
+			if (!wl_list_empty(&wheel->slots[0][tick &
+							   TIMER_WHEEL_MASK]))
+				return tick;
+		}
+	}
+
+	/* Otherwise wake up for the next cascade of the lowest level
+	 * holding timers. */
+	for (level = 1; level < TIMER_WHEEL_LEVELS - 1; level++)
+		if (wheel->count[level])
+			break;
+
+	return (wheel->current | ((1u << (level * TIMER_WHEEL_BITS)) - 1)) + 1;
+}
+
+static void
+wheel_rearm(struct timer_wheel *wheel)
+{
+	uint64_t now;
+	uint32_t next;
+	int32_t delay;
+
+	if (!wheel->source)
+		return;
+
+	if (wheel->stats.active == 0) {
+		if (wheel->is_armed) {
+			wl_event_source_timer_update(wheel->source, 0);
+			wheel->is_armed = 0;
+			wheel->stats.rearmed++;
+		}
+		return;
+	}
+
+	next = wheel_next_tick(wheel);
+	if (wheel->is_armed && (int32_t) (wheel->armed - next) <= 0)
+		return;
+
+	now = wheel->get_time();
+	delay = (int32_t) (next - (uint32_t) (now / TIMER_WHEEL_TICK)) *
+		TIMER_WHEEL_TICK - now % TIMER_WHEEL_TICK;
+	if (delay < 1)
+		delay = 1;
+
+	wl_event_source_timer_update(wheel->source, delay);
+	wheel->armed = next;
+	wheel->is_armed = 1;
+	wheel->stats.rearmed++;
+}
+
+static int
+wheel_handle_timer(void *data)
+{
+	struct timer_wheel *wheel = data;
+
+	wheel->is_armed = 0;
+	timer_wheel_advance(wheel);
+
+	return 1;
+}
+
+void
+timer_wheel_init(struct timer_wheel *wheel, struct wl_event_loop *loop)
+{
+	int level, i;
+
+	memset(wheel, 0, sizeof *wheel);
+	wheel->get_time = monotonic_msec;
+	wheel->current = wheel_now(wheel);
+
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++)
+		for (i = 0; i < TIMER_WHEEL_SIZE; i++)
+			wl_list_init(&wheel->slots[level][i]);
+
+	if (loop)
+		wheel->source = wl_event_loop_add_timer(loop,
+							wheel_handle_timer,
+							wheel);
+}
+
+void
+timer_wheel_release(struct timer_wheel *wheel)
+{
+	struct wheel_timer *timer;
+	struct wl_list *slot;
+	int level, i;
+
+	/* Leave pending timers unlinked, so cancelling them later does
+	 * not touch the wheel. */
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		for (i = 0; i < TIMER_WHEEL_SIZE; i++) {
+			slot = &wheel->slots[level][i];
+			while (!wl_list_empty(slot)) {
+				timer = container_of(slot->next,
+						     struct wheel_timer, link);
+				wl_list_remove(&timer->link);
+				wl_list_init(&timer->link);
+			}
+		}
+		wheel->count[level] = 0;
+	}
+	wheel->stats.active = 0;
+
+	if (wheel->source)
+		wl_event_source_remove(wheel->source);
+	wheel->source = NULL;
+}
+
+void
+timer_wheel_advance(struct timer_wheel *wheel)
+{
+	struct wheel_timer *timer;
+	struct wl_list *slot;
+	uint32_t now, mask, skip;
+	int level;
+
+	now = wheel_now(wheel);
+
+	while ((int32_t) (now - wheel->current) > 0) {
+		if (wheel->stats.active == 0) {
+			wheel->current = now;
+			break;
+		}
+
+		/* Jump straight to the next cascade when no level below
+		 * it holds timers. */
+		mask = 0;
+		for (level = 0; level < TIMER_WHEEL_LEVELS - 1; level++) {
+			if (wheel->count[level])
+				break;
+			mask = (mask << TIMER_WHEEL_BITS) | TIMER_WHEEL_MASK;
+		}
+		if (mask) {
+			skip = wheel->current | mask;
+			if ((int32_t) (skip - now) >= 0) {
+				wheel->current = now;
+				break;
+			}
+			wheel->current = skip;
+		}
+
+		wheel->current++;
+
+		for (level = TIMER_WHEEL_LEVELS - 1; level > 0; level--)
+			if (!(wheel->current &
+			      ((1u << (level * TIMER_WHEEL_BITS)) - 1)))
+				wheel_cascade(wheel, level);
+
+		slot = &wheel->slots[0][wheel->current & TIMER_WHEEL_MASK];
+		while (!wl_list_empty(slot)) {
+			timer = container_of(slot->next,
+					     struct wheel_timer, link);
+			wl_list_remove(&timer->link);
+			wl_list_init(&timer->link);
+			wheel->count[0]--;
+			wheel->stats.active--;
+			wheel->stats.fired++;
+			timer->func(timer->data);
+		}
+	}
+
+	wheel_rearm(wheel);
+}
+
+void
+wheel_timer_init(struct wheel_timer *timer,
+		 wl_event_loop_timer_func_t func, void *data)
+{
+	wl_list_init(&timer->link);
+	timer->expires = 0;
+	timer->level = 0;
+	timer->func = func;
+	timer->data = data;
+}
+
+static void
+wheel_timer_remove(struct timer_wheel *wheel, struct wheel_timer *timer)
+{
+	wl_list_remove(&timer->link);
+	wl_list_init(&timer->link);
+	wheel->count[timer->level]--;
+	wheel->stats.active--;
+}
+
+/* Like wl_event_source_timer_update(): (re)start the timer to fire
+ * in msec milliseconds, rounded up to the wheel tick, or stop it if
+ * msec is 0. */
+void
+wheel_timer_update(struct timer_wheel *wheel, struct wheel_timer *timer,
+		   uint32_t msec)
+{
+	uint32_t now;
+
+	if (wheel_timer_pending(timer))
+		wheel_timer_remove(wheel, timer);
+
+	if (msec == 0) {
+		wheel_rearm(wheel);
+		return;
+	}
+
+	now = wheel_now(wheel);
+	if (wheel->stats.active == 0)
+		wheel->current = now;
+
+	timer->expires = now + (msec + TIMER_WHEEL_TICK - 1) / TIMER_WHEEL_TICK;
+	wheel_place(wheel, timer);
+
+	wheel->stats.scheduled++;
+	if (++wheel->stats.active > wheel->stats.max_active)
+		wheel->stats.max_active = wheel->stats.active;
+
+	wheel_rearm(wheel);
+}
+
+void
+wheel_timer_cancel(struct timer_wheel *wheel, struct wheel_timer *timer)
+{
+	if (!wheel_timer_pending(timer))
+		return;
+
+	wheel_timer_remove(wheel, timer);
+	wheel_rearm(wheel);
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright © 2014 Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _WESTON_TIMER_WHEEL_H
+#define _WESTON_TIMER_WHEEL_H
+
+#include <stdint.h>
+#include <wayland-server.h>
+
+/* A hierarchical timer wheel multiplexing many coarse timeouts onto a
+ * single event loop timer.  Level 0 has TIMER_WHEEL_SIZE slots of
+ * TIMER_WHEEL_TICK ms each; every further level has slots as wide as
+ * the whole level below, and is cascaded down as time reaches it.
+ * Scheduling and cancelling are O(1) and never touch the kernel unless
+ * the new timeout is the earliest one. */
+
+#define TIMER_WHEEL_TICK	8
+#define TIMER_WHEEL_BITS	6
+#define TIMER_WHEEL_SIZE	(1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS	3
+
+struct wheel_timer {
+	struct wl_list link;
+	uint32_t expires;
+	int level;
+	wl_event_loop_timer_func_t func;
+	void *data;
+};
+
+struct timer_wheel {
+	struct wl_event_source *source;
+	uint64_t (*get_time)(void);
+
+	uint32_t current;
+	uint32_t armed;
+	int is_armed;
+
+	struct wl_list slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+	uint32_t count[TIMER_WHEEL_LEVELS];
+
+	struct {
+		uint32_t active;
+		uint32_t max_active;
+		uint64_t scheduled;
+		uint64_t fired;
+		uint64_t cascaded;
+		uint64_t rearmed;
+	} stats;
+};
+
+void
+timer_wheel_init(struct timer_wheel *wheel, struct wl_event_loop *loop);
+
+void
+timer_wheel_release(struct timer_wheel *wheel);
+
+void
+timer_wheel_advance(struct timer_wheel *wheel);
+
+void
+wheel_timer_init(struct wheel_timer *timer,
+		 wl_event_loop_timer_func_t func, void *data);
+
+void
+wheel_timer_update(struct timer_wheel *wheel, struct wheel_timer *timer,
+		   uint32_t msec);
+
+void
+wheel_timer_cancel(struct timer_wheel *wheel, struct wheel_timer *timer);
+
+static inline int
+wheel_timer_pending(struct wheel_timer *timer)
+{
+	return !wl_list_empty(&timer->link);
+}
+
+#endif
@@ -25,6 +25,10 @@
 
 #include <GLES2/gl2.h>
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
 #include "vertex-clipping.h"
 
 GLfloat
@@ -195,8 +199,11 @@ static void
 clip_context_prepare(struct clip_context *ctx, const struct polygon8 *src,
 		      GLfloat *dst_x, GLfloat *dst_y)
 {
-	ctx->prev.x = src->x[src->n - 1];
-	ctx->prev.y = src->y[src->n - 1];
+	/* an earlier edge may have clipped everything away */
+	if (src->n > 0) {
+		ctx->prev.x = src->x[src->n - 1];
+		ctx->prev.y = src->y[src->n - 1];
+	}
 	ctx->vertices.x = dst_x;
 	ctx->vertices.y = dst_y;
 }
@@ -283,21 +290,12 @@ clip_simple(struct clip_context *ctx,
 	return surf->n;
 }
 
-int
-clip_transformed(struct clip_context *ctx,
-		 struct polygon8 *surf,
-		 GLfloat *ex,
-		 GLfloat *ey)
+/* Copy the clipped polygon to ex, ey, dropping repeated vertices. */
+static int
+clip_remove_duplicates(const struct polygon8 *surf, GLfloat *ex, GLfloat *ey)
 {
-	struct polygon8 polygon;
 	int i, n;
 
-	polygon.n = clip_polygon_left(ctx, surf, polygon.x, polygon.y);
-	surf->n = clip_polygon_right(ctx, &polygon, surf->x, surf->y);
-	polygon.n = clip_polygon_top(ctx, surf, polygon.x, polygon.y);
-	surf->n = clip_polygon_bottom(ctx, &polygon, surf->x, surf->y);
-
-	/* Get rid of duplicate vertices */
 	ex[0] = surf->x[0];
 	ey[0] = surf->y[0];
 	n = 1;
@@ -315,3 +313,251 @@ clip_transformed(struct clip_context *ctx,
 
 	return n;
 }
+
+int
+clip_transformed(struct clip_context *ctx,
+		 struct polygon8 *surf,
+		 GLfloat *ex,
+		 GLfloat *ey)
+{
+	struct polygon8 polygon;
+
+	polygon.n = clip_polygon_left(ctx, surf, polygon.x, polygon.y);
+	surf->n = clip_polygon_right(ctx, &polygon, surf->x, surf->y);
+	polygon.n = clip_polygon_top(ctx, surf, polygon.x, polygon.y);
+	surf->n = clip_polygon_bottom(ctx, &polygon, surf->x, surf->y);
+
+	return clip_remove_duplicates(surf, ex, ey);
+}
+
+enum clip_edge {
+	CLIP_EDGE_LEFT = (1 << 0),
+	CLIP_EDGE_RIGHT = (1 << 1),
+	CLIP_EDGE_TOP = (1 << 2),
+	CLIP_EDGE_BOTTOM = (1 << 3),
+	CLIP_REJECT = (1 << 4),
+};
+
+struct clip_bbox {
+	GLfloat x1, y1;
+	GLfloat x2, y2;
+};
+
+static void
+clip_bbox_init(struct clip_bbox *bbox, const struct polygon8 *surf)
+{
+	int i;
+
+	bbox->x1 = bbox->x2 = surf->x[0];
+	bbox->y1 = bbox->y2 = surf->y[0];
+
+	for (i = 1; i < surf->n; i++) {
+		bbox->x1 = min(bbox->x1, surf->x[i]);
+		bbox->x2 = max(bbox->x2, surf->x[i]);
+		bbox->y1 = min(bbox->y1, surf->y[i]);
+		bbox->y2 = max(bbox->y2, surf->y[i]);
+	}
+}
+
+/* Classify the polygon's bounding box against rects [i, i + 4). Each
+ * mask says whether the rect misses the polygon completely, and which
+ * of its edges have any vertex on the outside. Edges with every vertex
+ * inside would pass the polygon through unchanged, so they are skipped.
+ * The comparisons match path_transition_*_edge().
+ */
+static void
+clip_classify4(const struct clip_bbox *bbox, const struct clip_rects *rects,
+	       int i, unsigned int mask[4])
+{
+#ifdef __SSE__
+	__m128 x1 = _mm_loadu_ps(rects->x1 + i);
+	__m128 y1 = _mm_loadu_ps(rects->y1 + i);
+	__m128 x2 = _mm_loadu_ps(rects->x2 + i);
+	__m128 y2 = _mm_loadu_ps(rects->y2 + i);
+	__m128 bx1 = _mm_set1_ps(bbox->x1);
+	__m128 by1 = _mm_set1_ps(bbox->y1);
+	__m128 bx2 = _mm_set1_ps(bbox->x2);
+	__m128 by2 = _mm_set1_ps(bbox->y2);
+	__m128 reject;
+	int left, right, top, bottom, out;
+	int k;
+
+	reject = _mm_or_ps(_mm_or_ps(_mm_cmpge_ps(bx1, x2),
+				     _mm_cmple_ps(bx2, x1)),
+			   _mm_or_ps(_mm_cmpge_ps(by1, y2),
+				     _mm_cmple_ps(by2, y1)));
+	out = _mm_movemask_ps(reject);
+	left = _mm_movemask_ps(_mm_cmplt_ps(bx1, x1));
+	right = _mm_movemask_ps(_mm_cmpge_ps(bx2, x2));
+	top = _mm_movemask_ps(_mm_cmplt_ps(by1, y1));
+	bottom = _mm_movemask_ps(_mm_cmpge_ps(by2, y2));
+
+	for (k = 0; k < 4; k++)
+		mask[k] = ((out >> k) & 1) * CLIP_REJECT |
+			  ((left >> k) & 1) * CLIP_EDGE_LEFT |
+			  ((right >> k) & 1) * CLIP_EDGE_RIGHT |
+			  ((top >> k) & 1) * CLIP_EDGE_TOP |
+			  ((bottom >> k) & 1) * CLIP_EDGE_BOTTOM;
+#else
+	int k;
+
+	for (k = 0; k < 4; k++) {
+		GLfloat x1 = rects->x1[i + k], y1 = rects->y1[i + k];
+		GLfloat x2 = rects->x2[i + k], y2 = rects->y2[i + k];
+
+		mask[k] = 0;
+		if (bbox->x1 >= x2 || bbox->x2 <= x1 ||
+		    bbox->y1 >= y2 || bbox->y2 <= y1)
+			mask[k] |= CLIP_REJECT;
+		if (bbox->x1 < x1)
+			mask[k] |= CLIP_EDGE_LEFT;
+		if (bbox->x2 >= x2)
+			mask[k] |= CLIP_EDGE_RIGHT;
+		if (bbox->y1 < y1)
+			mask[k] |= CLIP_EDGE_TOP;
+		if (bbox->y2 >= y2)
+			mask[k] |= CLIP_EDGE_BOTTOM;
+	}
+#endif
+}
+
+static void
+clip_classify(const struct clip_bbox *bbox, const struct clip_rects *rects,
+	      int i, unsigned int mask[4])
+{
+	struct clip_rects tail;
+	GLfloat x1[4], y1[4], x2[4], y2[4];
+	int k;
+
+	if (i + 4 <= rects->n) {
+		clip_classify4(bbox, rects, i, mask);
+		return;
+	}
+
+	/* Pad the last few rects; their masks are ignored. */
+	for (k = 0; k < 4; k++) {
+		if (i + k < rects->n) {
+			x1[k] = rects->x1[i + k];
+			y1[k] = rects->y1[i + k];
+			x2[k] = rects->x2[i + k];
+			y2[k] = rects->y2[i + k];
+		} else {
+			x1[k] = y1[k] = x2[k] = y2[k] = 0.0f;
+		}
+	}
+
+	tail.x1 = x1;
+	tail.y1 = y1;
+	tail.x2 = x2;
+	tail.y2 = y2;
+	tail.n = 4;
+	clip_classify4(bbox, &tail, 0, mask);
+}
+
+static void
+clip_context_set_rect(struct clip_context *ctx,
+		      const struct clip_rects *rects, int i)
+{
+	ctx->clip.x1 = rects->x1[i];
+	ctx->clip.y1 = rects->y1[i];
+	ctx->clip.x2 = rects->x2[i];
+	ctx->clip.y2 = rects->y2[i];
+}
+
+/* clip_transformed() restricted to the edges set in mask. */
+static int
+clip_transformed_masked(struct clip_context *ctx, const struct polygon8 *surf,
+			unsigned int mask, GLfloat *ex, GLfloat *ey)
+{
+	struct polygon8 a, b;
+	struct polygon8 *src = &a, *dst = &b, *tmp;
+
+	a = *surf;
+
+	if (mask & CLIP_EDGE_LEFT) {
+		dst->n = clip_polygon_left(ctx, src, dst->x, dst->y);
+		tmp = src; src = dst; dst = tmp;
+	}
+	if (mask & CLIP_EDGE_RIGHT) {
+		dst->n = clip_polygon_right(ctx, src, dst->x, dst->y);
+		tmp = src; src = dst; dst = tmp;
+	}
+	if (mask & CLIP_EDGE_TOP) {
+		dst->n = clip_polygon_top(ctx, src, dst->x, dst->y);
+		tmp = src; src = dst; dst = tmp;
+	}
+	if (mask & CLIP_EDGE_BOTTOM) {
+		dst->n = clip_polygon_bottom(ctx, src, dst->x, dst->y);
+		tmp = src; src = dst; dst = tmp;
+	}
+
+	if (src->n == 0)
+		return 0;
+
+	return clip_remove_duplicates(src, ex, ey);
+}
+
+int
+clip_simple_batch(const struct polygon8 *surf,
+		  const struct clip_rects *rects,
+		  GLfloat *ex, GLfloat *ey, int *vtxcnt)
+{
+	struct clip_context ctx;
+	struct clip_bbox bbox;
+	unsigned int mask[4];
+	int i, k, n, npoly = 0;
+
+	clip_bbox_init(&bbox, surf);
+
+	for (i = 0; i < rects->n; i += 4) {
+		clip_classify(&bbox, rects, i, mask);
+
+		for (k = 0; k < 4 && i + k < rects->n; k++) {
+			if (mask[k] & CLIP_REJECT)
+				continue;
+
+			clip_context_set_rect(&ctx, rects, i + k);
+			n = clip_simple(&ctx, (struct polygon8 *) surf,
+					ex, ey);
+			ex += n;
+			ey += n;
+			vtxcnt[npoly++] = n;
+		}
+	}
+
+	return npoly;
+}
+
+int
+clip_transformed_batch(const struct polygon8 *surf,
+		       const struct clip_rects *rects,
+		       GLfloat *ex, GLfloat *ey, int *vtxcnt)
+{
+	struct clip_context ctx;
+	struct clip_bbox bbox;
+	unsigned int mask[4];
+	int i, k, n, npoly = 0;
+
+	clip_bbox_init(&bbox, surf);
+
+	for (i = 0; i < rects->n; i += 4) {
+		clip_classify(&bbox, rects, i, mask);
+
+		for (k = 0; k < 4 && i + k < rects->n; k++) {
+			if (mask[k] & CLIP_REJECT)
+				continue;
+
+			clip_context_set_rect(&ctx, rects, i + k);
+			n = clip_transformed_masked(&ctx, surf, mask[k],
+						    ex, ey);
+			if (n < 3)
+				continue;
+
+			ex += n;
+			ey += n;
+			vtxcnt[npoly++] = n;
+		}
+	}
+
+	return npoly;
+}
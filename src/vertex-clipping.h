@@ -56,10 +56,40 @@ clip_simple(struct clip_context *ctx,
 	    GLfloat *ex,
 	    GLfloat *ey);
 
+/* Clip rectangles in structure-of-arrays layout, for the batch calls. */
+struct clip_rects {
+	const GLfloat *x1;
+	const GLfloat *y1;
+	const GLfloat *x2;
+	const GLfloat *y2;
+	int n;
+};
+
 int
 clip_transformed(struct clip_context *ctx,
 		 struct polygon8 *surf,
 		 GLfloat *ex,
-		 GLfloat *ey);\
+		 GLfloat *ey);
+
+/*
+ * Clip one polygon against every rect in 'rects'. Rects that the polygon
+ * does not intersect are skipped. The clipped polygons are packed back to
+ * back into 'ex' and 'ey', which must have room for 8 * rects->n vertices.
+ * The number of vertices of each polygon is stored in 'vtxcnt', and the
+ * number of polygons is returned.
+ *
+ * clip_simple_batch() is for polygons whose edges are parallel to the
+ * axes. clip_transformed_batch() takes any convex polygon, and only
+ * emits polygons with 3-8 vertices and non-zero area.
+ */
+int
+clip_simple_batch(const struct polygon8 *surf,
+		  const struct clip_rects *rects,
+		  GLfloat *ex, GLfloat *ey, int *vtxcnt);
+
+int
+clip_transformed_batch(const struct polygon8 *surf,
+		       const struct clip_rects *rects,
+		       GLfloat *ex, GLfloat *ey, int *vtxcnt);
 
 #endif
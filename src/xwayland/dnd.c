@@ -153,11 +153,12 @@ handle_enter(struct weston_wm *wm, xcb_client_message_event_t *client_message)
 	struct dnd_data_source *source;
 	struct weston_seat *seat = weston_wm_pick_seat(wm);
 	char **p;
-	const char *name;
 	uint32_t *types;
-	int i, length, has_text;
+	int i, length, has_text, pending;
 	xcb_get_property_cookie_t cookie;
 	xcb_get_property_reply_t *reply;
+	xcb_get_atom_name_cookie_t *name_cookies;
+	xcb_get_atom_name_reply_t *name_reply;
 
 	source = malloc(sizeof *source);
 	if (source == NULL)
@@ -177,22 +178,45 @@ handle_enter(struct weston_wm *wm, xcb_client_message_event_t *client_message)
 					  source->window,
 					  wm->atom.xdnd_type_list,
 					  XCB_ATOM_ANY, 0, 2048);
+		weston_wm_count_round_trip(wm);
 		reply = xcb_get_property_reply(wm->conn, cookie, NULL);
-		types = xcb_get_property_value(reply);
-		length = reply->value_len;
+		if (reply) {
+			types = xcb_get_property_value(reply);
+			length = reply->value_len;
+		} else {
+			types = NULL;
+			length = 0;
+		}
 	} else {
 		reply = NULL;
 		types = &client_message->data.data32[2];
 		length = 3;
 	}
 
+	/* Ask for all the type names up front, so the whole list
+	 * costs a single round trip rather than one per type. */
+	name_cookies = calloc(length, sizeof *name_cookies);
+	if (name_cookies == NULL)
+		length = 0;
+	pending = 0;
+	for (i = 0; i < length; i++) {
+		if (types[i] != XCB_ATOM_NONE &&
+		    types[i] != wm->atom.utf8_string &&
+		    types[i] != wm->atom.text_plain_utf8 &&
+		    types[i] != wm->atom.text_plain) {
+			name_cookies[i] = xcb_get_atom_name(wm->conn, types[i]);
+			pending++;
+		}
+	}
+	if (pending > 0)
+		weston_wm_count_round_trip(wm);
+
 	wl_array_init(&source->base.mime_types);
 	has_text = 0;
 	for (i = 0; i < length; i++) {
 		if (types[i] == XCB_ATOM_NONE)
 			continue;
 
-		name = get_atom_name(wm->conn, types[i]);
 		if (types[i] == wm->atom.utf8_string ||
 		    types[i] == wm->atom.text_plain_utf8 ||
 		    types[i] == wm->atom.text_plain) {
@@ -203,13 +227,25 @@ handle_enter(struct weston_wm *wm, xcb_client_message_event_t *client_message)
 			p = wl_array_add(&source->base.mime_types, sizeof *p);
 			if (p)
 				*p = strdup("text/plain;charset=utf-8");
-		} else if (strchr(name, '/')) {
+			continue;
+		}
+
+		name_reply = xcb_get_atom_name_reply(wm->conn,
+						     name_cookies[i], NULL);
+		if (name_reply == NULL)
+			continue;
+
+		if (memchr(xcb_get_atom_name_name(name_reply), '/',
+			   xcb_get_atom_name_name_length(name_reply))) {
 			p = wl_array_add(&source->base.mime_types, sizeof *p);
 			if (p)
-				*p = strdup(name);
+				*p = strndup(xcb_get_atom_name_name(name_reply),
+					     xcb_get_atom_name_name_length(name_reply));
 		}
+		free(name_reply);
 	}
 
+	free(name_cookies);
 	free(reply);
 	weston_seat_start_drag(seat, &source->base, NULL, NULL);
 }
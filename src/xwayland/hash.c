@@ -39,83 +39,44 @@
 
 #include "hash.h"
 
+/*
+ * Open addressing with linear probing in a power-of-two sized table.
+ * Keys are spread over the table with the murmur3 finalizer, since X
+ * resource ids share their high bits and differ mostly in the low
+ * ones. Removal shifts the rest of the probe run back instead of
+ * leaving tombstones, so lookups never have to skip deleted slots and
+ * the table never needs rehashing in place.
+ */
+
 struct hash_entry {
 	uint32_t hash;
-	void *data;
+	void *data;	/* NULL for a free slot */
 };
 
 struct hash_table {
 	struct hash_entry *table;
-	uint32_t size;
-	uint32_t rehash;
-	uint32_t max_entries;
-	uint32_t size_index;
+	uint32_t mask;		/* size - 1 */
 	uint32_t entries;
-	uint32_t deleted_entries;
 };
 
-#define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
+#define HASH_MIN_SIZE 8
 
-/*
- * From Knuth -- a good choice for hash/rehash values is p, p-2 where
- * p and p-2 are both prime.  These tables are sized to have an extra 10%
- * free to avoid exponential performance degradation as the hash table fills
- */
-
-static const uint32_t deleted_data;
-
-static const struct {
-   uint32_t max_entries, size, rehash;
-} hash_sizes[] = {
-    { 2,		5,		3	  },
-    { 4,		7,		5	  },
-    { 8,		13,		11	  },
-    { 16,		19,		17	  },
-    { 32,		43,		41        },
-    { 64,		73,		71        },
-    { 128,		151,		149       },
-    { 256,		283,		281       },
-    { 512,		571,		569       },
-    { 1024,		1153,		1151      },
-    { 2048,		2269,		2267      },
-    { 4096,		4519,		4517      },
-    { 8192,		9013,		9011      },
-    { 16384,		18043,		18041     },
-    { 32768,		36109,		36107     },
-    { 65536,		72091,		72089     },
-    { 131072,		144409,		144407    },
-    { 262144,		288361,		288359    },
-    { 524288,		576883,		576881    },
-    { 1048576,		1153459,	1153457   },
-    { 2097152,		2307163,	2307161   },
-    { 4194304,		4613893,	4613891   },
-    { 8388608,		9227641,	9227639   },
-    { 16777216,		18455029,	18455027  },
-    { 33554432,		36911011,	36911009  },
-    { 67108864,		73819861,	73819859  },
-    { 134217728,	147639589,	147639587 },
-    { 268435456,	295279081,	295279079 },
-    { 536870912,	590559793,	590559791 },
-    { 1073741824,	1181116273,	1181116271},
-    { 2147483648ul,	2362232233ul,	2362232231ul}
-};
-
-static int
-entry_is_free(struct hash_entry *entry)
+static uint32_t
+hash_mix(uint32_t h)
 {
-	return entry->data == NULL;
-}
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
 
-static int
-entry_is_deleted(struct hash_entry *entry)
-{
-	return entry->data == &deleted_data;
+	return h;
 }
 
 static int
-entry_is_present(struct hash_entry *entry)
+entry_is_free(struct hash_entry *entry)
 {
-	return entry->data != NULL && entry->data != &deleted_data;
+	return entry->data == NULL;
 }
 
 struct hash_table *
@@ -127,14 +88,9 @@ hash_table_create(void)
 	if (ht == NULL)
 		return NULL;
 
-	ht->size_index = 0;
-	ht->size = hash_sizes[ht->size_index].size;
-	ht->rehash = hash_sizes[ht->size_index].rehash;
-	ht->max_entries = hash_sizes[ht->size_index].max_entries;
-	ht->table = calloc(ht->size, sizeof(*ht->table));
+	ht->mask = HASH_MIN_SIZE - 1;
 	ht->entries = 0;
-	ht->deleted_entries = 0;
-
+	ht->table = calloc(HASH_MIN_SIZE, sizeof(*ht->table));
 	if (ht->table == NULL) {
 		free(ht);
 		return NULL;
@@ -157,36 +113,26 @@ hash_table_destroy(struct hash_table *ht)
 }
 
 /**
- * Finds a hash table entry with the given key and hash of that key.
- *
- * Returns NULL if no entry is found.  Note that the data pointer may be
- * modified by the user.
+ * Finds the slot holding the given hash, or the free slot ending its
+ * probe run if it is not in the table.
  */
-static void *
+static struct hash_entry *
 hash_table_search(struct hash_table *ht, uint32_t hash)
 {
-	uint32_t hash_address;
-
-	hash_address = hash % ht->size;
-	do {
-		uint32_t double_hash;
-
-		struct hash_entry *entry = ht->table + hash_address;
+	struct hash_entry *entry;
+	uint32_t i;
 
-		if (entry_is_free(entry)) {
-			return NULL;
-		} else if (entry_is_present(entry) && entry->hash == hash) {
+	for (i = hash_mix(hash) & ht->mask; ; i = (i + 1) & ht->mask) {
+		entry = ht->table + i;
+		if (entry_is_free(entry) || entry->hash == hash)
 			return entry;
-		}
-
-		double_hash = 1 + hash % ht->rehash;
-
-		hash_address = (hash_address + double_hash) % ht->size;
-	} while (hash_address != hash % ht->size);
-
-	return NULL;
+	}
 }
 
+/**
+ * Calls func on every element. The table must not be modified until
+ * the iteration is done.
+ */
 void
 hash_table_for_each(struct hash_table *ht,
 		    hash_table_iterator_func_t func, void *data)
@@ -194,9 +140,9 @@ hash_table_for_each(struct hash_table *ht,
 	struct hash_entry *entry;
 	uint32_t i;
 
-	for (i = 0; i < ht->size; i++) {
+	for (i = 0; i <= ht->mask; i++) {
 		entry = ht->table + i;
-		if (entry_is_present(entry))
+		if (!entry_is_free(entry))
 			func(entry->data, data);
 	}
 }
@@ -204,106 +150,94 @@ hash_table_for_each(struct hash_table *ht,
 void *
 hash_table_lookup(struct hash_table *ht, uint32_t hash)
 {
-	struct hash_entry *entry;
-
-	entry = hash_table_search(ht, hash);
-	if (entry != NULL)
-		return entry->data;
-
-	return NULL;
+	return hash_table_search(ht, hash)->data;
 }
 
-static void
-hash_table_rehash(struct hash_table *ht, unsigned int new_size_index)
+static int
+hash_table_resize(struct hash_table *ht, uint32_t size)
 {
-	struct hash_table old_ht;
-	struct hash_entry *table, *entry;
-
-	if (new_size_index >= ARRAY_SIZE(hash_sizes))
-		return;
+	struct hash_entry *old_table, *entry;
+	uint32_t old_size, i;
 
-	table = calloc(hash_sizes[new_size_index].size, sizeof(*ht->table));
-	if (table == NULL)
-		return;
+	old_table = ht->table;
+	old_size = ht->mask + 1;
 
-	old_ht = *ht;
+	ht->table = calloc(size, sizeof(*ht->table));
+	if (ht->table == NULL) {
+		ht->table = old_table;
+		return -1;
+	}
+	ht->mask = size - 1;
 
-	ht->table = table;
-	ht->size_index = new_size_index;
-	ht->size = hash_sizes[ht->size_index].size;
-	ht->rehash = hash_sizes[ht->size_index].rehash;
-	ht->max_entries = hash_sizes[ht->size_index].max_entries;
-	ht->entries = 0;
-	ht->deleted_entries = 0;
-
-	for (entry = old_ht.table;
-	     entry != old_ht.table + old_ht.size;
-	     entry++) {
-		if (entry_is_present(entry)) {
-			hash_table_insert(ht, entry->hash, entry->data);
-		}
+	for (i = 0; i < old_size; i++) {
+		if (entry_is_free(old_table + i))
+			continue;
+		entry = hash_table_search(ht, old_table[i].hash);
+		*entry = old_table[i];
 	}
 
-	free(old_ht.table);
+	free(old_table);
+
+	return 0;
 }
 
 /**
- * Inserts the data with the given hash into the table.
+ * Inserts the data with the given hash into the table, replacing the
+ * data already stored for that hash.
  *
- * Note that insertion may rearrange the table on a resize or rehash,
- * so previously found hash_entries are no longer valid after this function.
+ * Note that insertion may rearrange the table on a resize, so
+ * previously found hash_entries are no longer valid after this function.
  */
 int
 hash_table_insert(struct hash_table *ht, uint32_t hash, void *data)
 {
-	uint32_t hash_address;
+	struct hash_entry *entry;
 
-	if (ht->entries >= ht->max_entries) {
-		hash_table_rehash(ht, ht->size_index + 1);
-	} else if (ht->deleted_entries + ht->entries >= ht->max_entries) {
-		hash_table_rehash(ht, ht->size_index);
-	}
+	/* keep the load factor at or below 3/4 */
+	if ((ht->entries + 1) * 4 > (ht->mask + 1) * 3 &&
+	    hash_table_resize(ht, (ht->mask + 1) * 2) < 0)
+		return -1;
+
+	entry = hash_table_search(ht, hash);
+	if (entry_is_free(entry))
+		ht->entries++;
+	entry->hash = hash;
+	entry->data = data;
 
-	hash_address = hash % ht->size;
-	do {
-		struct hash_entry *entry = ht->table + hash_address;
-		uint32_t double_hash;
-
-		if (!entry_is_present(entry)) {
-			if (entry_is_deleted(entry))
-				ht->deleted_entries--;
-			entry->hash = hash;
-			entry->data = data;
-			ht->entries++;
-			return 0;
-		}
-
-		double_hash = 1 + hash % ht->rehash;
-
-		hash_address = (hash_address + double_hash) % ht->size;
-	} while (hash_address != hash % ht->size);
-
-	/* We could hit here if a required resize failed. An unchecked-malloc
-	 * application could ignore this result.
-	 */
-	return -1;
+	return 0;
 }
 
 /**
- * This function deletes the given hash table entry.
+ * This function deletes the entry with the given hash.
  *
- * Note that deletion doesn't otherwise modify the table, so an iteration over
- * the table deleting entries is safe.
+ * The entries after it in its probe run are shifted back to fill the
+ * hole, so that a lookup can stop at the first free slot.
  */
 void
 hash_table_remove(struct hash_table *ht, uint32_t hash)
 {
 	struct hash_entry *entry;
+	uint32_t i, j, home;
 
 	entry = hash_table_search(ht, hash);
-	if (entry != NULL) {
-		entry->data = (void *) &deleted_data;
-		ht->entries--;
-		ht->deleted_entries++;
+	if (entry_is_free(entry))
+		return;
+
+	ht->entries--;
+
+	i = entry - ht->table;
+	for (j = (i + 1) & ht->mask;
+	     !entry_is_free(ht->table + j);
+	     j = (j + 1) & ht->mask) {
+		/* The entry at j may move back to the hole at i only if
+		 * its home slot is not in (i, j], cyclically. */
+		home = hash_mix(ht->table[j].hash) & ht->mask;
+		if (((j - home) & ht->mask) < ((j - i) & ht->mask))
+			continue;
+
+		ht->table[i] = ht->table[j];
+		i = j;
 	}
+
+	ht->table[i].data = NULL;
 }
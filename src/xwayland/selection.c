@@ -26,6 +26,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 
 #include "xwayland.h"
 
@@ -104,6 +105,7 @@ weston_wm_get_incr_chunk(struct weston_wm *wm)
 				  0, /* offset */
 				  0x1fffffff /* length */);
 
+	weston_wm_count_round_trip(wm);
 	reply = xcb_get_property_reply(wm->conn, cookie, NULL);
 
 	dump_property(wm, wm->atom.wl_selection, reply);
@@ -176,6 +178,7 @@ weston_wm_get_selection_targets(struct weston_wm *wm)
 				  0, /* offset */
 				  4096 /* length */);
 
+	weston_wm_count_round_trip(wm);
 	reply = xcb_get_property_reply(wm->conn, cookie, NULL);
 
 	dump_property(wm, wm->atom.wl_selection, reply);
@@ -226,6 +229,7 @@ weston_wm_get_selection_data(struct weston_wm *wm)
 				  0, /* offset */
 				  0x1fffffff /* length */);
 
+	weston_wm_count_round_trip(wm);
 	reply = xcb_get_property_reply(wm->conn, cookie, NULL);
 
 	if (reply->type == wm->atom.incr) {
@@ -255,7 +259,14 @@ weston_wm_handle_selection_notify(struct weston_wm *wm,
 	}
 }
 
-static const size_t incr_chunk_size = 64 * 1024;
+/* Wayland to X transfers switch to INCR once this much data is
+ * buffered, and send the first INCR chunk at this size. Every chunk
+ * the requestor takes doubles the size of the next one, up to what
+ * the X server accepts in one request or INCR_CHUNK_MAX, so large
+ * transfers need few property round trips while small ones are not
+ * held up. */
+#define INCR_CHUNK_MIN	(64 * 1024)
+#define INCR_CHUNK_MAX	(4 * 1024 * 1024)
 
 static void
 weston_wm_send_selection_notify(struct weston_wm *wm, xcb_atom_t property)
@@ -340,27 +351,32 @@ weston_wm_read_data_source(int fd, uint32_t mask, void *data)
 	int len, current, available;
 	void *p;
 
+	/* Make room for the rest of the current chunk. */
 	current = wm->source_data.size;
-	if (wm->source_data.size < incr_chunk_size)
-		p = wl_array_add(&wm->source_data, incr_chunk_size);
-	else
-		p = (char *) wm->source_data.data + wm->source_data.size;
-	available = wm->source_data.alloc - current;
+	available = wm->incr_chunk_size - current;
+	p = wl_array_add(&wm->source_data, available);
+	if (p == NULL) {
+		weston_log("out of memory reading data source\n");
+		len = -1;
+	} else {
+		wm->source_data.size = current;
+		len = read(fd, p, available);
+	}
+
+	if (len == -1 && errno == EAGAIN)
+		return 1;
 
-	len = read(fd, p, available);
 	if (len == -1) {
 		weston_log("read error from data source: %m\n");
 		weston_wm_send_selection_notify(wm, XCB_ATOM_NONE);
 		wl_event_source_remove(wm->property_source);
 		close(fd);
 		wl_array_release(&wm->source_data);
+		return 1;
 	}
 
-	weston_log("read %d (available %d, mask 0x%x) bytes: \"%.*s\"\n",
-		len, available, mask, len, (char *) p);
-
 	wm->source_data.size = current + len;
-	if (wm->source_data.size >= incr_chunk_size) {
+	if (wm->source_data.size >= wm->incr_chunk_size) {
 		if (!wm->incr) {
 			weston_log("got %zu bytes, starting incr\n",
 				wm->source_data.size);
@@ -371,7 +387,7 @@ weston_wm_read_data_source(int fd, uint32_t mask, void *data)
 					    wm->selection_request.property,
 					    wm->atom.incr,
 					    32, /* format */
-					    1, &incr_chunk_size);
+					    1, &wm->incr_chunk_size);
 			wm->selection_property_set = 1;
 			wm->flush_property_on_delete = 1;
 			wl_event_source_remove(wm->property_source);
@@ -437,6 +453,7 @@ weston_wm_send_data(struct weston_wm *wm, xcb_atom_t target, const char *mime_ty
 	}
 
 	wl_array_init(&wm->source_data);
+	wm->incr_chunk_size = INCR_CHUNK_MIN;
 	wm->selection_target = target;
 	wm->data_source_fd = p[0];
 	wm->property_source = wl_event_loop_add_fd(wm->server->loop,
@@ -464,6 +481,12 @@ weston_wm_send_incr_chunk(struct weston_wm *wm)
 		wm->flush_property_on_delete = 0;
 		length = weston_wm_flush_source_data(wm);
 
+		if (wm->incr_chunk_size < wm->incr_chunk_max) {
+			wm->incr_chunk_size *= 2;
+			if (wm->incr_chunk_size > wm->incr_chunk_max)
+				wm->incr_chunk_size = wm->incr_chunk_max;
+		}
+
 		if (wm->data_source_fd >= 0) {
 			wm->property_source =
 				wl_event_loop_add_fd(wm->server->loop,
@@ -516,11 +539,11 @@ weston_wm_handle_selection_request(struct weston_wm *wm,
 		(xcb_selection_request_event_t *) event;
 
 	weston_log("selection request, %s, ",
-		get_atom_name(wm->conn, selection_request->selection));
+		get_atom_name(wm, selection_request->selection));
 	weston_log_continue("target %s, ",
-		get_atom_name(wm->conn, selection_request->target));
+		get_atom_name(wm, selection_request->target));
 	weston_log_continue("property %s\n",
-		get_atom_name(wm->conn, selection_request->property));
+		get_atom_name(wm, selection_request->property));
 
 	wm->selection_request = *selection_request;
 	wm->incr = 0;
@@ -675,10 +698,18 @@ void
 weston_wm_selection_init(struct weston_wm *wm)
 {
 	struct weston_seat *seat;
-	uint32_t values[1], mask;
+	uint32_t values[1], mask, max_request;
 
 	wm->selection_request.requestor = XCB_NONE;
 
+	/* Leave room for the ChangeProperty request header. */
+	max_request = xcb_get_maximum_request_length(wm->conn) * 4 - 64;
+	wm->incr_chunk_max = INCR_CHUNK_MAX;
+	if (max_request < wm->incr_chunk_max)
+		wm->incr_chunk_max = max_request;
+	if (wm->incr_chunk_max < INCR_CHUNK_MIN)
+		wm->incr_chunk_max = INCR_CHUNK_MIN;
+
 	values[0] = XCB_EVENT_MASK_PROPERTY_CHANGE;
 	wm->selection_window = xcb_generate_id(wm->conn);
 	xcb_create_window(wm->conn,
@@ -32,6 +32,7 @@
 #include <unistd.h>
 #include <signal.h>
 #include <X11/Xcursor/Xcursor.h>
+#include <xcb/xcbext.h>
 #include <linux/input.h>
 
 #include "xwayland.h"
@@ -116,6 +117,9 @@ struct motif_wm_hints {
 #define _NET_WM_MOVERESIZE_MOVE_KEYBOARD    10   /* move via keyboard */
 #define _NET_WM_MOVERESIZE_CANCEL           11   /* cancel operation */
 
+/* Number of properties weston_wm_window_fetch_properties() asks for */
+#define WM_PROP_COUNT 11
+
 struct weston_wm_window {
 	struct weston_wm *wm;
 	xcb_window_t id;
@@ -128,7 +132,14 @@ struct weston_wm_window {
 	struct wl_listener surface_destroy_listener;
 	struct wl_event_source *repaint_source;
 	struct wl_event_source *configure_source;
+	struct wl_list fetch_link;
+	int fetching;
+	int fetched;
 	int properties_dirty;
+	int map_pending;
+	xcb_get_property_cookie_t prop_cookies[WM_PROP_COUNT];
+	int fetch_geometry;
+	xcb_get_geometry_cookie_t geometry_cookie;
 	int pid;
 	char *machine;
 	char *class;
@@ -189,8 +200,44 @@ wm_log_continue(const char *fmt, ...)
 }
 
 
+void
+weston_wm_count_round_trip(struct weston_wm *wm)
+{
+	uint32_t now = weston_compositor_get_time();
+
+	if (now - wm->round_trips.second_start >= 1000) {
+		if (wm->round_trips.second > 0)
+			wm_log("%u blocking round trips in the last second\n",
+			       wm->round_trips.second);
+		if (wm->round_trips.second > wm->round_trips.peak)
+			wm->round_trips.peak = wm->round_trips.second;
+		wm->round_trips.second = 0;
+		wm->round_trips.second_start = now;
+	}
+
+	wm->round_trips.second++;
+	wm->round_trips.total++;
+}
+
+static void
+weston_wm_round_trip_binding(struct weston_seat *seat, uint32_t time,
+			     uint32_t key, void *data)
+{
+	struct weston_wm *wm = data;
+	uint32_t now = weston_compositor_get_time();
+	uint32_t second = wm->round_trips.second;
+
+	if (now - wm->round_trips.second_start >= 1000)
+		second = 0;
+
+	weston_log("xwm: %u blocking round trips, %u in the current second, "
+		   "at most %u per second\n", wm->round_trips.total, second,
+		   wm->round_trips.peak > second ?
+		   wm->round_trips.peak : second);
+}
+
 const char *
-get_atom_name(xcb_connection_t *c, xcb_atom_t atom)
+get_atom_name(struct weston_wm *wm, xcb_atom_t atom)
 {
 	xcb_get_atom_name_cookie_t cookie;
 	xcb_get_atom_name_reply_t *reply;
@@ -200,8 +247,9 @@ get_atom_name(xcb_connection_t *c, xcb_atom_t atom)
 	if (atom == XCB_ATOM_NONE)
 		return "None";
 
-	cookie = xcb_get_atom_name (c, atom);
-	reply = xcb_get_atom_name_reply (c, cookie, &e);
+	weston_wm_count_round_trip(wm);
+	cookie = xcb_get_atom_name (wm->conn, atom);
+	reply = xcb_get_atom_name_reply (wm->conn, cookie, &e);
 
 	if(reply) {
 		snprintf(buffer, sizeof buffer, "%.*s",
@@ -293,20 +341,23 @@ void
 dump_property(struct weston_wm *wm,
 	      xcb_atom_t property, xcb_get_property_reply_t *reply)
 {
+	/* Everything below goes to wm_log_continue(), but the atom names
+	 * it prints cost a round trip each. */
+#ifdef WM_DEBUG
 	int32_t *incr_value;
 	const char *text_value, *name;
 	xcb_atom_t *atom_value;
 	int width, len;
 	uint32_t i;
 
-	width = wm_log_continue("%s: ", get_atom_name(wm->conn, property));
+	width = wm_log_continue("%s: ", get_atom_name(wm, property));
 	if (reply == NULL) {
 		wm_log_continue("(no reply)\n");
 		return;
 	}
 
 	width += wm_log_continue("%s/%d, length %d (value_len %d): ",
-				 get_atom_name(wm->conn, reply->type),
+				 get_atom_name(wm, reply->type),
 				 reply->format,
 				 xcb_get_property_value_length(reply),
 				 reply->value_len);
@@ -325,7 +376,7 @@ dump_property(struct weston_wm *wm,
 	} else if (reply->type == XCB_ATOM_ATOM) {
 		atom_value = xcb_get_property_value(reply);
 		for (i = 0; i < reply->value_len; i++) {
-			name = get_atom_name(wm->conn, atom_value[i]);
+			name = get_atom_name(wm, atom_value[i]);
 			if (width + strlen(name) + 2 > 78) {
 				wm_log_continue("\n    ");
 				width = 4;
@@ -339,15 +390,19 @@ dump_property(struct weston_wm *wm,
 	} else {
 		wm_log_continue("huh?\n");
 	}
+#endif
 }
 
 static void
 read_and_dump_property(struct weston_wm *wm,
 		       xcb_window_t window, xcb_atom_t property)
 {
+	/* Don't pay for a round trip just to throw the reply away. */
+#ifdef WM_DEBUG
 	xcb_get_property_reply_t *reply;
 	xcb_get_property_cookie_t cookie;
 
+	weston_wm_count_round_trip(wm);
 	cookie = xcb_get_property(wm->conn, 0, window,
 				  property, XCB_ATOM_ANY, 0, 2048);
 	reply = xcb_get_property_reply(wm->conn, cookie, NULL);
@@ -355,6 +410,7 @@ read_and_dump_property(struct weston_wm *wm,
 	dump_property(wm, property, reply);
 
 	free(reply);
+#endif
 }
 
 /* We reuse some predefined, but otherwise useles atoms */
@@ -363,19 +419,17 @@ read_and_dump_property(struct weston_wm *wm,
 #define TYPE_NET_WM_STATE	XCB_ATOM_CUT_BUFFER2
 #define TYPE_WM_NORMAL_HINTS	XCB_ATOM_CUT_BUFFER3
 
+struct wm_prop {
+	xcb_atom_t atom;
+	xcb_atom_t type;
+	int offset;
+};
+
 static void
-weston_wm_window_read_properties(struct weston_wm_window *window)
+weston_wm_get_props(struct weston_wm *wm, struct wm_prop *out)
 {
-	struct weston_wm *wm = window->wm;
-	struct weston_shell_interface *shell_interface =
-		&wm->server->compositor->shell_interface;
-
 #define F(field) offsetof(struct weston_wm_window, field)
-	const struct {
-		xcb_atom_t atom;
-		xcb_atom_t type;
-		int offset;
-	} props[] = {
+	const struct wm_prop props[WM_PROP_COUNT] = {
 		{ XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, F(class) },
 		{ XCB_ATOM_WM_NAME, XCB_ATOM_STRING, F(name) },
 		{ XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, F(transient_for) },
@@ -390,102 +444,243 @@ weston_wm_window_read_properties(struct weston_wm_window *window)
 	};
 #undef F
 
-	xcb_get_property_cookie_t cookie[ARRAY_LENGTH(props)];
-	xcb_get_property_reply_t *reply;
+	memcpy(out, props, sizeof props);
+}
+
+static int
+weston_wm_is_window_prop(struct weston_wm *wm, xcb_atom_t atom)
+{
+	struct wm_prop props[WM_PROP_COUNT];
+	int i;
+
+	weston_wm_get_props(wm, props);
+	for (i = 0; i < WM_PROP_COUNT; i++)
+		if (props[i].atom == atom)
+			return 1;
+
+	return 0;
+}
+
+/* Send the property requests for window, but don't wait for the
+ * replies.  They're picked up by weston_wm_process_replies() once
+ * they've arrived, in the order the requests went out. */
+static void
+weston_wm_window_fetch_properties(struct weston_wm_window *window)
+{
+	struct weston_wm *wm = window->wm;
+	struct wm_prop props[WM_PROP_COUNT];
+	int i;
+
+	if (window->fetching) {
+		/* The replies in flight may predate the change; ask
+		 * again once they're in. */
+		window->properties_dirty = 1;
+		return;
+	}
+
+	weston_wm_get_props(wm, props);
+	for (i = 0; i < WM_PROP_COUNT; i++)
+		window->prop_cookies[i] =
+			xcb_get_property(wm->conn,
+					 0, /* delete */
+					 window->id,
+					 props[i].atom,
+					 XCB_ATOM_ANY, 0, 2048);
+
+	window->fetching = 1;
+	window->properties_dirty = 0;
+	wl_list_insert(wm->fetch_list.prev, &window->fetch_link);
+}
+
+static void
+weston_wm_window_parse_property(struct weston_wm_window *window,
+				const struct wm_prop *prop,
+				xcb_get_property_reply_t *reply)
+{
+	struct weston_wm *wm = window->wm;
 	void *p;
 	uint32_t *xid;
 	xcb_atom_t *atom;
 	uint32_t i;
 
-	if (!window->properties_dirty)
-		return;
-	window->properties_dirty = 0;
+	p = ((char *) window + prop->offset);
 
-	for (i = 0; i < ARRAY_LENGTH(props); i++)
-		cookie[i] = xcb_get_property(wm->conn,
-					     0, /* delete */
-					     window->id,
-					     props[i].atom,
-					     XCB_ATOM_ANY, 0, 2048);
+	switch (prop->type) {
+	case XCB_ATOM_WM_CLIENT_MACHINE:
+	case XCB_ATOM_STRING:
+		/* FIXME: We're using this for both string and
+		   utf8_string */
+		if (*(char **) p)
+			free(*(char **) p);
+
+		*(char **) p =
+			strndup(xcb_get_property_value(reply),
+				xcb_get_property_value_length(reply));
+		break;
+	case XCB_ATOM_WINDOW:
+		xid = xcb_get_property_value(reply);
+		*(struct weston_wm_window **) p =
+			hash_table_lookup(wm->window_hash, *xid);
+		break;
+	case XCB_ATOM_CARDINAL:
+	case XCB_ATOM_ATOM:
+		atom = xcb_get_property_value(reply);
+		*(xcb_atom_t *) p = *atom;
+		break;
+	case TYPE_WM_PROTOCOLS:
+		atom = xcb_get_property_value(reply);
+		for (i = 0; i < reply->value_len; i++)
+			if (atom[i] == wm->atom.wm_delete_window)
+				window->delete_window = 1;
+		break;
+	case TYPE_WM_NORMAL_HINTS:
+		memcpy(&window->size_hints,
+		       xcb_get_property_value(reply),
+		       sizeof window->size_hints);
+		break;
+	case TYPE_NET_WM_STATE:
+		window->fullscreen = 0;
+		atom = xcb_get_property_value(reply);
+		for (i = 0; i < reply->value_len; i++)
+			if (atom[i] == wm->atom.net_wm_state_fullscreen)
+				window->fullscreen = 1;
+		break;
+	case TYPE_MOTIF_WM_HINTS:
+		memcpy(&window->motif_hints,
+		       xcb_get_property_value(reply),
+		       sizeof window->motif_hints);
+		if (window->motif_hints.flags & MWM_HINTS_DECORATIONS)
+			window->decorate =
+				window->motif_hints.decorations > 0;
+		break;
+	default:
+		break;
+	}
+}
+
+static void
+weston_wm_window_map(struct weston_wm_window *window);
+
+/* Collect the replies for the requests sent by
+ * weston_wm_window_fetch_properties().  Returns 0 without touching
+ * anything if they haven't all arrived yet, unless block is set, in
+ * which case we wait for them. */
+static int
+weston_wm_window_finish_fetch(struct weston_wm_window *window, int block)
+{
+	struct weston_wm *wm = window->wm;
+	struct weston_shell_interface *shell_interface =
+		&wm->server->compositor->shell_interface;
+	struct wm_prop props[WM_PROP_COUNT];
+	xcb_get_property_reply_t *reply, *last = NULL;
+	xcb_get_geometry_reply_t *geometry_reply;
+	xcb_generic_error_t *error = NULL;
+	int i;
+
+	/* Replies come back in request order, so once the last one is
+	 * here, collecting the others below doesn't block. */
+	if (!xcb_poll_for_reply(wm->conn,
+				window->prop_cookies[WM_PROP_COUNT - 1].sequence,
+				(void **) &last, &error)) {
+		if (!block)
+			return 0;
+
+		weston_wm_count_round_trip(wm);
+		last = xcb_get_property_reply(wm->conn,
+					      window->prop_cookies[WM_PROP_COUNT - 1],
+					      &error);
+	}
+	free(error);
+
+	wl_list_remove(&window->fetch_link);
+	window->fetching = 0;
+
+	if (window->fetch_geometry) {
+		geometry_reply = xcb_get_geometry_reply(wm->conn,
+							window->geometry_cookie,
+							NULL);
+		/* technically we should use XRender and check the visual
+		 * format's alpha_mask, but checking depth is simpler and
+		 * works in all known cases */
+		if (geometry_reply != NULL)
+			window->has_alpha = geometry_reply->depth == 32;
+		free(geometry_reply);
+		window->fetch_geometry = 0;
+	}
 
 	window->decorate = !window->override_redirect;
 	window->size_hints.flags = 0;
 	window->motif_hints.flags = 0;
 	window->delete_window = 0;
 
-	for (i = 0; i < ARRAY_LENGTH(props); i++)  {
-		reply = xcb_get_property_reply(wm->conn, cookie[i], NULL);
+	weston_wm_get_props(wm, props);
+	for (i = 0; i < WM_PROP_COUNT; i++)  {
+		if (i == WM_PROP_COUNT - 1)
+			reply = last;
+		else
+			reply = xcb_get_property_reply(wm->conn,
+						       window->prop_cookies[i],
+						       NULL);
 		if (!reply)
 			/* Bad window, typically */
 			continue;
-		if (reply->type == XCB_ATOM_NONE) {
-			/* No such property */
-			free(reply);
-			continue;
-		}
-
-		p = ((char *) window + props[i].offset);
-
-		switch (props[i].type) {
-		case XCB_ATOM_WM_CLIENT_MACHINE:
-		case XCB_ATOM_STRING:
-			/* FIXME: We're using this for both string and
-			   utf8_string */
-			if (*(char **) p)
-				free(*(char **) p);
-
-			*(char **) p =
-				strndup(xcb_get_property_value(reply),
-					xcb_get_property_value_length(reply));
-			break;
-		case XCB_ATOM_WINDOW:
-			xid = xcb_get_property_value(reply);
-			*(struct weston_wm_window **) p =
-				hash_table_lookup(wm->window_hash, *xid);
-			break;
-		case XCB_ATOM_CARDINAL:
-		case XCB_ATOM_ATOM:
-			atom = xcb_get_property_value(reply);
-			*(xcb_atom_t *) p = *atom;
-			break;
-		case TYPE_WM_PROTOCOLS:
-			atom = xcb_get_property_value(reply);
-			for (i = 0; i < reply->value_len; i++)
-				if (atom[i] == wm->atom.wm_delete_window)
-					window->delete_window = 1;
-			break;
-
-			break;
-		case TYPE_WM_NORMAL_HINTS:
-			memcpy(&window->size_hints,
-			       xcb_get_property_value(reply),
-			       sizeof window->size_hints);
-			break;
-		case TYPE_NET_WM_STATE:
-			window->fullscreen = 0;
-			atom = xcb_get_property_value(reply);
-			for (i = 0; i < reply->value_len; i++)
-				if (atom[i] == wm->atom.net_wm_state_fullscreen)
-					window->fullscreen = 1;
-			break;
-		case TYPE_MOTIF_WM_HINTS:
-			memcpy(&window->motif_hints,
-			       xcb_get_property_value(reply),
-			       sizeof window->motif_hints);
-			if (window->motif_hints.flags & MWM_HINTS_DECORATIONS)
-				window->decorate =
-					window->motif_hints.decorations > 0;
-			break;
-		default:
-			break;
-		}
+		if (reply->type != XCB_ATOM_NONE)
+			weston_wm_window_parse_property(window,
+							&props[i], reply);
 		free(reply);
 	}
 
+	window->fetched = 1;
+
 	if (window->shsurf && window->name)
 		shell_interface->set_title(window->shsurf, window->name);
 	if (window->frame && window->name)
 		frame_set_title(window->frame, window->name);
+	if (window->frame_id != XCB_WINDOW_NONE)
+		weston_wm_window_schedule_repaint(window);
+
+	if (window->map_pending) {
+		window->map_pending = 0;
+		weston_wm_window_map(window);
+	}
+
+	if (window->properties_dirty)
+		weston_wm_window_fetch_properties(window);
+
+	return 1;
+}
+
+static void
+weston_wm_window_discard_fetch(struct weston_wm_window *window)
+{
+	struct weston_wm *wm = window->wm;
+	int i;
+
+	if (!window->fetching)
+		return;
+
+	for (i = 0; i < WM_PROP_COUNT; i++)
+		xcb_discard_reply(wm->conn, window->prop_cookies[i].sequence);
+	if (window->fetch_geometry)
+		xcb_discard_reply(wm->conn, window->geometry_cookie.sequence);
+
+	wl_list_remove(&window->fetch_link);
+	window->fetching = 0;
+}
+
+static int
+weston_wm_process_replies(struct weston_wm *wm)
+{
+	struct weston_wm_window *window, *next;
+	int count = 0;
+
+	wl_list_for_each_safe(window, next, &wm->fetch_list, fetch_link) {
+		if (!weston_wm_window_finish_fetch(window, 0))
+			break;
+		count++;
+	}
+
+	return count;
 }
 
 static void
@@ -855,6 +1050,24 @@ weston_wm_window_create_frame(struct weston_wm_window *window)
 	hash_table_insert(wm->window_hash, window->frame_id, window);
 }
 
+static void
+weston_wm_window_map(struct weston_wm_window *window)
+{
+	struct weston_wm *wm = window->wm;
+
+	if (window->frame_id == XCB_WINDOW_NONE)
+		weston_wm_window_create_frame(window);
+
+	wm_log("mapping window %d, %p, frame %d\n",
+	       window->id, window, window->frame_id);
+
+	weston_wm_window_set_wm_state(window, ICCCM_NORMAL_STATE);
+	weston_wm_window_set_net_wm_state(window);
+
+	xcb_map_window(wm->conn, window->id);
+	xcb_map_window(wm->conn, window->frame_id);
+}
+
 static void
 weston_wm_handle_map_request(struct weston_wm *wm, xcb_generic_event_t *event)
 {
@@ -869,20 +1082,18 @@ weston_wm_handle_map_request(struct weston_wm *wm, xcb_generic_event_t *event)
 	}
 
 	window = hash_table_lookup(wm->window_hash, map_request->window);
+	if (!window)
+		return;
 
-	weston_wm_window_read_properties(window);
-
-	if (window->frame_id == XCB_WINDOW_NONE)
-		weston_wm_window_create_frame(window);
-
-	wm_log("XCB_MAP_REQUEST (window %d, %p, frame %d)\n",
-	       window->id, window, window->frame_id);
-
-	weston_wm_window_set_wm_state(window, ICCCM_NORMAL_STATE);
-	weston_wm_window_set_net_wm_state(window);
+	wm_log("XCB_MAP_REQUEST (window %d%s)\n", window->id,
+	       window->fetching ? ", deferred" : "");
 
-	xcb_map_window(wm->conn, map_request->window);
-	xcb_map_window(wm->conn, window->frame_id);
+	/* The frame depends on the properties, so if they're still
+	 * on their way, map once they're in. */
+	if (window->fetching)
+		window->map_pending = 1;
+	else
+		weston_wm_window_map(window);
 }
 
 static void
@@ -941,8 +1152,6 @@ weston_wm_window_draw_decoration(void *data)
 
 	uint32_t flags = 0;
 
-	weston_wm_window_read_properties(window);
-
 	window->repaint_source = NULL;
 
 	weston_wm_window_get_frame_size(window, &width, &height);
@@ -1045,8 +1254,6 @@ weston_wm_handle_property_notify(struct weston_wm *wm, xcb_generic_event_t *even
 	if (!window)
 		return;
 
-	window->properties_dirty = 1;
-
 	wm_log("XCB_PROPERTY_NOTIFY: window %d, ", property_notify->window);
 	if (property_notify->state == XCB_PROPERTY_DELETE)
 		wm_log("deleted\n");
@@ -1054,9 +1261,10 @@ weston_wm_handle_property_notify(struct weston_wm *wm, xcb_generic_event_t *even
 		read_and_dump_property(wm, property_notify->window,
 				       property_notify->atom);
 
-	if (property_notify->atom == wm->atom.net_wm_name ||
-	    property_notify->atom == XCB_ATOM_WM_NAME)
-		weston_wm_window_schedule_repaint(window);
+	/* The repaint for a title change is scheduled when the new
+	 * values come in. */
+	if (weston_wm_is_window_prop(wm, property_notify->atom))
+		weston_wm_window_fetch_properties(window);
 }
 
 static void
@@ -1065,8 +1273,6 @@ weston_wm_window_create(struct weston_wm *wm,
 {
 	struct weston_wm_window *window;
 	uint32_t values[1];
-	xcb_get_geometry_cookie_t geometry_cookie;
-	xcb_get_geometry_reply_t *geometry_reply;
 
 	window = zalloc(sizeof *window);
 	if (window == NULL) {
@@ -1074,26 +1280,23 @@ weston_wm_window_create(struct weston_wm *wm,
 		return;
 	}
 
-	geometry_cookie = xcb_get_geometry(wm->conn, id);
+	window->geometry_cookie = xcb_get_geometry(wm->conn, id);
+	window->fetch_geometry = 1;
 
 	values[0] = XCB_EVENT_MASK_PROPERTY_CHANGE;
 	xcb_change_window_attributes(wm->conn, id, XCB_CW_EVENT_MASK, values);
 
 	window->wm = wm;
 	window->id = id;
-	window->properties_dirty = 1;
 	window->override_redirect = override;
 	window->width = width;
 	window->height = height;
 	window->x = x;
 	window->y = y;
 
-	geometry_reply = xcb_get_geometry_reply(wm->conn, geometry_cookie, NULL);
-	/* technically we should use XRender and check the visual format's
-	alpha_mask, but checking depth is simpler and works in all known cases */
-	if(geometry_reply != NULL)
-		window->has_alpha = geometry_reply->depth == 32;
-	free(geometry_reply);
+	/* Get the properties on their way now, so they're most likely
+	 * in by the time the window is mapped. */
+	weston_wm_window_fetch_properties(window);
 
 	hash_table_insert(wm->window_hash, id, window);
 }
@@ -1103,6 +1306,8 @@ weston_wm_window_destroy(struct weston_wm_window *window)
 {
 	struct weston_wm *wm = window->wm;
 
+	weston_wm_window_discard_fetch(window);
+
 	if (window->repaint_source)
 		wl_event_source_remove(window->repaint_source);
 	if (window->cairo_surface)
@@ -1313,14 +1518,18 @@ weston_wm_handle_client_message(struct weston_wm *wm,
 
 	window = hash_table_lookup(wm->window_hash, client_message->window);
 
+#ifdef WM_DEBUG
+	/* The arguments are evaluated even when wm_log() drops the
+	 * message, and get_atom_name() is a round trip. */
 	wm_log("XCB_CLIENT_MESSAGE (%s %d %d %d %d %d win %d)\n",
-	       get_atom_name(wm->conn, client_message->type),
+	       get_atom_name(wm, client_message->type),
 	       client_message->data.data32[0],
 	       client_message->data.data32[1],
 	       client_message->data.data32[2],
 	       client_message->data.data32[3],
 	       client_message->data.data32[4],
 	       client_message->window);
+#endif
 
 	if (client_message->type == wm->atom.net_wm_moveresize)
 		weston_wm_window_handle_moveresize(window, client_message);
@@ -1631,7 +1840,18 @@ weston_wm_handle_event(int fd, uint32_t mask, void *data)
 	xcb_generic_event_t *event;
 	int count = 0;
 
-	while (event = xcb_poll_for_event(wm->conn), event != NULL) {
+	/* Replies can arrive with no event behind them, and reading them
+	 * may queue more events, so keep going until neither makes
+	 * progress. */
+	while (event = xcb_poll_for_event(wm->conn),
+	       event != NULL || weston_wm_process_replies(wm) > 0) {
+		if (event == NULL)
+			continue;
+
+		/* Any reply that arrived ahead of this event is queued
+		 * by now; handle it first so the event sees its values. */
+		weston_wm_process_replies(wm);
+
 		if (weston_wm_handle_selection_event(wm, event)) {
 			free(event);
 			count++;
@@ -1934,6 +2154,7 @@ weston_wm_create(struct weston_xserver *wxs)
 		return NULL;
 
 	wm->server = wxs;
+	wl_list_init(&wm->fetch_list);
 	wm->window_hash = hash_table_create();
 	if (wm->window_hash == NULL) {
 		free(wm);
@@ -2018,6 +2239,11 @@ weston_wm_create(struct weston_xserver *wxs)
 	weston_wm_create_cursors(wm);
 	weston_wm_window_set_cursor(wm, wm->screen->root, XWM_CURSOR_LEFT_PTR);
 
+	wm->round_trip_binding =
+		weston_compositor_add_debug_binding(wxs->compositor, KEY_X,
+						    weston_wm_round_trip_binding,
+						    wm);
+
 	weston_log("created wm\n");
 
 	return wm;
@@ -2026,6 +2252,13 @@ weston_wm_create(struct weston_xserver *wxs)
 void
 weston_wm_destroy(struct weston_wm *wm)
 {
+	if (wm->round_trips.second > wm->round_trips.peak)
+		wm->round_trips.peak = wm->round_trips.second;
+	weston_log("xwm: %u blocking round trips, at most %u per second\n",
+		   wm->round_trips.total, wm->round_trips.peak);
+	if (wm->round_trip_binding)
+		weston_binding_destroy(wm->round_trip_binding);
+
 	/* FIXME: Free windows in hash. */
 	hash_table_destroy(wm->window_hash);
 	weston_wm_destroy_cursors(wm);
@@ -2261,7 +2494,10 @@ xserver_set_window_id(struct wl_client *client, struct wl_resource *resource,
 
 	wm_log("set_window_id %d for surface %p\n", id, surface);
 
-	weston_wm_window_read_properties(window);
+	/* Override-redirect windows never go through MapRequest, so
+	 * this may be the first time we need their properties. */
+	if (window->fetching && !window->fetched)
+		weston_wm_window_finish_fetch(window, 1);
 
 	/* A weston_wm_window may have many different surfaces assigned
 	 * throughout its life, so we must make sure to remove the listener
@@ -75,6 +75,8 @@ struct weston_wm {
 	xcb_get_property_reply_t *property_reply;
 	int property_start;
 	struct wl_array source_data;
+	uint32_t incr_chunk_size;
+	uint32_t incr_chunk_max;
 	xcb_selection_request_event_t selection_request;
 	xcb_atom_t selection_target;
 	xcb_timestamp_t selection_timestamp;
@@ -85,6 +87,17 @@ struct weston_wm {
 	xcb_window_t dnd_window;
 	xcb_window_t dnd_owner;
 
+	/* Windows with property requests in flight, in request order. */
+	struct wl_list fetch_list;
+
+	struct {
+		uint32_t total;
+		uint32_t peak;
+		uint32_t second;
+		uint32_t second_start;
+	} round_trips;
+	struct weston_binding *round_trip_binding;
+
 	struct {
 		xcb_atom_t		 wm_protocols;
 		xcb_atom_t		 wm_normal_hints;
@@ -150,7 +163,10 @@ dump_property(struct weston_wm *wm, xcb_atom_t property,
 	      xcb_get_property_reply_t *reply);
 
 const char *
-get_atom_name(xcb_connection_t *c, xcb_atom_t atom);
+get_atom_name(struct weston_wm *wm, xcb_atom_t atom);
+
+void
+weston_wm_count_round_trip(struct weston_wm *wm);
 
 void
 weston_wm_selection_init(struct weston_wm *wm);
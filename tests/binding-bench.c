@@ -0,0 +1,179 @@
+/*
+ * Copyright © 2014 Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <linux/input.h>
+
+#include "module-bench.h"
+
+/*
+ * Binding dispatch benchmark.  Registers growing numbers of key and
+ * button bindings spread over the usual modifier combinations, then
+ * times weston_compositor_run_key_binding() for keys that match no
+ * binding, as when typing, and weston_compositor_run_button_binding()
+ * for a button that matches exactly one.
+ */
+
+#define BENCH_ITERATIONS 200000
+
+static const uint32_t bench_modifiers[] = {
+	0,
+	MODIFIER_SUPER,
+	MODIFIER_SUPER | MODIFIER_SHIFT,
+	MODIFIER_CTRL | MODIFIER_ALT,
+};
+
+static const int bench_sizes[] = { 8, 32, 128, 512 };
+
+struct binding_bench {
+	struct module_bench base;
+	struct weston_binding **bindings;
+	int n_bindings;
+	int hits;
+};
+
+static void
+bench_key_handler(struct weston_seat *seat, uint32_t time, uint32_t key,
+		  void *data)
+{
+	struct binding_bench *bench = data;
+
+	bench->hits++;
+}
+
+static void
+bench_button_handler(struct weston_seat *seat, uint32_t time,
+		     uint32_t button, void *data)
+{
+	struct binding_bench *bench = data;
+
+	bench->hits++;
+}
+
+static void
+bench_add_bindings(struct binding_bench *bench, int count)
+{
+	uint32_t modifier;
+	int i, n;
+
+	for (i = bench->n_bindings; i < count; i++) {
+		n = i / 2;
+
+		/* Key bindings on the upper half of the key range, so the
+		 * typed keys below never match. */
+		if (i & 1) {
+			modifier = bench_modifiers[(n / 120) % 4];
+			bench->bindings[i] =
+				weston_compositor_add_key_binding(
+					bench->base.compositor,
+					128 + n % 120, modifier,
+					bench_key_handler, bench);
+		} else {
+			modifier = bench_modifiers[(n / 64) % 4];
+			bench->bindings[i] =
+				weston_compositor_add_button_binding(
+					bench->base.compositor,
+					BTN_MISC + n % 64, modifier,
+					bench_button_handler, bench);
+		}
+	}
+
+	bench->n_bindings = count;
+}
+
+static void
+bench_measure(struct binding_bench *bench)
+{
+	struct weston_compositor *compositor = bench->base.compositor;
+	double start, key_time, button_time;
+	int i;
+
+	bench->base.seat.modifier_state = 0;
+
+	start = module_bench_now_usec();
+	for (i = 0; i < BENCH_ITERATIONS; i++)
+		weston_compositor_run_key_binding(compositor,
+						  &bench->base.seat, i,
+						  KEY_A + i % 26,
+						  WL_KEYBOARD_KEY_STATE_PRESSED);
+	key_time = module_bench_now_usec() - start;
+
+	bench->hits = 0;
+
+	start = module_bench_now_usec();
+	for (i = 0; i < BENCH_ITERATIONS; i++)
+		weston_compositor_run_button_binding(compositor,
+						     &bench->base.seat, i,
+						     BTN_MISC + 1,
+						     WL_POINTER_BUTTON_STATE_PRESSED);
+	button_time = module_bench_now_usec() - start;
+
+	fprintf(stderr, "%4d bindings: key miss %.3f us, button hit %.3f us "
+		"(%d hits)\n", bench->n_bindings,
+		key_time / BENCH_ITERATIONS, button_time / BENCH_ITERATIONS,
+		bench->hits);
+}
+
+static void
+bench_run(struct module_bench *base)
+{
+	struct binding_bench *bench =
+		container_of(base, struct binding_bench, base);
+	unsigned int i;
+	int max = bench_sizes[ARRAY_LENGTH(bench_sizes) - 1];
+
+	bench->bindings = calloc(max, sizeof *bench->bindings);
+	if (!bench->bindings)
+		goto out;
+
+	for (i = 0; i < ARRAY_LENGTH(bench_sizes); i++) {
+		bench_add_bindings(bench, bench_sizes[i]);
+		bench_measure(bench);
+	}
+
+	for (i = 0; i < (unsigned int) bench->n_bindings; i++)
+		weston_binding_destroy(bench->bindings[i]);
+	free(bench->bindings);
+
+out:
+	module_bench_finish(base);
+	free(bench);
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor, int *argc, char *argv[])
+{
+	struct binding_bench *bench;
+
+	bench = calloc(1, sizeof *bench);
+	if (!bench)
+		return -1;
+
+	if (module_bench_start(&bench->base, compositor, "binding-bench",
+			       bench_run) < 0) {
+		free(bench);
+		return -1;
+	}
+
+	return 0;
+}
@@ -21,6 +21,7 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <stdint.h>
 #include <string.h>
 #include <assert.h>
@@ -94,6 +95,83 @@ static const char t4[] =
 	"[bambam]\n"
 	"=not valid at all\n";
 
+static const char t5[] =
+	"# only the first occurrence of a key counts...\n"
+	"[output]\n"
+	"name=A\n"
+	"name=B\n"
+	"mode=1\n"
+	"\n"
+	"[output]\n"
+	"name=B\n"
+	"mode=2\n"
+	"\n"
+	"[output]\n"
+	"name=B\n"
+	"mode=3\n";
+
+#define MANY_SECTIONS 500
+
+/* Lots of sections sharing a few names, so every hash chain holds
+ * several candidates that must be told apart. */
+static char *
+many_sections(void)
+{
+	char *text, *p;
+	int i, j;
+
+	text = malloc(MANY_SECTIONS * 128);
+	assert(text);
+
+	p = text;
+	for (i = 0; i < MANY_SECTIONS; i++) {
+		p += sprintf(p, "[section%d]\n", i % 7);
+		p += sprintf(p, "id=%d\n", i);
+		for (j = 0; j < 3; j++)
+			p += sprintf(p, "key%d=%d\n", j, (i + j) % 11);
+	}
+
+	return text;
+}
+
+static void
+check_many_sections(struct weston_config *config)
+{
+	struct weston_config_section *section;
+	char name[32], value[32];
+	int32_t n;
+	int i, j, r;
+
+	for (i = 0; i < MANY_SECTIONS; i++) {
+		snprintf(name, sizeof name, "section%d", i % 7);
+		snprintf(value, sizeof value, "%d", i);
+		section = weston_config_get_section(config, name, "id", value);
+		assert(section);
+		r = weston_config_section_get_int(section, "id", &n, -1);
+		assert(r == 0 && n == i);
+
+		/* The first section of that name whose key0 matches. */
+		for (j = i % 7; j < MANY_SECTIONS; j += 7)
+			if (j % 11 == i % 11)
+				break;
+		snprintf(value, sizeof value, "%d", i % 11);
+		section = weston_config_get_section(config, name, "key0",
+						    value);
+		assert(section);
+		r = weston_config_section_get_int(section, "id", &n, -1);
+		assert(r == 0 && n == j);
+	}
+
+	section = weston_config_get_section(config, "section3", NULL, NULL);
+	r = weston_config_section_get_int(section, "id", &n, -1);
+	assert(r == 0 && n == 3);
+
+	section = weston_config_get_section(config, "section7", NULL, NULL);
+	assert(section == NULL);
+	section = weston_config_get_section(config, "section1", "id", "2");
+	assert(section == NULL);
+}
+
 int main(int argc, char *argv[])
 {
 	struct weston_config *config;
@@ -184,6 +262,38 @@ int main(int argc, char *argv[])
 
 	weston_config_destroy(config);
 
+	config = run_test(t5);
+	assert(config);
+	section = weston_config_get_section(config, "output", NULL, NULL);
+	r = weston_config_section_get_string(section, "name", &s, NULL);
+	assert(r == 0 && strcmp(s, "A") == 0);
+	free(s);
+
+	section = weston_config_get_section(config, "output", "name", "B");
+	r = weston_config_section_get_int(section, "mode", &n, 0);
+	assert(r == 0 && n == 2);
+
+	section = weston_config_get_section(config, "output", "mode", "3");
+	r = weston_config_section_get_string(section, "name", &s, NULL);
+	assert(r == 0 && strcmp(s, "B") == 0);
+	free(s);
+
+	section = NULL;
+	weston_config_next_section(config, &section, &name);
+	assert(weston_config_section_equal(section, section));
+	assert(!weston_config_section_equal(section, NULL));
+	weston_config_next_section(config, &section, &name);
+	assert(!weston_config_section_equal(section,
+		weston_config_get_section(config, "output", "mode", "3")));
+	weston_config_destroy(config);
+
+	s = many_sections();
+	config = run_test(s);
+	free(s);
+	assert(config);
+	check_many_sections(config);
+	weston_config_destroy(config);
+
 	config = run_test(t2);
 	assert(config == NULL);
 
@@ -0,0 +1,142 @@
+/*
+ * Copyright © 2014 Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+
+#include "../src/filter.h"
+
+#define TRACE_LENGTH 4096
+
+static volatile int running;
+
+static struct timespec begin_time;
+
+static void
+reset_timer(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &begin_time);
+}
+
+static double
+read_timer(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)(t.tv_sec - begin_time.tv_sec) +
+	       1e-9 * (t.tv_nsec - begin_time.tv_nsec);
+}
+
+static void
+stopme(int n)
+{
+	running = 0;
+}
+
+struct trace_event {
+	double dx, dy;
+};
+
+static struct trace_event trace[TRACE_LENGTH];
+
+static const double constant_factor = 50.0 / 4000.0;
+static const double min_factor = 0.16;
+static const double max_factor = 1.0;
+
+static double
+bench_profile(struct weston_motion_filter *filter,
+	      void *data, double velocity, uint32_t time)
+{
+	double factor = velocity * constant_factor;
+
+	if (factor > max_factor)
+		factor = max_factor;
+	else if (factor < min_factor)
+		factor = min_factor;
+
+	return factor;
+}
+
+static void __attribute__((noinline))
+test_loop_speed(const char *name, struct weston_motion_filter *filter)
+{
+	struct weston_motion_params motion;
+	unsigned long count = 0;
+	uint32_t time = 0;
+	double sum = 0.0;
+	double t;
+
+	printf("\nRunning 3 s test on %s...\n", name);
+
+	running = 1;
+	alarm(3);
+	reset_timer();
+	while (running) {
+		/* 125 Hz events, the rate of a typical touchpad */
+		time += 8;
+		motion.dx = trace[count % TRACE_LENGTH].dx;
+		motion.dy = trace[count % TRACE_LENGTH].dy;
+		weston_filter_dispatch(filter, &motion, NULL, time);
+		sum += motion.dx + motion.dy;
+		count++;
+	}
+	t = read_timer();
+
+	printf("%lu events in %f seconds, %.2f Mevents/s, "
+	       "%.1f ns/event (checksum %g).\n",
+	       count, t, count / t / 1e6, 1e9 * t / count, sum);
+}
+
+int main(void)
+{
+	struct sigaction ding;
+	struct weston_motion_filter *filter;
+	int i;
+
+	ding.sa_handler = stopme;
+	sigemptyset(&ding.sa_mask);
+	ding.sa_flags = 0;
+	sigaction(SIGALRM, &ding, NULL);
+
+	srandom(37);
+	for (i = 0; i < TRACE_LENGTH; i++) {
+		trace[i].dx = (random() % 9) - 4;
+		trace[i].dy = (random() % 9) - 4;
+	}
+
+	filter = create_pointer_accelator_filter(bench_profile);
+	test_loop_speed("profile callback", filter);
+	filter->interface->destroy(filter);
+
+	filter = create_pointer_accelator_filter_clamped(constant_factor,
+							 min_factor,
+							 max_factor);
+	test_loop_speed("clamped profile", filter);
+	filter->interface->destroy(filter);
+
+	return 0;
+}
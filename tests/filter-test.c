@@ -0,0 +1,375 @@
+/*
+ * Copyright © 2014 Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "weston-test-runner.h"
+
+#include "../src/filter.h"
+
+/*
+ * Reference copy of the tracker based accelerator as it was before the
+ * trackers were moved into a fixed structure of arrays. Both
+ * implementations are fed the same traces and must produce the same
+ * deltas.
+ */
+
+#define REF_MAX_VELOCITY_DIFF	1.0
+#define REF_MOTION_TIMEOUT	300
+#define REF_NUM_TRACKERS	16
+
+struct ref_tracker {
+	double dx;
+	double dy;
+	uint32_t time;
+	int dir;
+};
+
+struct ref_accelerator {
+	double constant_factor;
+	double min_factor;
+	double max_factor;
+
+	double last_velocity;
+	int last_dx;
+	int last_dy;
+
+	struct ref_tracker trackers[REF_NUM_TRACKERS];
+	int cur_tracker;
+};
+
+static int
+ref_get_direction(int dx, int dy)
+{
+	int dir = 0xff;
+	int d1, d2;
+	double r;
+
+	if (abs(dx) < 2 && abs(dy) < 2) {
+		if (dx > 0 && dy > 0)
+			dir = (1 << 4) | (1 << 3) | (1 << 2);
+		else if (dx > 0 && dy < 0)
+			dir = (1 << 0) | (1 << 1) | (1 << 2);
+		else if (dx < 0 && dy > 0)
+			dir = (1 << 4) | (1 << 5) | (1 << 6);
+		else if (dx < 0 && dy < 0)
+			dir = (1 << 0) | (1 << 7) | (1 << 6);
+		else if (dx > 0)
+			dir = (1 << 7) | (1 << 6) | (1 << 5);
+		else if (dx < 0)
+			dir = (1 << 1) | (1 << 2) | (1 << 3);
+		else if (dy > 0)
+			dir = (1 << 3) | (1 << 4) | (1 << 5);
+		else if (dy < 0)
+			dir = (1 << 1) | (1 << 0) | (1 << 7);
+	} else {
+		r = atan2(dy, dx);
+		r = fmod(r + 2.5*M_PI, 2*M_PI);
+		r *= 4*M_1_PI;
+
+		d1 = (int)(r + 0.9) % 8;
+		d2 = (int)(r + 0.1) % 8;
+
+		dir = (1 << d1) | (1 << d2);
+	}
+
+	return dir;
+}
+
+static struct ref_tracker *
+ref_tracker_by_offset(struct ref_accelerator *accel, unsigned int offset)
+{
+	unsigned int index =
+		(accel->cur_tracker + REF_NUM_TRACKERS - offset)
+		% REF_NUM_TRACKERS;
+	return &accel->trackers[index];
+}
+
+static double
+ref_tracker_velocity(struct ref_tracker *tracker, uint32_t time)
+{
+	int dx = tracker->dx;
+	int dy = tracker->dy;
+
+	return sqrt(dx*dx + dy*dy) / (double)(time - tracker->time);
+}
+
+static double
+ref_velocity(struct ref_accelerator *accel, uint32_t time)
+{
+	struct ref_tracker *tracker;
+	double velocity, result = 0.0, initial_velocity;
+	unsigned int offset;
+	unsigned int dir = ref_tracker_by_offset(accel, 0)->dir;
+
+	for (offset = 1; offset < REF_NUM_TRACKERS; offset++) {
+		tracker = ref_tracker_by_offset(accel, offset);
+		if (time <= tracker->time)
+			continue;
+		result = initial_velocity =
+			ref_tracker_velocity(tracker, time);
+		if (initial_velocity > 0.0)
+			break;
+	}
+
+	for (; offset < REF_NUM_TRACKERS; offset++) {
+		tracker = ref_tracker_by_offset(accel, offset);
+		if (time - tracker->time > REF_MOTION_TIMEOUT ||
+		    tracker->time > time)
+			break;
+		dir &= tracker->dir;
+		if (dir == 0)
+			break;
+		velocity = ref_tracker_velocity(tracker, time);
+		if (fabs(initial_velocity - velocity) > REF_MAX_VELOCITY_DIFF)
+			break;
+		result = velocity;
+	}
+
+	return result;
+}
+
+static double
+ref_profile(struct ref_accelerator *accel, double velocity)
+{
+	double factor = velocity * accel->constant_factor;
+
+	if (factor > accel->max_factor)
+		factor = accel->max_factor;
+	else if (factor < accel->min_factor)
+		factor = accel->min_factor;
+
+	return factor;
+}
+
+static double
+ref_soften_delta(double last_delta, double delta)
+{
+	if (delta < -1.0 || delta > 1.0) {
+		if (delta > last_delta)
+			return delta - 0.5;
+		else if (delta < last_delta)
+			return delta + 0.5;
+	}
+
+	return delta;
+}
+
+static void
+ref_filter(struct ref_accelerator *accel,
+	   struct weston_motion_params *motion, uint32_t time)
+{
+	double velocity, factor;
+	int i, current;
+
+	for (i = 0; i < REF_NUM_TRACKERS; i++) {
+		accel->trackers[i].dx += motion->dx;
+		accel->trackers[i].dy += motion->dy;
+	}
+	current = (accel->cur_tracker + 1) % REF_NUM_TRACKERS;
+	accel->cur_tracker = current;
+	accel->trackers[current].dx = 0.0;
+	accel->trackers[current].dy = 0.0;
+	accel->trackers[current].time = time;
+	accel->trackers[current].dir =
+		ref_get_direction(motion->dx, motion->dy);
+
+	velocity = ref_velocity(accel, time);
+
+	factor = ref_profile(accel, velocity);
+	factor += ref_profile(accel, accel->last_velocity);
+	factor += 4.0 * ref_profile(accel,
+				    (accel->last_velocity + velocity) / 2);
+	factor = factor / 6.0;
+
+	motion->dx = factor * motion->dx;
+	motion->dy = factor * motion->dy;
+	motion->dx = ref_soften_delta(accel->last_dx, motion->dx);
+	motion->dy = ref_soften_delta(accel->last_dy, motion->dy);
+
+	accel->last_dx = motion->dx;
+	accel->last_dy = motion->dy;
+	accel->last_velocity = velocity;
+}
+
+/*
+ * Traces
+ */
+
+struct trace_event {
+	double dx, dy;
+	uint32_t time;
+};
+
+/* A short touchpad swipe: slow start, fast middle, a hook at the end
+ * and a pause long enough to time out every tracker. */
+static const struct trace_event swipe_trace[] = {
+	{ 1, 0, 1000 }, { 1, 0, 1012 }, { 2, 1, 1024 }, { 3, 1, 1036 },
+	{ 6, 2, 1048 }, { 11, 3, 1060 }, { 18, 5, 1072 }, { 24, 7, 1084 },
+	{ 27, 8, 1096 }, { 25, 9, 1108 }, { 19, 11, 1120 }, { 12, 12, 1132 },
+	{ 6, 14, 1144 }, { 2, 13, 1156 }, { -1, 9, 1168 }, { -2, 4, 1180 },
+	{ -1, 1, 1192 }, { 0, 1, 1204 }, { 0, 0, 1216 }, { 1, 1, 1800 },
+	{ 2, 2, 1812 }, { 3, 2, 1824 }, { 2, 1, 1836 }, { 1, 0, 1848 },
+};
+
+/* Back and forth scrubbing, exercising the direction filter and
+ * repeated timestamps. */
+static const struct trace_event scrub_trace[] = {
+	{ 4, 0, 5000 }, { 5, 0, 5008 }, { 4, 1, 5016 }, { -3, 0, 5024 },
+	{ -6, -1, 5032 }, { -5, 0, 5040 }, { 3, 0, 5048 }, { 6, 1, 5048 },
+	{ 7, 0, 5056 }, { -2, 0, 5064 }, { -8, 0, 5072 }, { -8, -1, 5080 },
+	{ 0, 5, 5088 }, { 0, 7, 5096 }, { 0, -7, 5104 }, { 1, -1, 5112 },
+	{ -1, 1, 5120 }, { 1, 0, 5128 }, { 0, -1, 5136 }, { -1, 0, 5144 },
+};
+
+/* Timestamps wrapping around the 32 bit millisecond counter. */
+static const struct trace_event wrap_trace[] = {
+	{ 3, 3, 0xffffffd0 }, { 4, 3, 0xffffffdc }, { 5, 4, 0xffffffe8 },
+	{ 6, 4, 0xfffffff4 }, { 6, 5, 0x00000000 }, { 7, 5, 0x0000000c },
+	{ 6, 4, 0x00000018 }, { 4, 3, 0x00000024 }, { 2, 1, 0x00000030 },
+};
+
+struct profile_params {
+	double constant_factor;
+	double min_factor;
+	double max_factor;
+};
+
+/* The touchpad defaults for a few pad diagonals, plus an inverted
+ * clamp to pin down which bound wins. */
+static const struct profile_params profiles[] = {
+	{ 50.0 / 4000.0, 0.16, 1.0 },
+	{ 50.0 / 1500.0, 0.16, 1.0 },
+	{ 50.0 / 6000.0, 0.3, 2.5 },
+	{ 0.8, 1.5, 0.5 },
+};
+
+static double
+test_profile(struct weston_motion_filter *filter,
+	     void *data, double velocity, uint32_t time)
+{
+	const struct profile_params *params = data;
+	double factor = velocity * params->constant_factor;
+
+	if (factor > params->max_factor)
+		factor = params->max_factor;
+	else if (factor < params->min_factor)
+		factor = params->min_factor;
+
+	return factor;
+}
+
+static void
+check_trace(const struct trace_event *trace, int count)
+{
+	struct weston_motion_filter *callback, *clamped;
+	struct ref_accelerator ref;
+	struct weston_motion_params expected, a, b;
+	const struct profile_params *params;
+	unsigned int p;
+	int i;
+
+	for (p = 0; p < ARRAY_LENGTH(profiles); p++) {
+		params = &profiles[p];
+
+		memset(&ref, 0, sizeof ref);
+		ref.constant_factor = params->constant_factor;
+		ref.min_factor = params->min_factor;
+		ref.max_factor = params->max_factor;
+
+		callback = create_pointer_accelator_filter(test_profile);
+		clamped = create_pointer_accelator_filter_clamped(
+			params->constant_factor,
+			params->min_factor,
+			params->max_factor);
+		assert(callback && clamped);
+
+		for (i = 0; i < count; i++) {
+			expected.dx = a.dx = b.dx = trace[i].dx;
+			expected.dy = a.dy = b.dy = trace[i].dy;
+
+			ref_filter(&ref, &expected, trace[i].time);
+			weston_filter_dispatch(callback, &a, (void *) params,
+					       trace[i].time);
+			weston_filter_dispatch(clamped, &b, NULL,
+					       trace[i].time);
+
+			assert(fabs(a.dx - expected.dx) < 1e-9);
+			assert(fabs(a.dy - expected.dy) < 1e-9);
+			assert(fabs(b.dx - expected.dx) < 1e-9);
+			assert(fabs(b.dy - expected.dy) < 1e-9);
+		}
+
+		callback->interface->destroy(callback);
+		clamped->interface->destroy(clamped);
+	}
+}
+
+TEST(filter_swipe_trace)
+{
+	check_trace(swipe_trace, ARRAY_LENGTH(swipe_trace));
+}
+
+TEST(filter_scrub_trace)
+{
+	check_trace(scrub_trace, ARRAY_LENGTH(scrub_trace));
+}
+
+TEST(filter_wrap_trace)
+{
+	check_trace(wrap_trace, ARRAY_LENGTH(wrap_trace));
+}
+
+TEST(filter_random_trace)
+{
+	struct trace_event *trace;
+	uint32_t time = 20000;
+	int i, n = 20000;
+
+	trace = malloc(n * sizeof *trace);
+	assert(trace);
+
+	srandom(37);
+	for (i = 0; i < n; i++) {
+		/* Mostly small deltas at 125 Hz, with the occasional fast
+		 * flick and idle gap. */
+		trace[i].dx = (random() % 9) - 4;
+		trace[i].dy = (random() % 9) - 4;
+		if (random() % 16 == 0) {
+			trace[i].dx *= 10;
+			trace[i].dy *= 10;
+		}
+		time += 8;
+		if (random() % 64 == 0)
+			time += random() % 500;
+		trace[i].time = time;
+	}
+
+	check_trace(trace, n);
+
+	free(trace);
+}
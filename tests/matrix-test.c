@@ -22,6 +22,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <unistd.h>
 #include <signal.h>
@@ -29,6 +30,8 @@
 
 #include "../shared/matrix.h"
 
+#define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
+
 struct inverse_matrix {
 	double LU[16];		/* column-major */
 	unsigned perm[4];	/* permutation */
@@ -238,6 +241,91 @@ test(void)
 	return TEST_FAIL;
 }
 
+/* Compare the dispatched kernels against a double precision reference.
+ * The tolerance is relative to the magnitude of the summed terms, so
+ * it holds whether or not the kernel fuses multiply and add.
+ */
+static int
+check_transform(const struct weston_matrix *m, const float *in,
+		const float *out)
+{
+	unsigned i, j;
+	double ref, mag;
+
+	for (i = 0; i < 4; ++i) {
+		ref = mag = 0.0;
+		for (j = 0; j < 4; ++j) {
+			ref += (double)m->d[i + j * 4] * in[j];
+			mag += fabs((double)m->d[i + j * 4] * in[j]);
+		}
+
+		if (fabs(out[i] - ref) > 1e-5 * mag) {
+			printf("row %u: got %g, expected %g\n", i, out[i], ref);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int
+test_kernels(void)
+{
+	struct weston_matrix m, n, mn;
+	struct weston_vector v[37], orig[37];
+	unsigned i, k;
+	int fail = 0;
+
+	printf("\nChecking matrix kernels against the reference...\n");
+
+	for (k = 0; k < 10000; ++k) {
+		randomize_matrix(&m);
+		randomize_matrix(&n);
+		m.type = WESTON_MATRIX_TRANSFORM_SCALE;
+		n.type = WESTON_MATRIX_TRANSFORM_ROTATE;
+
+		for (i = 0; i < 37; ++i) {
+			v[i].f[0] = frand() * 4096.0;
+			v[i].f[1] = frand() * 4096.0;
+			v[i].f[2] = frand();
+			v[i].f[3] = 1.0f + frand() * 0.5;
+		}
+		memcpy(orig, v, sizeof v);
+
+		/* odd count, so no kernel can assume pairs of points */
+		weston_matrix_transform_points(&m, v, 37);
+		for (i = 0; i < 37; ++i)
+			fail |= check_transform(&m, orig[i].f, v[i].f);
+
+		memcpy(v, orig, sizeof v);
+		weston_matrix_transform(&m, &v[0]);
+		fail |= check_transform(&m, orig[0].f, v[0].f);
+
+		mn = m;
+		weston_matrix_multiply(&mn, &n);
+		for (i = 0; i < 4; ++i)
+			fail |= check_transform(&n, &m.d[i * 4], &mn.d[i * 4]);
+		if (mn.type != (m.type | n.type))
+			fail = -1;
+
+		/* multiplying a matrix by itself must not read partial
+		 * results */
+		n = m;
+		weston_matrix_multiply(&n, &n);
+		for (i = 0; i < 4; ++i)
+			fail |= check_transform(&m, &m.d[i * 4], &n.d[i * 4]);
+
+		if (fail) {
+			printf("kernel check failed on iteration %u\n", k);
+			return -1;
+		}
+	}
+
+	printf("ok.\n");
+
+	return 0;
+}
+
 static int running;
 static void
 stopme(int n)
@@ -290,6 +378,91 @@ test_loop_speed_matrixvector(void)
 	       count, t, 1e9 * t / count);
 }
 
+static double __attribute__((noinline))
+speed_transform_points(const char *name, struct weston_matrix *m,
+		       struct weston_vector *v, unsigned int count,
+		       void (*func)(const float *, float *, unsigned int))
+{
+	unsigned long n = 0;
+	double t;
+
+	running = 1;
+	alarm(1);
+	reset_timer();
+	while (running) {
+		if (func)
+			func(m->d, v->f, count);
+		else
+			weston_matrix_transform_points(m, v, count);
+		n += count;
+	}
+	t = read_timer();
+
+	printf("  %-10s %lu points in %f seconds, avg. %.2f ns/point.\n",
+	       name, n, t, 1e9 * t / n);
+
+	return t / n;
+}
+
+static void __attribute__((noinline))
+test_loop_speed_transform_points(void)
+{
+	static const unsigned int counts[] = { 1, 4, 8, 64 };
+	struct weston_vector v[64];
+	struct weston_matrix m;
+	double scalar, batch;
+	unsigned i;
+
+	printf("\nRunning 1 s tests on weston_matrix_transform_points()...\n");
+
+	/* a rotation with a perspective term keeps the values bounded */
+	weston_matrix_init(&m);
+	weston_matrix_rotate_xy(&m, 0.6f, 0.8f);
+	m.d[3] = 1e-9f;
+
+	for (i = 0; i < 64; ++i) {
+		v[i].f[0] = i;
+		v[i].f[1] = -(float)i;
+		v[i].f[2] = 0.0f;
+		v[i].f[3] = 1.0f;
+	}
+
+	for (i = 0; i < ARRAY_LENGTH(counts); ++i) {
+		printf("batches of %u:\n", counts[i]);
+		scalar = speed_transform_points("scalar", &m, v, counts[i],
+						matrix_transform_points_scalar);
+		batch = speed_transform_points("dispatched", &m, v, counts[i],
+					       NULL);
+		printf("  speedup %.2fx\n", scalar / batch);
+	}
+}
+
+static void __attribute__((noinline))
+test_loop_speed_multiply(void)
+{
+	struct weston_matrix m, n;
+	unsigned long count = 0;
+	double t;
+
+	printf("\nRunning 3 s test on weston_matrix_multiply()...\n");
+
+	weston_matrix_init(&m);
+	weston_matrix_init(&n);
+	weston_matrix_rotate_xy(&n, 0.6f, 0.8f);
+
+	running = 1;
+	alarm(3);
+	reset_timer();
+	while (running) {
+		weston_matrix_multiply(&m, &n);
+		count++;
+	}
+	t = read_timer();
+
+	printf("%lu iterations in %f seconds, avg. %.1f ns/iter.\n",
+	       count, t, 1e9 * t / count);
+}
+
 static void __attribute__((noinline))
 test_loop_speed_inversetransform(void)
 {
@@ -409,8 +582,13 @@ int main(void)
 	print_matrix(&M);
 	printf("max abs error: %g, original determinant %g\n", errsup, det);
 
+	if (test_kernels() != 0)
+		return 1;
+
 	test_loop_precision();
 	test_loop_speed_matrixvector();
+	test_loop_speed_transform_points();
+	test_loop_speed_multiply();
 	test_loop_speed_inversetransform();
 	test_loop_speed_invert();
 	test_loop_speed_invert_explicit();
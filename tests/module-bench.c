@@ -0,0 +1,70 @@
+/*
+ * Copyright © 2014 Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <time.h>
+
+#include "module-bench.h"
+
+static void
+module_bench_idle(void *data)
+{
+	struct module_bench *bench = data;
+
+	weston_seat_init(&bench->seat, bench->compositor, bench->name);
+	bench->run(bench);
+}
+
+int
+module_bench_start(struct module_bench *bench,
+		   struct weston_compositor *compositor,
+		   const char *name, module_bench_run_t run)
+{
+	struct wl_event_loop *loop;
+
+	bench->compositor = compositor;
+	bench->name = name;
+	bench->run = run;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	if (!wl_event_loop_add_idle(loop, module_bench_idle, bench))
+		return -1;
+
+	return 0;
+}
+
+void
+module_bench_finish(struct module_bench *bench)
+{
+	weston_seat_release(&bench->seat);
+	wl_display_terminate(bench->compositor->wl_display);
+}
+
+double
+module_bench_now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright © 2014 Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#ifndef _MODULE_BENCH_H_
+#define _MODULE_BENCH_H_
+
+#include "../src/compositor.h"
+
+/*
+ * Fixture for the benchmarks that run inside the compositor as a
+ * module, started with
+ *
+ *   ./weston-tests-env foo-bench.la
+ *
+ * module_bench_start() defers the run until the compositor is up and
+ * gives it a private seat without capabilities.  The bench adds the
+ * capabilities it needs, and calls module_bench_finish() when it is
+ * done, possibly from a later event loop callback.  That releases the
+ * seat and quits weston.  Results are reported in microseconds.
+ */
+
+struct module_bench;
+
+typedef void (*module_bench_run_t)(struct module_bench *bench);
+
+struct module_bench {
+	struct weston_compositor *compositor;
+	struct weston_seat seat;
+	const char *name;
+	module_bench_run_t run;
+};
+
+int
+module_bench_start(struct module_bench *bench,
+		   struct weston_compositor *compositor,
+		   const char *name, module_bench_run_t run);
+
+void
+module_bench_finish(struct module_bench *bench);
+
+double
+module_bench_now_usec(void);
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * Copyright © 2014 Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "module-bench.h"
+
+/*
+ * Motion coalescing benchmark.  Feeds relative motion into a private
+ * seat at 1000 Hz, first with coalescing off and then on, and reports
+ * how many motion events reached the pointer grab and how long the
+ * injected events waited for delivery.
+ */
+
+#define BENCH_EVENTS 2000
+
+struct motion_bench {
+	struct module_bench base;
+	struct weston_pointer_grab grab;
+	struct wl_event_source *timer;
+
+	int coalesce;
+	int injected;
+	int delivered_upto;
+	int deliveries;
+	double inject_time[BENCH_EVENTS];
+	double latency_sum, latency_max;
+	double notify_time;
+};
+
+static void
+bench_grab_focus(struct weston_pointer_grab *grab)
+{
+}
+
+static void
+bench_grab_motion(struct weston_pointer_grab *grab, uint32_t time)
+{
+	struct motion_bench *bench =
+		container_of(grab, struct motion_bench, grab);
+	double now = module_bench_now_usec(), latency;
+
+	bench->deliveries++;
+	for (; bench->delivered_upto < bench->injected;
+	     bench->delivered_upto++) {
+		latency = now - bench->inject_time[bench->delivered_upto];
+		bench->latency_sum += latency;
+		if (latency > bench->latency_max)
+			bench->latency_max = latency;
+	}
+}
+
+static void
+bench_grab_button(struct weston_pointer_grab *grab,
+		  uint32_t time, uint32_t button, uint32_t state)
+{
+}
+
+static void
+bench_grab_cancel(struct weston_pointer_grab *grab)
+{
+}
+
+static const struct weston_pointer_grab_interface bench_grab_interface = {
+	bench_grab_focus,
+	bench_grab_motion,
+	bench_grab_button,
+	bench_grab_cancel,
+};
+
+static void
+bench_report(struct motion_bench *bench)
+{
+	fprintf(stderr, "coalescing %s: %d events, %d deliveries, "
+		"latency mean %.0f us max %.0f us, %.2f us per notify\n",
+		bench->coalesce ? "on " : "off",
+		bench->injected, bench->deliveries,
+		bench->latency_sum / bench->injected, bench->latency_max,
+		bench->notify_time / bench->injected);
+}
+
+static void
+bench_start(struct motion_bench *bench, int coalesce)
+{
+	bench->coalesce = coalesce;
+	bench->base.compositor->coalesce_motion = coalesce;
+	bench->injected = 0;
+	bench->delivered_upto = 0;
+	bench->deliveries = 0;
+	bench->latency_sum = 0;
+	bench->latency_max = 0;
+	bench->notify_time = 0;
+
+	wl_event_source_timer_update(bench->timer, 1);
+}
+
+static int
+bench_tick(void *data)
+{
+	struct motion_bench *bench = data;
+	double start;
+
+	if (bench->injected == BENCH_EVENTS) {
+		/* Let the last coalesced motion go out. */
+		weston_compositor_flush_motion(bench->base.compositor);
+		bench_report(bench);
+
+		if (!bench->coalesce) {
+			bench_start(bench, 1);
+			return 1;
+		}
+
+		weston_pointer_end_grab(bench->base.seat.pointer);
+		wl_event_source_remove(bench->timer);
+		module_bench_finish(&bench->base);
+		free(bench);
+		return 1;
+	}
+
+	start = module_bench_now_usec();
+	bench->inject_time[bench->injected++] = start;
+	notify_motion(&bench->base.seat, (uint32_t) (start / 1000),
+		      wl_fixed_from_int(bench->injected & 1 ? 1 : -1), 0);
+	bench->notify_time += module_bench_now_usec() - start;
+
+	wl_event_source_timer_update(bench->timer, 1);
+
+	return 1;
+}
+
+static void
+bench_run(struct module_bench *base)
+{
+	struct motion_bench *bench =
+		container_of(base, struct motion_bench, base);
+	struct wl_event_loop *loop;
+
+	loop = wl_display_get_event_loop(base->compositor->wl_display);
+	bench->timer = wl_event_loop_add_timer(loop, bench_tick, bench);
+
+	weston_seat_init_pointer(&base->seat);
+	bench->grab.interface = &bench_grab_interface;
+	weston_pointer_start_grab(base->seat.pointer, &bench->grab);
+
+	bench_start(bench, 0);
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor, int *argc, char *argv[])
+{
+	struct motion_bench *bench;
+
+	bench = calloc(1, sizeof *bench);
+	if (!bench)
+		return -1;
+
+	if (module_bench_start(&bench->base, compositor, "motion-bench",
+			       bench_run) < 0) {
+		free(bench);
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright © 2014 Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+
+#include "rdp-raw.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define MAX_REQUEST_SIZE 0x3f0000
+
+static volatile int running;
+
+static struct timespec begin_time;
+
+static void
+reset_timer(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &begin_time);
+}
+
+static double
+read_timer(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)(t.tv_sec - begin_time.tv_sec) +
+	       1e-9 * (t.tv_nsec - begin_time.tv_nsec);
+}
+
+static void
+stopme(int n)
+{
+	running = 0;
+}
+
+struct counter {
+	unsigned long commands;
+	unsigned long long bytes;
+};
+
+static void
+count_command(SURFACE_BITS_COMMAND *cmd, void *data)
+{
+	struct counter *counter = data;
+
+	counter->commands++;
+	counter->bytes += cmd->bitmapDataLength;
+}
+
+static void __attribute__((noinline))
+test_loop_speed_raw(const char *name, pixman_region32_t *region,
+		    pixman_image_t *image)
+{
+	struct rdp_raw_encoder raw;
+	SURFACE_BITS_COMMAND cmd;
+	struct counter counter = { 0, 0 };
+	unsigned long count = 0;
+	double t;
+
+	printf("\nRunning 3 s test on %s (%d rectangles)...\n",
+	       name, pixman_region32_n_rects(region));
+
+	rdp_raw_encoder_init(&raw);
+
+	running = 1;
+	alarm(3);
+	reset_timer();
+	while (running) {
+		rdp_raw_encode(&raw, region, image, MAX_REQUEST_SIZE,
+			       &cmd, count_command, &counter);
+		count++;
+	}
+	t = read_timer();
+
+	printf("%lu frames in %f seconds, avg. %.1f us/frame, "
+	       "%.1f commands/frame, %.1f MB/s.\n",
+	       count, t, 1e6 * t / count, (double)counter.commands / count,
+	       counter.bytes / t / (1024 * 1024));
+
+	rdp_raw_encoder_release(&raw);
+}
+
+int main(void)
+{
+	struct sigaction ding;
+	pixman_image_t *image;
+	pixman_region32_t region;
+	int i;
+
+	ding.sa_handler = stopme;
+	sigemptyset(&ding.sa_mask);
+	ding.sa_flags = 0;
+	sigaction(SIGALRM, &ding, NULL);
+
+	image = pixman_image_create_bits(PIXMAN_x8r8g8b8, WIDTH, HEIGHT,
+					 NULL, WIDTH * 4);
+
+	pixman_region32_init_rect(&region, 0, 0, WIDTH, HEIGHT);
+	test_loop_speed_raw("full screen", &region, image);
+	pixman_region32_fini(&region);
+
+	/* a terminal worth of glyph sized damage */
+	pixman_region32_init(&region);
+	for (i = 0; i < 400; i++)
+		pixman_region32_union_rect(&region, &region,
+					   (i % 80) * 10, (i / 80) * 20,
+					   8, 16);
+	test_loop_speed_raw("small rectangles", &region, image);
+	pixman_region32_fini(&region);
+
+	/* scattered cursor sized updates */
+	pixman_region32_init(&region);
+	srandom(13);
+	for (i = 0; i < 64; i++)
+		pixman_region32_union_rect(&region, &region,
+					   random() % (WIDTH - 32),
+					   random() % (HEIGHT - 32), 32, 32);
+	test_loop_speed_raw("scattered rectangles", &region, image);
+	pixman_region32_fini(&region);
+
+	pixman_image_unref(image);
+
+	return 0;
+}
@@ -0,0 +1,280 @@
+/*
+ * Copyright © 2014 Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <linux/input.h>
+
+#include "module-bench.h"
+
+/*
+ * Desktop shell scaling benchmark.  Maps growing numbers of toplevel
+ * shell surfaces and times, per operation, mapping, click to
+ * activate, stepping the Super+Tab switcher, moving the focused
+ * surface to the next workspace and back (Super+Shift+Down/Up) and
+ * switching workspaces (Super+Down/Up).  The workspace operations need
+ * num-workspaces of at least 2 in the [shell] section of weston.ini
+ * and the default Super binding modifier.
+ */
+
+#define BENCH_OPS 500
+
+static const int bench_sizes[] = { 100, 500, 1000, 2000, 5000 };
+
+struct shell_bench {
+	struct module_bench base;
+	struct weston_surface **surfaces;
+	int n_surfaces;
+	int workspaces;
+};
+
+static void
+bench_send_configure(struct weston_surface *surface,
+		     uint32_t edges, int32_t width, int32_t height)
+{
+}
+
+static const struct weston_shell_client bench_client = {
+	bench_send_configure
+};
+
+static struct weston_view *
+bench_view(struct weston_surface *surface)
+{
+	return container_of(surface->views.next, struct weston_view,
+			    surface_link);
+}
+
+static struct weston_layer *
+bench_find_layer(struct shell_bench *bench, struct weston_view *view)
+{
+	struct weston_layer *layer;
+	struct weston_view *v;
+
+	wl_list_for_each(layer, &bench->base.compositor->layer_list, link)
+		wl_list_for_each(v, &layer->view_list, layer_link)
+			if (v == view)
+				return layer;
+
+	return NULL;
+}
+
+/* Run a key binding and swallow the key release grab it leaves
+ * behind, unless the binding started its own grab. */
+static void
+bench_key(struct shell_bench *bench, uint32_t key, uint32_t modifier)
+{
+	struct weston_keyboard *keyboard = bench->base.seat.keyboard;
+
+	bench->base.seat.modifier_state = modifier;
+	weston_compositor_run_key_binding(bench->base.compositor,
+					  &bench->base.seat, 0, key,
+					  WL_KEYBOARD_KEY_STATE_PRESSED);
+	bench->base.seat.modifier_state = 0;
+
+	if (keyboard->grab != &keyboard->default_grab)
+		keyboard->grab->interface->cancel(keyboard->grab);
+}
+
+static void
+bench_click(struct shell_bench *bench, struct weston_surface *surface)
+{
+	weston_pointer_set_focus(bench->base.seat.pointer, bench_view(surface),
+				 0, 0);
+	weston_compositor_run_button_binding(bench->base.compositor,
+					     &bench->base.seat, 0, BTN_LEFT,
+					     WL_POINTER_BUTTON_STATE_PRESSED);
+}
+
+static int
+bench_map(struct shell_bench *bench, int count)
+{
+	struct weston_compositor *ec = bench->base.compositor;
+	struct weston_surface *surface;
+	struct shell_surface *shsurf;
+	int i;
+
+	for (i = bench->n_surfaces; i < count; i++) {
+		surface = weston_surface_create(ec);
+		if (!surface)
+			return -1;
+
+		shsurf = ec->shell_interface.create_shell_surface(
+			ec->shell_interface.shell, surface, &bench_client);
+		if (!shsurf) {
+			weston_surface_destroy(surface);
+			return -1;
+		}
+
+		ec->shell_interface.set_toplevel(shsurf);
+		surface->width = 64;
+		surface->height = 48;
+		surface->configure(surface, 0, 0, 64, 48);
+
+		bench->surfaces[i] = surface;
+		bench->n_surfaces = i + 1;
+	}
+
+	return 0;
+}
+
+static void
+bench_check_workspaces(struct shell_bench *bench)
+{
+	struct weston_surface *surface = bench->surfaces[0];
+	struct weston_layer *before;
+
+	bench_click(bench, surface);
+	before = bench_find_layer(bench, bench_view(surface));
+	bench_key(bench, KEY_DOWN, MODIFIER_SUPER | MODIFIER_SHIFT);
+	bench->workspaces = bench_find_layer(bench, bench_view(surface)) !=
+			    before;
+	if (bench->workspaces)
+		bench_key(bench, KEY_UP, MODIFIER_SUPER | MODIFIER_SHIFT);
+	else
+		fprintf(stderr, "only one workspace, skipping workspace "
+			"operations\n");
+}
+
+static void
+bench_measure(struct shell_bench *bench, double map_time, int mapped)
+{
+	struct weston_keyboard *keyboard = bench->base.seat.keyboard;
+	double start, activate_time, switcher_time;
+	double move_time = 0, switch_time = 0;
+	int i;
+
+	start = module_bench_now_usec();
+	for (i = 0; i < BENCH_OPS; i++)
+		bench_click(bench,
+			    bench->surfaces[rand() % bench->n_surfaces]);
+	activate_time = module_bench_now_usec() - start;
+
+	bench->base.seat.modifier_state = MODIFIER_SUPER;
+	weston_compositor_run_key_binding(bench->base.compositor,
+					  &bench->base.seat, 0, KEY_TAB,
+					  WL_KEYBOARD_KEY_STATE_PRESSED);
+	start = module_bench_now_usec();
+	for (i = 0; i < BENCH_OPS; i++)
+		keyboard->grab->interface->key(keyboard->grab, 0, KEY_TAB,
+					       WL_KEYBOARD_KEY_STATE_PRESSED);
+	switcher_time = module_bench_now_usec() - start;
+	bench->base.seat.modifier_state = 0;
+	keyboard->grab->interface->cancel(keyboard->grab);
+
+	if (bench->workspaces) {
+		start = module_bench_now_usec();
+		for (i = 0; i < BENCH_OPS / 2; i++) {
+			bench_click(bench, bench->surfaces[rand() %
+							   bench->n_surfaces]);
+			bench_key(bench, KEY_DOWN,
+				  MODIFIER_SUPER | MODIFIER_SHIFT);
+			bench_key(bench, KEY_UP,
+				  MODIFIER_SUPER | MODIFIER_SHIFT);
+		}
+		move_time = module_bench_now_usec() - start;
+
+		start = module_bench_now_usec();
+		for (i = 0; i < BENCH_OPS / 2; i++) {
+			bench_key(bench, KEY_DOWN, MODIFIER_SUPER);
+			bench_key(bench, KEY_UP, MODIFIER_SUPER);
+		}
+		switch_time = module_bench_now_usec() - start;
+	}
+
+	fprintf(stderr, "%5d surfaces: map %.1f us, activate %.1f us, "
+		"switcher step %.1f us, move %.1f us, switch %.1f us\n",
+		bench->n_surfaces, map_time / mapped,
+		activate_time / BENCH_OPS,
+		switcher_time / BENCH_OPS,
+		move_time / BENCH_OPS,
+		switch_time / BENCH_OPS);
+}
+
+static void
+bench_run(struct module_bench *base)
+{
+	struct shell_bench *bench =
+		container_of(base, struct shell_bench, base);
+	int max = bench_sizes[ARRAY_LENGTH(bench_sizes) - 1];
+	double start, map_time;
+	unsigned int i;
+	int mapped;
+
+	if (!bench->base.compositor->shell_interface.create_shell_surface) {
+		fprintf(stderr, "no shell loaded\n");
+		goto out;
+	}
+
+	bench->surfaces = calloc(max, sizeof *bench->surfaces);
+	if (!bench->surfaces)
+		goto out;
+
+	weston_seat_init_pointer(&base->seat);
+	weston_seat_init_keyboard(&base->seat, NULL);
+
+	srand(0);
+	for (i = 0; i < ARRAY_LENGTH(bench_sizes); i++) {
+		mapped = bench_sizes[i] - bench->n_surfaces;
+		start = module_bench_now_usec();
+		if (bench_map(bench, bench_sizes[i]) < 0) {
+			fprintf(stderr, "failed to create surfaces\n");
+			break;
+		}
+		map_time = module_bench_now_usec() - start;
+
+		if (i == 0)
+			bench_check_workspaces(bench);
+		bench_measure(bench, map_time, mapped);
+	}
+
+	weston_pointer_set_focus(bench->base.seat.pointer, NULL, 0, 0);
+	start = module_bench_now_usec();
+	for (i = 0; i < (unsigned int) bench->n_surfaces; i++)
+		weston_surface_destroy(bench->surfaces[i]);
+	fprintf(stderr, "destroy %.1f us per surface\n",
+		(module_bench_now_usec() - start) / bench->n_surfaces);
+
+	free(bench->surfaces);
+
+out:
+	module_bench_finish(base);
+	free(bench);
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor, int *argc, char *argv[])
+{
+	struct shell_bench *bench;
+
+	bench = calloc(1, sizeof *bench);
+	if (!bench)
+		return -1;
+
+	if (module_bench_start(&bench->base, compositor, "shell-bench",
+			       bench_run) < 0) {
+		free(bench);
+		return -1;
+	}
+
+	return 0;
+}
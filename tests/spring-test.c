@@ -0,0 +1,195 @@
+/*
+ * Copyright © 2014 Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "weston-test-runner.h"
+
+#include "../src/compositor.h"
+
+/* animation.c is linked in directly, as for spring-tool. */
+WL_EXPORT void
+weston_view_geometry_dirty(struct weston_view *view)
+{
+}
+
+WL_EXPORT void
+weston_view_damage_animation(struct weston_view *view, int geometry_changed)
+{
+}
+
+WL_EXPORT int
+weston_log(const char *fmt, ...)
+{
+	return 0;
+}
+
+WL_EXPORT void
+weston_view_schedule_repaint(struct weston_view *view)
+{
+}
+
+/* The 4 ms step integrator weston_spring_update() used to run. */
+static void
+reference_spring_update(struct weston_spring *spring, uint32_t msec)
+{
+	double force, v, current, step;
+
+	if (msec - spring->timestamp > 1000)
+		spring->timestamp = msec - 1000;
+
+	step = 0.01;
+	while (4 < msec - spring->timestamp) {
+		current = spring->current;
+		v = current - spring->previous;
+		force = spring->k * (spring->target - current) / 10.0 +
+			(spring->previous - current) - v * spring->friction;
+
+		spring->current =
+			current + (current - spring->previous) +
+			force * step * step;
+		spring->previous = current;
+
+		switch (spring->clip) {
+		case WESTON_SPRING_OVERSHOOT:
+			break;
+
+		case WESTON_SPRING_CLAMP:
+			if (spring->current > spring->max) {
+				spring->current = spring->max;
+				spring->previous = spring->max;
+			} else if (spring->current < 0.0) {
+				spring->current = spring->min;
+				spring->previous = spring->min;
+			}
+			break;
+
+		case WESTON_SPRING_BOUNCE:
+			if (spring->current > spring->max) {
+				spring->current =
+					2 * spring->max - spring->current;
+				spring->previous =
+					2 * spring->max - spring->previous;
+			} else if (spring->current < spring->min) {
+				spring->current =
+					2 * spring->min - spring->current;
+				spring->previous =
+					2 * spring->min - spring->previous;
+			}
+			break;
+		}
+
+		spring->timestamp += 4;
+	}
+}
+
+struct spring_test_data {
+	double k, friction;
+	double current, previous, target;
+	uint32_t clip;
+};
+
+/* The springs set up by animation.c, zoom.c and the shell, plus an
+ * overdamped and a barely damped one. */
+static const struct spring_test_data spring_data[] = {
+	{ 200.0, 700.0, 0.0, 0.0, 1.0, WESTON_SPRING_OVERSHOOT },
+	{ 300.0, 1400.0, 0.5, 0.485, 1.0, WESTON_SPRING_OVERSHOOT },
+	{ 300.0, 1400.0, 1.0, 1.015, 0.5, WESTON_SPRING_OVERSHOOT },
+	{ 250.0, 1000.0, 0.0, 0.0, 0.8, WESTON_SPRING_OVERSHOOT },
+	{ 400.0, 600.0, 0.0, 0.0, 1.0, WESTON_SPRING_BOUNCE },
+	{ 400.0, 600.0, 0.0, 0.0, 1.0, WESTON_SPRING_CLAMP },
+	{ 20.0, 20000.0, 0.0, 0.0, 1.0, WESTON_SPRING_OVERSHOOT },
+	{ 2000.0, 10.0, 0.0, 0.0, 1.0, WESTON_SPRING_OVERSHOOT },
+};
+
+/* Frame intervals in ms, cycled through; includes stalls past the one
+ * second cap. */
+static const uint32_t frame_intervals[] = {
+	16, 16, 17, 7, 33, 16, 250, 16, 1, 0, 4, 5, 16, 1500, 16, 16,
+};
+
+static void
+init_spring(struct weston_spring *spring, const struct spring_test_data *d,
+	    uint32_t timestamp)
+{
+	weston_spring_init(spring, d->k, d->current, d->target);
+	spring->friction = d->friction;
+	spring->previous = d->previous;
+	spring->clip = d->clip;
+	spring->timestamp = timestamp;
+}
+
+TEST_P(spring_matches_integrator, spring_data)
+{
+	const struct spring_test_data *d = data;
+	struct weston_spring spring, reference;
+	uint32_t msec = 0xfffff000;	/* wraps during the run */
+	double diff, max_diff = 0.0;
+	int i;
+
+	init_spring(&spring, d, msec);
+	init_spring(&reference, d, msec);
+
+	for (i = 0; i < 400; i++) {
+		msec += frame_intervals[i % ARRAY_LENGTH(frame_intervals)];
+
+		weston_spring_update(&spring, msec);
+		reference_spring_update(&reference, msec);
+
+		assert(spring.timestamp == reference.timestamp);
+
+		diff = fabs(spring.current - reference.current);
+		if (diff > max_diff)
+			max_diff = diff;
+		assert(diff < 1e-12);
+		assert(fabs(spring.previous - reference.previous) < 1e-12);
+		assert(weston_spring_done(&spring) ==
+		       weston_spring_done(&reference));
+	}
+
+	fprintf(stderr, "k %g friction %g: max difference %g\n",
+		d->k, d->friction, max_diff);
+}
+
+TEST(spring_settles_after_stall)
+{
+	struct weston_spring spring, reference;
+
+	weston_spring_init(&spring, 200.0, 0.0, 1.0);
+	spring.friction = 700;
+	spring.timestamp = 0;
+	reference = spring;
+
+	/* A single update covering a full second of steps lands where
+	 * stepping through them does, with the fade spring at rest. */
+	weston_spring_update(&spring, 1000);
+	reference_spring_update(&reference, 1000);
+
+	assert(spring.timestamp == 996);
+	assert(fabs(spring.current - reference.current) < 1e-12);
+	assert(weston_spring_done(&spring));
+}
@@ -0,0 +1,263 @@
+/*
+ * Copyright © 2014 Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "weston-test-runner.h"
+
+#include "../src/timer-wheel.h"
+
+/* The wheel is driven by hand from a fake clock, without an event
+ * loop. */
+static uint64_t fake_time;
+
+static uint64_t
+get_fake_time(void)
+{
+	return fake_time;
+}
+
+static void
+wheel_setup(struct timer_wheel *wheel, uint64_t start)
+{
+	timer_wheel_init(wheel, NULL);
+	fake_time = start;
+	wheel->get_time = get_fake_time;
+	wheel->current = (uint32_t) (start / TIMER_WHEEL_TICK);
+}
+
+struct test_timer {
+	struct wheel_timer timer;
+	uint32_t due;		/* tick it must fire on */
+	int fired;
+	int armed;
+};
+
+static int
+count_fire(void *data)
+{
+	struct test_timer *t = data;
+
+	t->fired++;
+
+	return 0;
+}
+
+static uint32_t
+due_tick(uint32_t msec)
+{
+	return (uint32_t) (fake_time / TIMER_WHEEL_TICK) +
+		(msec + TIMER_WHEEL_TICK - 1) / TIMER_WHEEL_TICK;
+}
+
+TEST(timer_fires_on_its_tick)
+{
+	struct timer_wheel wheel;
+	struct test_timer t = { .fired = 0 };
+
+	wheel_setup(&wheel, 1000);
+	wheel_timer_init(&t.timer, count_fire, &t);
+	wheel_timer_update(&wheel, &t.timer, 200);
+	assert(wheel_timer_pending(&t.timer));
+	assert(wheel.stats.active == 1);
+
+	fake_time += 199;
+	timer_wheel_advance(&wheel);
+	assert(t.fired == 0);
+
+	fake_time += 1;
+	timer_wheel_advance(&wheel);
+	assert(t.fired == 1);
+	assert(!wheel_timer_pending(&t.timer));
+	assert(wheel.stats.active == 0);
+
+	fake_time += 10000;
+	timer_wheel_advance(&wheel);
+	assert(t.fired == 1);
+
+	timer_wheel_release(&wheel);
+}
+
+TEST(cancelled_timer_does_not_fire)
+{
+	struct timer_wheel wheel;
+	struct test_timer t = { .fired = 0 };
+
+	wheel_setup(&wheel, 0);
+	wheel_timer_init(&t.timer, count_fire, &t);
+	wheel_timer_update(&wheel, &t.timer, 100000);
+	wheel_timer_cancel(&wheel, &t.timer);
+	assert(!wheel_timer_pending(&t.timer));
+
+	wheel_timer_update(&wheel, &t.timer, 50);
+	wheel_timer_update(&wheel, &t.timer, 0);
+	assert(wheel.stats.active == 0);
+
+	fake_time += 200000;
+	timer_wheel_advance(&wheel);
+	assert(t.fired == 0);
+
+	timer_wheel_release(&wheel);
+}
+
+static struct timer_wheel *periodic_wheel;
+
+static int
+periodic_fire(void *data)
+{
+	struct test_timer *t = data;
+
+	t->fired++;
+	if (t->fired < 10)
+		wheel_timer_update(periodic_wheel, &t->timer, 1000);
+
+	return 0;
+}
+
+TEST(timer_rearms_from_callback)
+{
+	struct timer_wheel wheel;
+	struct test_timer t = { .fired = 0 };
+	int i;
+
+	wheel_setup(&wheel, 5);
+	periodic_wheel = &wheel;
+	wheel_timer_init(&t.timer, periodic_fire, &t);
+	wheel_timer_update(&wheel, &t.timer, 1000);
+
+	for (i = 1; i <= 20; i++) {
+		fake_time += 1000;
+		timer_wheel_advance(&wheel);
+		assert(t.fired == (i < 10 ? i : 10));
+	}
+
+	timer_wheel_release(&wheel);
+}
+
+#define NUM_TIMERS 500
+
+static uint32_t
+random_delay(void)
+{
+	switch (rand() % 4) {
+	case 0:
+		return 1 + rand() % 600;
+	case 1:
+		return 1 + rand() % 40000;
+	case 2:
+		return 1 + rand() % 3000000;
+	default:
+		/* Longer than the whole wheel. */
+		return 1 + rand() % 30000000;
+	}
+}
+
+static uint32_t
+random_step(void)
+{
+	switch (rand() % 8) {
+	case 0:
+		return rand() % 2000000;
+	case 1:
+	case 2:
+		return rand() % 50000;
+	default:
+		return rand() % 40;
+	}
+}
+
+TEST(random_timers_fire_exactly_once_on_time)
+{
+	struct timer_wheel wheel;
+	struct test_timer *timers, *t;
+	uint32_t now, active;
+	int i, round;
+
+	srand(0x5eed);
+	timers = calloc(NUM_TIMERS, sizeof *timers);
+	assert(timers);
+
+	/* Start close to the 32 bit wrap of the tick counter. */
+	wheel_setup(&wheel, ((uint64_t) 1 << 32) * TIMER_WHEEL_TICK - 500000);
+	for (i = 0; i < NUM_TIMERS; i++)
+		wheel_timer_init(&timers[i].timer, count_fire, &timers[i]);
+
+	for (round = 0; round < 20000; round++) {
+		t = &timers[rand() % NUM_TIMERS];
+		switch (rand() % 3) {
+		case 0:
+		case 1:
+			if (t->armed)
+				assert(t->fired == 0);
+			t->fired = 0;
+			t->due = due_tick(random_delay());
+			t->armed = 1;
+			wheel_timer_update(&wheel, &t->timer,
+					   (t->due - (uint32_t) (fake_time /
+					    TIMER_WHEEL_TICK)) *
+					   TIMER_WHEEL_TICK);
+			break;
+		case 2:
+			wheel_timer_cancel(&wheel, &t->timer);
+			t->armed = 0;
+			t->fired = 0;
+			break;
+		}
+
+		fake_time += random_step();
+		timer_wheel_advance(&wheel);
+
+		now = fake_time / TIMER_WHEEL_TICK;
+		active = 0;
+		for (i = 0; i < NUM_TIMERS; i++) {
+			t = &timers[i];
+			if (!t->armed) {
+				assert(t->fired == 0);
+				assert(!wheel_timer_pending(&t->timer));
+				continue;
+			}
+
+			if ((int32_t) (now - t->due) >= 0) {
+				assert(t->fired == 1);
+				assert(!wheel_timer_pending(&t->timer));
+				t->armed = 0;
+				t->fired = 0;
+			} else {
+				assert(t->fired == 0);
+				assert(wheel_timer_pending(&t->timer));
+				active++;
+			}
+		}
+		assert(wheel.stats.active == active);
+	}
+
+	timer_wheel_release(&wheel);
+	for (i = 0; i < NUM_TIMERS; i++)
+		assert(!wheel_timer_pending(&timers[i].timer));
+
+	free(timers);
+}
@@ -217,3 +217,169 @@ TEST(float_difference_same)
 	assert(float_difference(1.0f, 1.0f) == 0.0f);
 }
 
+
+#define BATCH_RECTS 13
+
+/* What the GL renderer computed for one rect before the batch calls:
+ * reject on the bounding box, then clip. */
+static int
+clip_single_reference(const struct polygon8 *surf, GLfloat x1, GLfloat y1,
+		      GLfloat x2, GLfloat y2, int transformed,
+		      GLfloat *ex, GLfloat *ey)
+{
+	struct clip_context ctx;
+	struct polygon8 polygon = *surf;
+	GLfloat min_x, max_x, min_y, max_y;
+	int i, n;
+
+	min_x = max_x = surf->x[0];
+	min_y = max_y = surf->y[0];
+	for (i = 1; i < surf->n; i++) {
+		min_x = fminf(min_x, surf->x[i]);
+		max_x = fmaxf(max_x, surf->x[i]);
+		min_y = fminf(min_y, surf->y[i]);
+		max_y = fmaxf(max_y, surf->y[i]);
+	}
+
+	if (min_x >= x2 || max_x <= x1 || min_y >= y2 || max_y <= y1)
+		return 0;
+
+	ctx.clip.x1 = x1;
+	ctx.clip.y1 = y1;
+	ctx.clip.x2 = x2;
+	ctx.clip.y2 = y2;
+
+	if (!transformed)
+		return clip_simple(&ctx, &polygon, ex, ey);
+
+	n = clip_transformed(&ctx, &polygon, ex, ey);
+	if (n < 3)
+		return 0;
+
+	return n;
+}
+
+static GLfloat
+random_coord(void)
+{
+	return (GLfloat)(random() % 4000) / 8.0f - 100.0f;
+}
+
+static void
+random_quad(struct polygon8 *surf, int transformed)
+{
+	GLfloat cx = random_coord(), cy = random_coord();
+	GLfloat w = random() % 300 + 1, h = random() % 300 + 1;
+	GLfloat phi = transformed ? (random() % 3600) * M_PI / 1800.0 : 0.0;
+	GLfloat c = cosf(phi), s = sinf(phi);
+	static const GLfloat corner_x[4] = { -0.5f, 0.5f, 0.5f, -0.5f };
+	static const GLfloat corner_y[4] = { -0.5f, -0.5f, 0.5f, 0.5f };
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		GLfloat x = corner_x[i] * w, y = corner_y[i] * h;
+
+		surf->x[i] = cx + c * x + s * y;
+		surf->y[i] = cy - s * x + c * y;
+	}
+	surf->n = 4;
+}
+
+static void
+check_batch(int transformed)
+{
+	GLfloat x1[BATCH_RECTS], y1[BATCH_RECTS];
+	GLfloat x2[BATCH_RECTS], y2[BATCH_RECTS];
+	GLfloat ex[8 * BATCH_RECTS], ey[8 * BATCH_RECTS];
+	GLfloat rx[8], ry[8];
+	int vtxcnt[BATCH_RECTS];
+	struct clip_rects rects = { x1, y1, x2, y2, 0 };
+	struct polygon8 surf;
+	int iter, i, j, n, npoly, p, v;
+
+	srandom(4);
+
+	for (iter = 0; iter < 20000; iter++) {
+		random_quad(&surf, transformed);
+
+		/* vary the count so the tail of the batch is covered */
+		rects.n = iter % BATCH_RECTS + 1;
+		for (i = 0; i < rects.n; i++) {
+			x1[i] = random_coord();
+			y1[i] = random_coord();
+			x2[i] = x1[i] + random() % 200 + 1;
+			y2[i] = y1[i] + random() % 200 + 1;
+		}
+
+		if (transformed)
+			npoly = clip_transformed_batch(&surf, &rects,
+						       ex, ey, vtxcnt);
+		else
+			npoly = clip_simple_batch(&surf, &rects,
+						  ex, ey, vtxcnt);
+
+		p = 0;
+		v = 0;
+		for (i = 0; i < rects.n; i++) {
+			n = clip_single_reference(&surf, x1[i], y1[i],
+						  x2[i], y2[i], transformed,
+						  rx, ry);
+			if (n == 0)
+				continue;
+
+			assert(p < npoly);
+			assert(vtxcnt[p] == n);
+			for (j = 0; j < n; j++) {
+				assert(ex[v + j] == rx[j]);
+				assert(ey[v + j] == ry[j]);
+			}
+			v += n;
+			p++;
+		}
+		assert(p == npoly);
+	}
+}
+
+TEST(clip_transformed_batch_matches_single)
+{
+	check_batch(1);
+}
+
+TEST(clip_simple_batch_matches_single)
+{
+	check_batch(0);
+}
+
+TEST(clip_batch_skips_disjoint_rects)
+{
+	GLfloat x1[] = { 0.0f, 200.0f, 20.0f, 0.0f, 300.0f };
+	GLfloat y1[] = { 0.0f, 200.0f, 20.0f, 0.0f, 0.0f };
+	GLfloat x2[] = { 100.0f, 300.0f, 30.0f, 10.0f, 400.0f };
+	GLfloat y2[] = { 100.0f, 300.0f, 30.0f, 10.0f, 100.0f };
+	struct clip_rects rects = { x1, y1, x2, y2, 5 };
+	struct polygon8 surf = {
+		{ 10.0f, 50.0f, 50.0f, 10.0f },
+		{ 10.0f, 10.0f, 50.0f, 50.0f },
+		4
+	};
+	GLfloat ex[8 * 5], ey[8 * 5];
+	int vtxcnt[5];
+	int npoly;
+
+	/* The polygon overlaps rects 0 and 2 only; rect 3 touches it
+	 * at a corner without overlapping. */
+	npoly = clip_transformed_batch(&surf, &rects, ex, ey, vtxcnt);
+	assert(npoly == 2);
+	assert(vtxcnt[0] == 4 && vtxcnt[1] == 4);
+
+	/* rect 0 contains the polygon, so it comes out unchanged */
+	assert(ex[0] == 10.0f && ey[0] == 10.0f);
+	assert(ex[2] == 50.0f && ey[2] == 50.0f);
+
+	/* rect 2 is inside the polygon, so its corners come out */
+	assert(ex[5] == 20.0f && ey[5] == 20.0f);
+	assert(ex[7] == 30.0f && ey[7] == 30.0f);
+
+	npoly = clip_simple_batch(&surf, &rects, ex, ey, vtxcnt);
+	assert(npoly == 2);
+}
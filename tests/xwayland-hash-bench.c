@@ -0,0 +1,195 @@
+/*
+ * Copyright © 2014 Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../src/xwayland/hash.h"
+#include "xwayland-hash-knuth.h"
+
+#define LOOKUPS (1 << 22)
+#define CHURNS (1 << 14)
+
+static struct timespec begin_time;
+
+static void
+reset_timer(void)
+{
+	clock_gettime(CLOCK_MONOTONIC, &begin_time);
+}
+
+static double
+read_timer(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (double)(t.tv_sec - begin_time.tv_sec) +
+	       1e-9 * (t.tv_nsec - begin_time.tv_nsec);
+}
+
+/* The ids an X server hands out: a few clients, each with a base in
+ * the high bits and a counter in the low ones. */
+static void
+make_ids(uint32_t *ids, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		ids[i] = ((uint32_t) (i % 4 + 1) << 21) | (i / 4 + 1);
+}
+
+struct ops {
+	const char *name;
+	void *(*create)(void);
+	void (*destroy)(void *table);
+	void *(*lookup)(void *table, uint32_t id);
+	int (*insert)(void *table, uint32_t id, void *data);
+	void (*remove)(void *table, uint32_t id);
+};
+
+static void *
+current_create(void)
+{
+	return hash_table_create();
+}
+
+static void
+current_destroy(void *table)
+{
+	hash_table_destroy(table);
+}
+
+static void *
+current_lookup(void *table, uint32_t id)
+{
+	return hash_table_lookup(table, id);
+}
+
+static int
+current_insert(void *table, uint32_t id, void *data)
+{
+	return hash_table_insert(table, id, data);
+}
+
+static void
+current_remove(void *table, uint32_t id)
+{
+	hash_table_remove(table, id);
+}
+
+static void *
+knuth_create(void)
+{
+	return knuth_hash_table_create();
+}
+
+static void
+knuth_destroy(void *table)
+{
+	knuth_hash_table_destroy(table);
+}
+
+static void *
+knuth_lookup(void *table, uint32_t id)
+{
+	return knuth_hash_table_lookup(table, id);
+}
+
+static int
+knuth_insert(void *table, uint32_t id, void *data)
+{
+	return knuth_hash_table_insert(table, id, data);
+}
+
+static void
+knuth_remove(void *table, uint32_t id)
+{
+	knuth_hash_table_remove(table, id);
+}
+
+static const struct ops tables[] = {
+	{ "knuth", knuth_create, knuth_destroy,
+	  knuth_lookup, knuth_insert, knuth_remove },
+	{ "current", current_create, current_destroy,
+	  current_lookup, current_insert, current_remove },
+};
+
+static void
+bench(const struct ops *ops, int n)
+{
+	uint32_t *ids;
+	void *table;
+	unsigned long found = 0;
+	double t_hit, t_miss, t_churn;
+	int i;
+
+	ids = malloc(2 * n * sizeof *ids);
+	make_ids(ids, 2 * n);
+
+	table = ops->create();
+	for (i = 0; i < n; i++)
+		ops->insert(table, ids[i], &ids[i]);
+
+	reset_timer();
+	for (i = 0; i < LOOKUPS; i++)
+		found += ops->lookup(table, ids[i & (n - 1)]) != NULL;
+	t_hit = read_timer();
+
+	/* events for windows the wm does not track, like the root */
+	reset_timer();
+	for (i = 0; i < LOOKUPS; i++)
+		found += ops->lookup(table, ids[n + (i & (n - 1))]) != NULL;
+	t_miss = read_timer();
+
+	/* windows being destroyed and created, keeping n alive */
+	reset_timer();
+	for (i = 0; i < CHURNS; i++) {
+		ops->remove(table, ids[i % (2 * n)]);
+		ops->insert(table, ids[(i + n) % (2 * n)],
+			    &ids[(i + n) % (2 * n)]);
+	}
+	t_churn = read_timer();
+
+	printf("%-8s %6d windows: hit %6.2f ns, miss %6.2f ns, "
+	       "remove+insert %6.2f ns (%lu)\n", ops->name, n,
+	       1e9 * t_hit / LOOKUPS, 1e9 * t_miss / LOOKUPS,
+	       1e9 * t_churn / CHURNS, found);
+
+	ops->destroy(table);
+	free(ids);
+}
+
+int
+main(void)
+{
+	int n;
+	unsigned int i;
+
+	for (n = 16; n <= 4096; n *= 4)
+		for (i = 0; i < sizeof tables / sizeof tables[0]; i++)
+			bench(&tables[i], n);
+
+	return 0;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright © 2009 Intel Corporation
+ * Copyright © 1988-2004 Keith Packard and Bart Massey.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the names of the authors
+ * or their institutions shall not be used in advertising or
+ * otherwise to promote the sale, use or other dealings in this
+ * Software without prior written authorization from the
+ * authors.
+ *
+ * Authors:
+ *    Eric Anholt <eric@anholt.net>
+ *    Keith Packard <keithp@keithp.com>
+ */
+
+#ifndef KNUTH_HASH_H
+#define KNUTH_HASH_H
+
+/* The double hashing table that src/xwayland/hash.c used to be, kept
+ * as a reference for xwayland-hash-test and xwayland-hash-bench. */
+
+struct knuth_hash_table;
+struct knuth_hash_table *knuth_hash_table_create(void);
+typedef void (*knuth_hash_table_iterator_func_t)(void *element, void *data);
+
+void knuth_hash_table_destroy(struct knuth_hash_table *ht);
+void *knuth_hash_table_lookup(struct knuth_hash_table *ht, uint32_t hash);
+int knuth_hash_table_insert(struct knuth_hash_table *ht, uint32_t hash, void *data);
+void knuth_hash_table_remove(struct knuth_hash_table *ht, uint32_t hash);
+void knuth_hash_table_for_each(struct knuth_hash_table *ht,
+			 knuth_hash_table_iterator_func_t func, void *data);
+
+#endif
@@ -0,0 +1,173 @@
+/*
+ * Copyright © 2014 Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "weston-test-runner.h"
+
+#include "../src/xwayland/hash.h"
+#include "xwayland-hash-knuth.h"
+
+#define KEY_SPACE 4096
+
+static void *
+data_for(uint32_t key)
+{
+	return (void *) (((uintptr_t) key << 1) | 1);
+}
+
+/* X resource ids: a per-client base in the high bits, and a small
+ * counter in the low ones. */
+static uint32_t
+random_xid(void)
+{
+	return ((uint32_t) (random() % 8 + 1) << 21) |
+		(uint32_t) (random() % (KEY_SPACE / 8));
+}
+
+static void
+check_all(struct hash_table *ht, struct knuth_hash_table *ref,
+	  const uint32_t *keys, int nkeys)
+{
+	int i;
+
+	for (i = 0; i < nkeys; i++)
+		assert(hash_table_lookup(ht, keys[i]) ==
+		       knuth_hash_table_lookup(ref, keys[i]));
+}
+
+TEST(hash_matches_knuth_table)
+{
+	struct hash_table *ht = hash_table_create();
+	struct knuth_hash_table *ref = knuth_hash_table_create();
+	uint32_t keys[KEY_SPACE];
+	uint32_t key;
+	int i, nkeys = 0;
+
+	assert(ht && ref);
+	srandom(48);
+
+	for (i = 0; i < 200000; i++) {
+		key = random_xid();
+
+		/* Grow towards a few thousand entries, then churn
+		 * around that size so removals hit long probe runs. */
+		switch (random() % (i < 20000 ? 4 : 3)) {
+		case 0:
+		case 3:
+			if (knuth_hash_table_lookup(ref, key))
+				break;
+			assert(hash_table_insert(ht, key,
+						 data_for(key)) == 0);
+			knuth_hash_table_insert(ref, key, data_for(key));
+			if (nkeys < KEY_SPACE)
+				keys[nkeys++] = key;
+			break;
+		case 1:
+			hash_table_remove(ht, key);
+			knuth_hash_table_remove(ref, key);
+			break;
+		case 2:
+			assert(hash_table_lookup(ht, key) ==
+			       knuth_hash_table_lookup(ref, key));
+			break;
+		}
+
+		if (i % 1000 == 0)
+			check_all(ht, ref, keys, nkeys);
+	}
+
+	check_all(ht, ref, keys, nkeys);
+
+	hash_table_destroy(ht);
+	knuth_hash_table_destroy(ref);
+}
+
+TEST(hash_random_keys)
+{
+	struct hash_table *ht = hash_table_create();
+	uint32_t keys[1000];
+	int i;
+
+	assert(ht);
+	srandom(4);
+
+	for (i = 0; i < 1000; i++) {
+		keys[i] = random();
+		assert(hash_table_insert(ht, keys[i], data_for(keys[i])) == 0);
+	}
+
+	for (i = 0; i < 1000; i += 2)
+		hash_table_remove(ht, keys[i]);
+
+	for (i = 0; i < 1000; i++)
+		assert(hash_table_lookup(ht, keys[i]) ==
+		       (i % 2 ? data_for(keys[i]) : NULL));
+
+	hash_table_destroy(ht);
+}
+
+TEST(hash_insert_replaces)
+{
+	struct hash_table *ht = hash_table_create();
+	int a, b;
+
+	assert(ht);
+	assert(hash_table_insert(ht, 7, &a) == 0);
+	assert(hash_table_insert(ht, 7, &b) == 0);
+	assert(hash_table_lookup(ht, 7) == &b);
+
+	hash_table_remove(ht, 7);
+	assert(hash_table_lookup(ht, 7) == NULL);
+	hash_table_remove(ht, 7);
+
+	hash_table_destroy(ht);
+}
+
+static void
+count_element(void *element, void *data)
+{
+	int *count = data;
+
+	assert(element != NULL);
+	(*count)++;
+}
+
+TEST(hash_for_each_visits_every_element)
+{
+	struct hash_table *ht = hash_table_create();
+	uint32_t i;
+	int count = 0;
+
+	assert(ht);
+	for (i = 1; i <= 100; i++)
+		assert(hash_table_insert(ht, i, data_for(i)) == 0);
+	for (i = 1; i <= 100; i += 3)
+		hash_table_remove(ht, i);
+
+	hash_table_for_each(ht, count_element, &count);
+	assert(count == 66);
+
+	hash_table_destroy(ht);
+}
@@ -0,0 +1,374 @@
+/*
+ * Copyright © 2014 Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Selection throughput benchmark for the Xwayland window manager.  Run
+ * it as
+ *
+ *   ./weston-tests-env xwayland-selection-bench [megabytes]
+ *
+ * It owns CLIPBOARD with a large UTF8_STRING and serves it with INCR in
+ * 256 KiB chunks, the way toolkits do, while the window manager copies
+ * it into the Wayland clipboard manager (X to Wayland).  It then drops
+ * ownership, so the window manager claims CLIPBOARD on behalf of the
+ * clipboard manager's copy, and converts the selection back (Wayland
+ * to X), checking the contents and reporting the INCR chunk sizes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <xcb/xcb.h>
+
+#define OWNER_CHUNK_SIZE (256 * 1024)
+
+struct bench {
+	xcb_connection_t *conn;
+	xcb_screen_t *screen;
+	xcb_window_t owner;
+	xcb_window_t requestor;
+	xcb_atom_t clipboard, utf8_string, targets, incr, property;
+
+	char *data;
+	size_t size;
+};
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static xcb_atom_t
+intern(xcb_connection_t *conn, const char *name)
+{
+	xcb_intern_atom_reply_t *reply;
+	xcb_atom_t atom;
+
+	reply = xcb_intern_atom_reply(conn,
+				      xcb_intern_atom(conn, 0, strlen(name),
+						      name),
+				      NULL);
+	atom = reply ? reply->atom : XCB_ATOM_NONE;
+	free(reply);
+
+	return atom;
+}
+
+static xcb_window_t
+create_window(struct bench *bench)
+{
+	uint32_t values[1] = { XCB_EVENT_MASK_PROPERTY_CHANGE };
+	xcb_window_t window;
+
+	window = xcb_generate_id(bench->conn);
+	xcb_create_window(bench->conn, XCB_COPY_FROM_PARENT, window,
+			  bench->screen->root, 0, 0, 10, 10, 0,
+			  XCB_WINDOW_CLASS_INPUT_OUTPUT,
+			  bench->screen->root_visual,
+			  XCB_CW_EVENT_MASK, values);
+
+	return window;
+}
+
+static void
+send_notify(struct bench *bench, xcb_selection_request_event_t *request,
+	    xcb_atom_t property)
+{
+	xcb_selection_notify_event_t notify;
+
+	memset(&notify, 0, sizeof notify);
+	notify.response_type = XCB_SELECTION_NOTIFY;
+	notify.time = request->time;
+	notify.requestor = request->requestor;
+	notify.selection = request->selection;
+	notify.target = request->target;
+	notify.property = property;
+
+	xcb_send_event(bench->conn, 0, request->requestor,
+		       XCB_EVENT_MASK_NO_EVENT, (char *) &notify);
+}
+
+/* X to Wayland: serve our selection until one INCR transfer of the
+ * data has completed. */
+static int
+serve_selection(struct bench *bench)
+{
+	xcb_selection_request_event_t request, *r;
+	xcb_property_notify_event_t *p;
+	xcb_generic_event_t *event;
+	uint32_t values[1] = { XCB_EVENT_MASK_PROPERTY_CHANGE };
+	xcb_atom_t targets[2] = { bench->targets, bench->utf8_string };
+	size_t offset = 0, len;
+	int sending = 0, chunks = 0;
+	uint32_t incr_size = bench->size;
+	double start = 0;
+
+	xcb_set_selection_owner(bench->conn, bench->owner, bench->clipboard,
+				XCB_TIME_CURRENT_TIME);
+	xcb_flush(bench->conn);
+
+	while ((event = xcb_wait_for_event(bench->conn))) {
+		switch (event->response_type & ~0x80) {
+		case XCB_SELECTION_REQUEST:
+			r = (xcb_selection_request_event_t *) event;
+			if (r->target == bench->targets) {
+				xcb_change_property(bench->conn,
+						    XCB_PROP_MODE_REPLACE,
+						    r->requestor, r->property,
+						    XCB_ATOM_ATOM, 32,
+						    2, targets);
+				send_notify(bench, r, r->property);
+			} else if (r->target == bench->utf8_string &&
+				   !sending) {
+				request = *r;
+				xcb_change_window_attributes(bench->conn,
+							     r->requestor,
+							     XCB_CW_EVENT_MASK,
+							     values);
+				xcb_change_property(bench->conn,
+						    XCB_PROP_MODE_REPLACE,
+						    r->requestor, r->property,
+						    bench->incr, 32,
+						    1, &incr_size);
+				send_notify(bench, r, r->property);
+				sending = 1;
+				offset = 0;
+				start = now();
+			} else {
+				send_notify(bench, r, XCB_ATOM_NONE);
+			}
+			xcb_flush(bench->conn);
+			break;
+
+		case XCB_PROPERTY_NOTIFY:
+			p = (xcb_property_notify_event_t *) event;
+			if (!sending || p->window != request.requestor ||
+			    p->atom != request.property ||
+			    p->state != XCB_PROPERTY_DELETE)
+				break;
+
+			len = bench->size - offset;
+			if (len > OWNER_CHUNK_SIZE)
+				len = OWNER_CHUNK_SIZE;
+			xcb_change_property(bench->conn,
+					    XCB_PROP_MODE_REPLACE,
+					    request.requestor,
+					    request.property,
+					    bench->utf8_string, 8,
+					    len, bench->data + offset);
+			xcb_flush(bench->conn);
+			offset += len;
+			chunks++;
+
+			if (len == 0) {
+				printf("X to Wayland: %zu bytes in %.3f s, "
+				       "%.1f MB/s, %d chunks\n",
+				       bench->size, now() - start,
+				       bench->size / (now() - start) / 1e6,
+				       chunks);
+				free(event);
+				return 0;
+			}
+			break;
+		}
+
+		free(event);
+	}
+
+	return -1;
+}
+
+static xcb_generic_event_t *
+wait_for_event(struct bench *bench, uint8_t type)
+{
+	xcb_generic_event_t *event;
+
+	while ((event = xcb_wait_for_event(bench->conn))) {
+		if ((event->response_type & ~0x80) == type)
+			return event;
+		free(event);
+	}
+
+	return NULL;
+}
+
+static xcb_get_property_reply_t *
+take_property(struct bench *bench)
+{
+	return xcb_get_property_reply(bench->conn,
+		xcb_get_property(bench->conn, 1, bench->requestor,
+				 bench->property, XCB_GET_PROPERTY_TYPE_ANY,
+				 0, 0x1fffffff),
+		NULL);
+}
+
+/* Wayland to X: convert the selection the window manager now owns and
+ * read it back through INCR. */
+static int
+receive_selection(struct bench *bench)
+{
+	xcb_get_selection_owner_reply_t *owner;
+	xcb_get_property_reply_t *reply;
+	xcb_generic_event_t *event;
+	xcb_property_notify_event_t *p;
+	size_t received = 0, len, largest = 0;
+	int chunks = 0, tries, mismatch = 0;
+	double start;
+
+	for (tries = 0; tries < 500; tries++) {
+		owner = xcb_get_selection_owner_reply(bench->conn,
+			xcb_get_selection_owner(bench->conn, bench->clipboard),
+			NULL);
+		if (owner && owner->owner != XCB_WINDOW_NONE &&
+		    owner->owner != bench->owner) {
+			free(owner);
+			break;
+		}
+		free(owner);
+		usleep(10000);
+	}
+	if (tries == 500) {
+		fprintf(stderr, "window manager did not take the selection\n");
+		return -1;
+	}
+
+	start = now();
+	xcb_convert_selection(bench->conn, bench->requestor, bench->clipboard,
+			      bench->utf8_string, bench->property,
+			      XCB_TIME_CURRENT_TIME);
+	xcb_flush(bench->conn);
+
+	event = wait_for_event(bench, XCB_SELECTION_NOTIFY);
+	if (!event ||
+	    ((xcb_selection_notify_event_t *) event)->property == XCB_ATOM_NONE) {
+		fprintf(stderr, "selection conversion failed\n");
+		free(event);
+		return -1;
+	}
+	free(event);
+
+	reply = take_property(bench);
+	if (reply && reply->type == bench->incr) {
+		free(reply);
+		xcb_flush(bench->conn);
+		while ((event = wait_for_event(bench, XCB_PROPERTY_NOTIFY))) {
+			p = (xcb_property_notify_event_t *) event;
+			if (p->atom != bench->property ||
+			    p->state != XCB_PROPERTY_NEW_VALUE) {
+				free(event);
+				continue;
+			}
+			free(event);
+
+			reply = take_property(bench);
+			xcb_flush(bench->conn);
+			if (!reply)
+				break;
+			len = xcb_get_property_value_length(reply);
+			if (len == 0) {
+				free(reply);
+				break;
+			}
+			if (received + len > bench->size ||
+			    memcmp(bench->data + received,
+				   xcb_get_property_value(reply), len))
+				mismatch = 1;
+			received += len;
+			if (len > largest)
+				largest = len;
+			chunks++;
+			free(reply);
+		}
+	} else if (reply) {
+		len = xcb_get_property_value_length(reply);
+		if (len != bench->size ||
+		    memcmp(bench->data, xcb_get_property_value(reply), len))
+			mismatch = 1;
+		received = largest = len;
+		chunks = 1;
+		free(reply);
+	}
+
+	printf("Wayland to X: %zu bytes in %.3f s, %.1f MB/s, "
+	       "%d chunks, largest %zu bytes%s\n",
+	       received, now() - start, received / (now() - start) / 1e6,
+	       chunks, largest,
+	       mismatch || received != bench->size ? ", DATA MISMATCH" : "");
+
+	return mismatch || received != bench->size ? -1 : 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	struct bench bench;
+	size_t i;
+	int ret;
+
+	memset(&bench, 0, sizeof bench);
+	bench.size = (argc > 1 ? atoi(argv[1]) : 32) * 1024 * 1024;
+	bench.data = malloc(bench.size);
+	if (!bench.data)
+		return 1;
+	for (i = 0; i < bench.size; i++)
+		bench.data[i] = i % 79 == 78 ? '\n' : 'a' + i % 26;
+
+	bench.conn = xcb_connect(NULL, NULL);
+	if (xcb_connection_has_error(bench.conn)) {
+		fprintf(stderr, "failed to connect to the X server\n");
+		return 1;
+	}
+	bench.screen = xcb_setup_roots_iterator(xcb_get_setup(bench.conn)).data;
+
+	bench.clipboard = intern(bench.conn, "CLIPBOARD");
+	bench.utf8_string = intern(bench.conn, "UTF8_STRING");
+	bench.targets = intern(bench.conn, "TARGETS");
+	bench.incr = intern(bench.conn, "INCR");
+	bench.property = intern(bench.conn, "SELECTION_BENCH");
+
+	bench.owner = create_window(&bench);
+	bench.requestor = create_window(&bench);
+
+	ret = serve_selection(&bench);
+
+	/* Give the clipboard manager time to drain the last chunk from its
+	 * pipe before its copy becomes the selection. */
+	usleep(200000);
+	xcb_set_selection_owner(bench.conn, XCB_WINDOW_NONE, bench.clipboard,
+				XCB_TIME_CURRENT_TIME);
+	xcb_flush(bench.conn);
+
+	if (ret == 0)
+		ret = receive_selection(&bench);
+
+	xcb_disconnect(bench.conn);
+	free(bench.data);
+
+	return ret == 0 ? 0 : 1;
+}